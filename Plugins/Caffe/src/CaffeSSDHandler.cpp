@@ -43,6 +43,9 @@ void SSDHandler::handleOutput(const caffe::Net<float>& net, const std::vector<cv
     for (size_t i = 0; i < static_cast<size_t>(num_detections); ++i) {
         if ((detection_threshold.size() == 1 && confidence[static_cast<int>(i)][0] > detection_threshold[0]) || (labels[static_cast<int>(i)][0] < detection_threshold.size() && confidence[static_cast<int>(i)][0] > detection_threshold[static_cast<size_t>(labels[static_cast<int>(i)][0])])) {
             size_t         num = static_cast<size_t>(roi_num[static_cast<int>(i)][0]);
+            // Detections of padded batch slots have no roi
+            if (num >= bounding_boxes.size())
+                continue;
             DetectedObject obj;
             obj.bounding_box.x      = xmin[static_cast<int>(i)][0] * bounding_boxes[num].width + bounding_boxes[num].x;
             obj.bounding_box.y      = ymin[static_cast<int>(i)][0] * bounding_boxes[num].height + bounding_boxes[num].y;
@@ -0,0 +1,198 @@
+#include "BlobPreprocessing.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace {
+// Source sample positions for one axis, same mapping as cv::resize INTER_LINEAR
+struct AxisTable {
+    std::vector<int>   ofs0;
+    std::vector<int>   ofs1;
+    std::vector<float> alpha;
+
+    AxisTable(int src_size, int dst_size, int stride) {
+        ofs0.resize(dst_size);
+        ofs1.resize(dst_size);
+        alpha.resize(dst_size);
+        const double ratio = double(src_size) / double(dst_size);
+        for (int d = 0; d < dst_size; ++d) {
+            const double f = (d + 0.5) * ratio - 0.5;
+            int          s = static_cast<int>(std::floor(f));
+            float        a = static_cast<float>(f - s);
+            if (s < 0) {
+                s = 0;
+                a = 0.0f;
+            }
+            if (s >= src_size - 1) {
+                s = src_size - 1;
+                a = 0.0f;
+            }
+            ofs0[d]  = s * stride;
+            ofs1[d]  = std::min(s + 1, src_size - 1) * stride;
+            alpha[d] = a;
+        }
+    }
+};
+
+// Horizontally resamples one source row into CN planar float rows
+template <typename T, int CN>
+void resampleRow(const T* src, const AxisTable& xtab, float* dst, int dst_width) {
+    for (int x = 0; x < dst_width; ++x) {
+        const T*    p0 = src + xtab.ofs0[x];
+        const T*    p1 = src + xtab.ofs1[x];
+        const float a  = xtab.alpha[x];
+        for (int c = 0; c < CN; ++c) {
+            const float v0         = static_cast<float>(p0[c]);
+            dst[c * dst_width + x] = v0 + a * (static_cast<float>(p1[c]) - v0);
+        }
+    }
+}
+
+// dst = (r0 + b * (r1 - r0)) * scale + offset
+void blendRows(const float* r0, const float* r1, float b, float scale, float offset, float* dst, int width) {
+    int x = 0;
+#if CV_SIMD128
+    const cv::v_float32x4 vb(b, b, b, b);
+    const cv::v_float32x4 vscale(scale, scale, scale, scale);
+    const cv::v_float32x4 voffset(offset, offset, offset, offset);
+    for (; x <= width - 4; x += 4) {
+        const cv::v_float32x4 v0 = cv::v_load(r0 + x);
+        const cv::v_float32x4 v1 = cv::v_load(r1 + x);
+        const cv::v_float32x4 v  = cv::v_muladd(v1 - v0, vb, v0);
+        cv::v_store(dst + x, cv::v_muladd(v, vscale, voffset));
+    }
+#endif
+    for (; x < width; ++x) {
+        dst[x] = (r0[x] + b * (r1[x] - r0[x])) * scale + offset;
+    }
+}
+
+template <typename T, int CN>
+void preprocessImpl(const cv::Mat& src, const cv::Rect& roi, const cv::Scalar& mean, float scale,
+    std::vector<cv::Mat>& planes, int row_begin, int row_end) {
+    const int       dst_width  = planes[0].cols;
+    const int       dst_height = planes[0].rows;
+    const AxisTable xtab(roi.width, dst_width, CN);
+    const AxisTable ytab(roi.height, dst_height, 1);
+
+    float offsets[CN];
+    for (int c = 0; c < CN; ++c)
+        offsets[c] = static_cast<float>(-mean[c] * scale);
+
+    // Two cached horizontally resampled rows, consecutive output rows mostly share source rows
+    std::vector<float> buffer(2 * CN * dst_width);
+    float*             rows[2]   = {buffer.data(), buffer.data() + CN * dst_width};
+    int                cached[2] = {-1, -1};
+    auto               sourceRow = [&](int y, int slot) {
+        if (cached[slot] == y)
+            return;
+        if (cached[1 - slot] == y) {
+            std::swap(rows[0], rows[1]);
+            std::swap(cached[0], cached[1]);
+            return;
+        }
+        resampleRow<T, CN>(src.ptr<T>(roi.y + y) + roi.x * CN, xtab, rows[slot], dst_width);
+        cached[slot] = y;
+    };
+
+    for (int y = row_begin; y < row_end; ++y) {
+        const int   y0 = ytab.ofs0[y];
+        const int   y1 = ytab.ofs1[y];
+        const float b  = ytab.alpha[y];
+        sourceRow(y0, 0);
+        if (b != 0.0f)
+            sourceRow(y1, 1);
+        for (int c = 0; c < CN; ++c) {
+            const float* r0 = rows[0] + c * dst_width;
+            const float* r1 = b != 0.0f ? rows[1] + c * dst_width : r0;
+            blendRows(r0, r1, b, scale, offsets[c], planes[c].ptr<float>(y), dst_width);
+        }
+    }
+}
+
+typedef void (*PreprocessFunc_t)(const cv::Mat&, const cv::Rect&, const cv::Scalar&, float, std::vector<cv::Mat>&, int, int);
+
+template <typename T>
+PreprocessFunc_t selectChannels(int cn) {
+    switch (cn) {
+    case 1:
+        return &preprocessImpl<T, 1>;
+    case 2:
+        return &preprocessImpl<T, 2>;
+    case 3:
+        return &preprocessImpl<T, 3>;
+    case 4:
+        return &preprocessImpl<T, 4>;
+    default:
+        return nullptr;
+    }
+}
+
+class PreprocessBody : public cv::ParallelLoopBody {
+public:
+    PreprocessBody(const cv::Mat& src, const std::vector<cv::Rect>& rois, const cv::Scalar& mean, float scale,
+        std::vector<std::vector<cv::Mat> >& net_input, int bands)
+        : _src(src)
+        , _rois(rois)
+        , _mean(mean)
+        , _scale(scale)
+        , _net_input(net_input)
+        , _bands(bands) {
+    }
+
+    void operator()(const cv::Range& range) const {
+        for (int task = range.start; task < range.end; ++task) {
+            const int roi    = task / _bands;
+            const int band   = task % _bands;
+            const int height = _net_input[roi][0].rows;
+            preprocessRoi(_src, _rois[roi], _mean, _scale, _net_input[roi],
+                height * band / _bands, height * (band + 1) / _bands);
+        }
+    }
+
+private:
+    const cv::Mat&                      _src;
+    const std::vector<cv::Rect>&        _rois;
+    const cv::Scalar&                   _mean;
+    float                               _scale;
+    std::vector<std::vector<cv::Mat> >& _net_input;
+    int                                 _bands;
+};
+}
+
+void aq::nodes::preprocessRoi(const cv::Mat& src, const cv::Rect& roi, const cv::Scalar& mean, float scale,
+    std::vector<cv::Mat>& planes, int row_begin, int row_end) {
+    CV_Assert(static_cast<int>(planes.size()) == src.channels());
+    CV_Assert((roi & cv::Rect(0, 0, src.cols, src.rows)) == roi && roi.area() > 0);
+    if (row_end < 0)
+        row_end = planes[0].rows;
+    PreprocessFunc_t func = nullptr;
+    if (src.depth() == CV_8U)
+        func = selectChannels<uchar>(src.channels());
+    else if (src.depth() == CV_32F)
+        func = selectChannels<float>(src.channels());
+    if (func == nullptr) {
+        cv::Mat converted;
+        src(roi).convertTo(converted, CV_32F);
+        func = selectChannels<float>(converted.channels());
+        CV_Assert(func);
+        func(converted, cv::Rect(0, 0, roi.width, roi.height), mean, scale, planes, row_begin, row_end);
+        return;
+    }
+    func(src, roi, mean, scale, planes, row_begin, row_end);
+}
+
+void aq::nodes::preprocessRois(const cv::Mat& src, const std::vector<cv::Rect>& rois, const cv::Scalar& mean, float scale,
+    std::vector<std::vector<cv::Mat> >& net_input) {
+    CV_Assert(net_input.size() >= rois.size());
+    if (rois.empty())
+        return;
+    const int count = static_cast<int>(rois.size());
+    // Split each roi into row bands when there are fewer rois than threads
+    const int bands = std::max(1, cv::getNumThreads() / count);
+    cv::parallel_for_(cv::Range(0, count * bands), PreprocessBody(src, rois, mean, scale, net_input, bands));
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "CoreExport.hpp"
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace aq {
+namespace nodes {
+    // Single pass network input preparation. Crops roi out of src, resizes it bilinearly to the
+    // size of planes (same sampling as cv::resize INTER_LINEAR), computes (value - mean) * scale and
+    // writes channel c into planes[c]. Equivalent to convertTo(CV_32F), subtract, multiply, resize
+    // and split without any full image temporaries. src is CV_8U or CV_32F with 1 to 4 channels,
+    // other depths are converted first. Only output rows [row_begin, row_end) are written.
+    Core_EXPORT void preprocessRoi(const cv::Mat& src, const cv::Rect& roi, const cv::Scalar& mean, float scale,
+        std::vector<cv::Mat>& planes, int row_begin = 0, int row_end = -1);
+
+    // preprocessRoi of rois[i] into net_input[i], parallel across rois and across output rows
+    // when there are fewer rois than threads
+    Core_EXPORT void preprocessRois(const cv::Mat& src, const std::vector<cv::Rect>& rois, const cv::Scalar& mean, float scale,
+        std::vector<std::vector<cv::Mat> >& net_input);
+}
+}
@@ -64,6 +64,10 @@ bool FlowVectorDisplay::processImpl()
 
 bool HistogramDisplay::processImpl()
 {
+#ifndef HAVE_CUDA
+    MO_LOG_EVERY_N(warning, 100) << "HistogramDisplay requires a CUDA build";
+    return false;
+#else
     if(draw.empty())
     {
         cv::Mat h_draw;
@@ -88,10 +92,15 @@ bool HistogramDisplay::processImpl()
         getDataStream()->getWindowCallbackManager()->imshowd(name, output_image, cv::WINDOW_OPENGL);
     }, gui_thread_id, stream());
     return true;
+#endif
 }
 
 bool HistogramOverlay::processImpl()
 {
+#ifndef HAVE_CUDA
+    MO_LOG_EVERY_N(warning, 100) << "HistogramOverlay requires a CUDA build";
+    return false;
+#else
     if(draw.empty())
     {
         cv::Mat h_draw;
@@ -112,6 +121,7 @@ bool HistogramOverlay::processImpl()
                   cv::noArray(), -1, stream());
     output_param.updateData(output_image, image_param.getTimestamp(), _ctx.get());
     return true;
+#endif
 }
 
 bool DetectionDisplay::processImpl()
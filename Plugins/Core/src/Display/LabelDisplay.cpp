@@ -13,6 +13,10 @@ using namespace aq::nodes;
 
 bool LabelDisplay::processImpl()
 {
+#ifndef HAVE_CUDA
+    MO_LOG_EVERY_N(warning, 100) << "LabelDisplay requires a CUDA build";
+    return false;
+#else
     if(d_lut.empty() ||
        (display_legend && d_legend.size() != label->getSize()))
     {
@@ -93,6 +97,7 @@ bool LabelDisplay::processImpl()
         return true;
     }
     return false;
+#endif
 
 }
 
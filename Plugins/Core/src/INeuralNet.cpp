@@ -1,9 +1,10 @@
 #include "INeuralNet.hpp"
+#include "BlobPreprocessing.hpp"
 #include <opencv2/cudaarithm.hpp>
 #include <opencv2/cudawarping.hpp>
-#ifndef NDEBUG
 #include <opencv2/imgproc.hpp>
-#endif
+
+#include <algorithm>
 
 void aq::nodes::INeuralNet::on_weight_file_modified(mo::IParam*, mo::Context*, mo::OptionalTime_t, size_t,
                                                     const std::shared_ptr<mo::ICoordinateSystem>&, mo::UpdateFlags){
@@ -17,14 +18,338 @@ void aq::nodes::INeuralNet::preBatch(int batch_size) {
 void aq::nodes::INeuralNet::postBatch() {
 }
 
+std::vector<std::vector<cv::Mat> > aq::nodes::INeuralNet::getNetImageInputHost(int requested_batch_size) {
+    (void)requested_batch_size;
+    return std::vector<std::vector<cv::Mat> >();
+}
+
+void aq::nodes::INeuralNet::dispatchMiniBatch(const std::vector<cv::Rect>& pixel_bounding_boxes, size_t start, size_t end,
+                                              const std::vector<cv::Rect2f>& default_roi) {
+    std::vector<cv::Rect>         batch_bounding_boxes;
+    std::vector<DetectedObject2d> batch_detections;
+    for (size_t j = start; j < end; ++j) {
+        batch_bounding_boxes.push_back(pixel_bounding_boxes[j]);
+    }
+    if (input_detections != nullptr && bounding_boxes == &default_roi) {
+        for (size_t j = start; j < end; ++j)
+            batch_detections.push_back((*input_detections)[j]);
+    }
+    postMiniBatch(batch_bounding_boxes, batch_detections);
+}
+
+bool aq::nodes::INeuralNet::forwardAllHost(const std::vector<cv::Rect>& pixel_bounding_boxes,
+                                           std::vector<std::vector<cv::Mat> >& net_input,
+                                           std::vector<cv::Rect2f>& default_roi) {
+    const bool on_device = input->getSyncState() >= SyncedMemory::DEVICE_UPDATED;
+    cv::Mat    h_input   = input->getMat(stream());
+    if (on_device)
+        stream().waitForCompletion();
+    MO_ASSERT(net_input[0].size() == static_cast<size_t>(h_input.channels()));
+
+    // Crop, resize, mean subtraction, scaling and deinterleaving happen in one pass straight into the
+    // network's input buffer, without full image float temporaries
+    for (size_t i = 0; i < pixel_bounding_boxes.size();) {
+        const size_t start = i;
+        const size_t end   = std::min(start + net_input.size(), pixel_bounding_boxes.size());
+        const std::vector<cv::Rect> batch(pixel_bounding_boxes.begin() + start, pixel_bounding_boxes.begin() + end);
+        preprocessRois(h_input, batch, channel_mean, pixel_scale, net_input);
+        padInput(net_input, batch.size());
+        i = end;
+        if (forwardMinibatch()) {
+            dispatchMiniBatch(pixel_bounding_boxes, start, end, default_roi);
+        }
+    }
+    postBatch();
+    if (bounding_boxes == &default_roi) {
+        bounding_boxes = nullptr;
+    }
+    return true;
+}
+
+bool aq::nodes::INeuralNet::queueFrame(const std::vector<cv::Rect>& pixel_bounding_boxes, std::vector<cv::Rect2f>& default_roi) {
+    if (getNetImageInputHost().empty()) {
+        MO_LOG_FIRST_N(warning, 1) << "cross_frame_batching needs a backend with a host input, running frames individually";
+        return false;
+    }
+    QueuedFrame frame;
+    frame.bounding_boxes = pixel_bounding_boxes;
+    if (input_detections != nullptr && bounding_boxes == &default_roi) {
+        frame.detections.assign(input_detections->begin(), input_detections->end());
+    }
+    frame.image        = *input;
+    frame.timestamp    = input_param.getTimestamp();
+    frame.frame_number = input_param.getFrameNumber();
+    frame.queued       = std::chrono::steady_clock::now();
+
+    if (!pixel_bounding_boxes.empty()) {
+        // Same input size forwardAll reshapes the network to, minus the batch dimension
+        const auto                input_image_shape = input->getShape();
+        cv::Scalar_<unsigned int> shape             = getNetworkShape();
+        shape[0]                                    = 0;
+        const bool tiled = tiled_inference && input_detections == nullptr && bounding_boxes == &default_roi;
+        if (image_scale > 0 && !tiled) {
+            shape[1] = static_cast<unsigned int>(input_image_shape[3]);
+            shape[2] = static_cast<unsigned int>(input_image_shape[1] * image_scale);
+            shape[3] = static_cast<unsigned int>(input_image_shape[2] * image_scale);
+        }
+        // Rois of differently sized inputs can't share a forward pass
+        if (_queued_rois != 0 && shape != _queued_shape) {
+            forwardAllQueued();
+        }
+        _queued_shape = shape;
+
+        const bool on_device = input->getSyncState() >= SyncedMemory::DEVICE_UPDATED;
+        cv::Mat    h_input   = input->getMat(stream());
+        if (on_device)
+            stream().waitForCompletion();
+        MO_ASSERT(shape[1] == static_cast<unsigned int>(h_input.channels()));
+        // Preprocessed right away so the queue doesn't depend on the producer keeping its buffer
+        const cv::Size plane_size(static_cast<int>(shape[3]), static_cast<int>(shape[2]));
+        frame.net_input.resize(pixel_bounding_boxes.size());
+        for (auto& planes : frame.net_input) {
+            while (!_plane_pool.empty() && planes.empty()) {
+                const auto& pooled = _plane_pool.back();
+                if (pooled.size() == shape[1] && pooled[0].size() == plane_size)
+                    planes = std::move(_plane_pool.back());
+                _plane_pool.pop_back();
+            }
+            if (planes.empty()) {
+                for (unsigned int c = 0; c < shape[1]; ++c)
+                    planes.emplace_back(plane_size, CV_32F);
+                ++_input_allocations;
+            }
+        }
+        preprocessRois(h_input, frame.bounding_boxes, channel_mean, pixel_scale, frame.net_input);
+    }
+    _queued_rois += pixel_bounding_boxes.size();
+    _frame_queue.push_back(std::move(frame));
+
+    forwardDue();
+    if (bounding_boxes == &default_roi) {
+        bounding_boxes = nullptr;
+    }
+    return true;
+}
+
+void aq::nodes::INeuralNet::forwardQueued(size_t max_rois) {
+    std::vector<QueuedFrame> frames;
+    size_t                   rois = 0;
+    while (!_frame_queue.empty() && (frames.empty() || rois + _frame_queue.front().bounding_boxes.size() <= max_rois)) {
+        rois += _frame_queue.front().bounding_boxes.size();
+        frames.push_back(std::move(_frame_queue.front()));
+        _frame_queue.pop_front();
+    }
+    _queued_rois -= rois;
+
+    bool                                batched   = false;
+    bool                                forwarded = false;
+    std::vector<std::vector<cv::Mat> > net_input;
+    if (rois != 0) {
+        if (reshapeInput(static_cast<unsigned int>(rois), _queued_shape[1], _queued_shape[2], _queued_shape[3])) {
+            net_input = getNetImageInputHost(static_cast<int>(rois));
+            batched   = net_input.size() >= rois;
+        }
+        if (batched) {
+            size_t idx = 0;
+            for (const auto& frame : frames) {
+                for (const auto& planes : frame.net_input) {
+                    for (size_t c = 0; c < planes.size(); ++c)
+                        planes[c].copyTo(net_input[idx][c]);
+                    ++idx;
+                }
+            }
+            padInput(net_input, rois);
+            forwarded = forwardMinibatch();
+        } else {
+            MO_LOG_FIRST_N(warning, 1) << "The network can't be reshaped to a batch of " << rois
+                                       << " rois, running queued frames one after the other";
+            net_input.clear();
+            if (reshapeInput(1, _queued_shape[1], _queued_shape[2], _queued_shape[3]))
+                net_input = getNetImageInputHost();
+            if (net_input.empty()) {
+                MO_LOG(warning) << "Unable to reshape the network to " << _queued_shape[1] << "x" << _queued_shape[2] << "x"
+                                << _queued_shape[3] << ", skipping " << frames.size() << " queued frames";
+            }
+        }
+    }
+
+    const auto now     = std::chrono::steady_clock::now();
+    float      latency = 0.0f;
+    for (const auto& frame : frames)
+        latency += std::chrono::duration<float, std::milli>(now - frame.queued).count();
+    batch_fill_param.updateData(static_cast<float>(rois) / static_cast<float>(max_rois));
+    batch_queue_latency_param.updateData(latency / static_cast<float>(frames.size()));
+
+    // Results go out frame by frame stamped with the frame they were computed from
+    _batch_input_param.setMtx(_mtx);
+    _batch_input_param.updatePtr(&_batch_input);
+    _current_input = &_batch_input_param;
+    size_t offset  = 0;
+    for (const auto& frame : frames) {
+        if (frame.timestamp) {
+            _batch_input_param.updateData(frame.image, mo::tag::_timestamp = *frame.timestamp,
+                mo::tag::_frame_number = frame.frame_number, _ctx.get());
+        } else {
+            _batch_input_param.updateData(frame.image, mo::tag::_frame_number = frame.frame_number, _ctx.get());
+        }
+        preBatch(static_cast<int>(frame.bounding_boxes.size()));
+        if (batched && forwarded && !frame.bounding_boxes.empty()) {
+            _minibatch_offset = offset;
+            postMiniBatch(frame.bounding_boxes, frame.detections);
+        } else if (!batched && !net_input.empty() && !frame.bounding_boxes.empty()) {
+            forwardQueuedFrame(frame, net_input);
+        }
+        postBatch();
+        offset += frame.bounding_boxes.size();
+        for (auto& planes : frame.net_input)
+            _plane_pool.push_back(std::move(planes));
+    }
+    _minibatch_offset = 0;
+    _current_input    = nullptr;
+}
+
+void aq::nodes::INeuralNet::forwardQueuedFrame(QueuedFrame& frame, std::vector<std::vector<cv::Mat> >& net_input) {
+    _minibatch_offset = 0;
+    for (size_t start = 0; start < frame.bounding_boxes.size();) {
+        const size_t end = std::min(start + net_input.size(), frame.bounding_boxes.size());
+        for (size_t i = start; i < end; ++i) {
+            for (size_t c = 0; c < frame.net_input[i].size(); ++c)
+                frame.net_input[i][c].copyTo(net_input[i - start][c]);
+        }
+        padInput(net_input, end - start);
+        if (forwardMinibatch()) {
+            const std::vector<cv::Rect> batch_bb(frame.bounding_boxes.begin() + start, frame.bounding_boxes.begin() + end);
+            std::vector<DetectedObject2d> batch_detections;
+            if (!frame.detections.empty())
+                batch_detections.assign(frame.detections.begin() + start, frame.detections.begin() + end);
+            postMiniBatch(batch_bb, batch_detections);
+        }
+        start = end;
+    }
+}
+
+void aq::nodes::INeuralNet::forwardDue() {
+    const size_t max_rois = static_cast<size_t>(std::max(max_batch_size, 1));
+    const auto   now      = std::chrono::steady_clock::now();
+    while (!_frame_queue.empty() && (_queued_rois >= max_rois ||
+                                        std::chrono::duration<float, std::milli>(now - _frame_queue.front().queued).count() >= batch_deadline)) {
+        forwardQueued(max_rois);
+    }
+}
+
+bool aq::nodes::INeuralNet::process() {
+    {
+        mo::Mutex_t::scoped_lock lock(*_mtx);
+        if (!_frame_queue.empty())
+            forwardDue();
+    }
+    return Node::process();
+}
+
+void aq::nodes::INeuralNet::eos() {
+    mo::Mutex_t::scoped_lock lock(*_mtx);
+    forwardAllQueued();
+}
+
+void aq::nodes::INeuralNet::forwardAllQueued() {
+    while (!_frame_queue.empty()) {
+        forwardQueued(static_cast<size_t>(std::max(max_batch_size, 1)));
+    }
+}
+
+mo::ITParam<aq::SyncedMemory>& aq::nodes::INeuralNet::currentInputParam() {
+    if (_current_input != nullptr)
+        return *_current_input;
+    return input_param;
+}
+
+std::vector<cv::Rect> aq::nodes::INeuralNet::tileImage(cv::Size image_size, cv::Size tile_size, cv::Size stride) {
+    // Tiles start every stride pixels, the last one is aligned with the far border so the whole
+    // image is covered with every tile at full size
+    auto positions = [](int size, int tile, int step) {
+        std::vector<int> output;
+        if (tile >= size) {
+            output.push_back(0);
+            return output;
+        }
+        for (int pos = 0; pos + tile < size; pos += step)
+            output.push_back(pos);
+        output.push_back(size - tile);
+        return output;
+    };
+    const int             width  = std::min(tile_size.width, image_size.width);
+    const int             height = std::min(tile_size.height, image_size.height);
+    std::vector<cv::Rect> tiles;
+    if (width <= 0 || height <= 0)
+        return tiles;
+    const std::vector<int> xs = positions(image_size.width, width, std::max(stride.width, 1));
+    const std::vector<int> ys = positions(image_size.height, height, std::max(stride.height, 1));
+    for (int y : ys) {
+        for (int x : xs)
+            tiles.emplace_back(x, y, width, height);
+    }
+    return tiles;
+}
+
+unsigned int aq::nodes::INeuralNet::batchBucket(unsigned int num) const {
+    unsigned int bucket = 0;
+    for (int size : batch_buckets) {
+        if (size > 0 && static_cast<unsigned int>(size) >= num && (bucket == 0 || static_cast<unsigned int>(size) < bucket))
+            bucket = static_cast<unsigned int>(size);
+    }
+    return bucket != 0 ? bucket : num;
+}
+
+bool aq::nodes::INeuralNet::reshapeInput(unsigned int num, unsigned int channels, unsigned int height, unsigned int width) {
+    const cv::Scalar_<unsigned int> shape(batchBucket(num), channels, height, width);
+    if (shape == getNetworkShape())
+        return true;
+    ++_network_reshapes;
+    if (reshapeNetwork(shape[0], shape[1], shape[2], shape[3]))
+        return true;
+    if (shape[0] == num)
+        return false;
+    MO_LOG_FIRST_N(warning, 1) << "Batch bucket " << shape[0] << " rejected by the network, using " << num;
+    if (cv::Scalar_<unsigned int>(num, channels, height, width) == getNetworkShape())
+        return true;
+    ++_network_reshapes;
+    return reshapeNetwork(num, channels, height, width);
+}
+
+void aq::nodes::INeuralNet::padInput(std::vector<std::vector<cv::Mat> >& net_input, size_t used) {
+    // Keeps whatever the network computes for the spare slots independent of earlier frames
+    for (size_t i = used; i < net_input.size(); ++i) {
+        for (auto& plane : net_input[i])
+            plane.setTo(cv::Scalar::all(0));
+    }
+}
+
+void aq::nodes::INeuralNet::padInput(std::vector<std::vector<cv::cuda::GpuMat> >& net_input, size_t used) {
+    for (size_t i = used; i < net_input.size(); ++i) {
+        for (auto& plane : net_input[i])
+            plane.setTo(cv::Scalar::all(0), stream());
+    }
+}
+
+NODE_PROFILE_IMPL(aq::nodes::INeuralNet)
+
 bool aq::nodes::INeuralNet::processImpl() {
+    NodeProfiler::Scope<INeuralNet> profile(_profiler, *this);
+    _network_reshapes  = 0;
+    _input_allocations = 0;
+    bool processed     = false;
     if (initNetwork()) {
-        return forwardAll();
+        processed = forwardAll();
     }
-    return false;
+    network_reshapes_param.updateData(_network_reshapes);
+    input_allocations_param.updateData(_input_allocations);
+    return processed;
 }
 
 bool aq::nodes::INeuralNet::forwardAll() {
+    if (!cross_frame_batching && !_frame_queue.empty()) {
+        forwardAllQueued();
+    }
     std::vector<cv::Rect2f> defaultROI;
     auto                    input_image_shape = input->getShape();
     defaultROI.push_back(cv::Rect2f(0, 0, 1.0, 1.0));
@@ -32,6 +357,24 @@ bool aq::nodes::INeuralNet::forwardAll() {
         bounding_boxes = &defaultROI;
     }
 
+    // Tiles replace the whole image roi, explicit rois and detections take precedence
+    std::vector<cv::Rect> tile_rects;
+    if (tiled_inference && bounding_boxes == &defaultROI && input_detections == nullptr) {
+        const cv::Scalar_<unsigned int> net_shape = getNetworkShape();
+        const cv::Size                  tile(tile_width > 0 ? tile_width : static_cast<int>(net_shape[3]),
+            tile_height > 0 ? tile_height : static_cast<int>(net_shape[2]));
+        const float                     overlap = std::min(std::max(tile_overlap, 0.0f), 0.95f);
+        const cv::Size                  stride(tile_stride > 0 ? tile_stride : std::max(1, cvRound(tile.width * (1.0f - overlap))),
+            tile_stride > 0 ? tile_stride : std::max(1, cvRound(tile.height * (1.0f - overlap))));
+        tile_rects = tileImage(cv::Size(input_image_shape[2], input_image_shape[1]), tile, stride);
+        defaultROI.clear();
+        for (const auto& rect : tile_rects) {
+            defaultROI.emplace_back(static_cast<float>(rect.x) / input_image_shape[2], static_cast<float>(rect.y) / input_image_shape[1],
+                static_cast<float>(rect.width) / input_image_shape[2], static_cast<float>(rect.height) / input_image_shape[1]);
+        }
+        tiles_param.updateData(defaultROI, mo::tag::_param = input_param, _ctx.get());
+    }
+
     if (input_detections != nullptr && bounding_boxes == &defaultROI) {
         defaultROI.clear();
         for (const auto& itr : *input_detections) {
@@ -42,6 +385,10 @@ bool aq::nodes::INeuralNet::forwardAll() {
                 itr.bounding_box.height / input_image_shape[1]);
         }
         if (defaultROI.size() == 0) {
+            // Frames without rois still have to come out in order behind the queued ones
+            if (cross_frame_batching && !_frame_queue.empty() && queueFrame(std::vector<cv::Rect>(), defaultROI)) {
+                return false;
+            }
             bounding_boxes = nullptr;
             preBatch(0);
             postBatch();
@@ -58,17 +405,23 @@ bool aq::nodes::INeuralNet::forwardAll() {
     cv::Scalar_<unsigned int> network_input_shape = getNetworkShape();
     float net_ar = float(network_input_shape[3]) / float(network_input_shape[2]);
     std::vector<cv::Rect> pixel_bounding_boxes;
+    // Tiles are used in pixels as generated, going through normalized coordinates could move them by a pixel
     for (size_t i = 0; i < bounding_boxes->size(); ++i) {
         cv::Rect bb;
+        if (!tile_rects.empty()) {
+            pixel_bounding_boxes.push_back(tile_rects[i]);
+            continue;
+        }
         bb.x      = static_cast<int>((*bounding_boxes)[i].x * input_image_shape[2]);
         bb.y      = static_cast<int>((*bounding_boxes)[i].y * input_image_shape[1]);
-        bb.width  = static_cast<int>((*bounding_boxes)[i].width * input_image_shape[2]);
-        bb.height = static_cast<int>((*bounding_boxes)[i].height * input_image_shape[1]);
-        if (bb.x + bb.width >= input_image_shape[2]) {
-            bb.x -= input_image_shape[2] - bb.width;
+        bb.width  = std::min(static_cast<int>((*bounding_boxes)[i].width * input_image_shape[2]), input_image_shape[2]);
+        bb.height = std::min(static_cast<int>((*bounding_boxes)[i].height * input_image_shape[1]), input_image_shape[1]);
+        // Rois reaching past the border are shifted back inside the image
+        if (bb.x + bb.width > input_image_shape[2]) {
+            bb.x = input_image_shape[2] - bb.width;
         }
-        if (bb.y + bb.height >= input_image_shape[1]) {
-            bb.y -= input_image_shape[1] - bb.height;
+        if (bb.y + bb.height > input_image_shape[1]) {
+            bb.y = input_image_shape[1] - bb.height;
         }
         bb.x = std::max(0, bb.x);
         bb.y = std::max(0, bb.y);
@@ -82,18 +435,47 @@ bool aq::nodes::INeuralNet::forwardAll() {
 #endif
     }
 
+    if (cross_frame_batching && queueFrame(pixel_bounding_boxes, defaultROI)) {
+        return true;
+    }
 
-    if (image_scale > 0) {
-        reshapeNetwork(static_cast<unsigned int>(bounding_boxes->size()),
+    // The image sized reshape already sets the batch, reshaping the batch alone afterwards would
+    // restore the previous input size and flip the network between two shapes every frame
+    cv::Scalar_<unsigned int> requested_shape = network_input_shape;
+    bool                      reshaped        = true;
+    if (!tile_rects.empty()) {
+        // Tiles are resized to the network input and run tile_batch_size at a time
+        requested_shape[0] = std::min(static_cast<unsigned int>(tile_rects.size()), static_cast<unsigned int>(std::max(tile_batch_size, 1)));
+        reshaped           = reshapeInput(requested_shape[0], requested_shape[1], requested_shape[2], requested_shape[3]);
+    } else if (image_scale > 0) {
+        requested_shape = cv::Scalar_<unsigned int>(static_cast<unsigned int>(bounding_boxes->size()),
             static_cast<unsigned int>(input_image_shape[3]),
             static_cast<unsigned int>(input_image_shape[1] * image_scale),
             static_cast<unsigned int>(input_image_shape[2] * image_scale));
+        reshaped = reshapeInput(requested_shape[0], requested_shape[1], requested_shape[2], requested_shape[3]);
+    } else if (pixel_bounding_boxes.size() != network_input_shape[0] && input_detections == nullptr) {
+        requested_shape[0] = static_cast<unsigned int>(bounding_boxes->size());
+        reshaped           = reshapeInput(requested_shape[0], requested_shape[1], requested_shape[2], requested_shape[3]);
+    }
+    if (!reshaped) {
+        // Mini batches of the current batch size still work as long as a single roi fits the input
+        const cv::Scalar_<unsigned int> current = getNetworkShape();
+        if (current[1] != requested_shape[1] || current[2] != requested_shape[2] || current[3] != requested_shape[3]) {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to reshape the network to " << requested_shape[1] << "x" << requested_shape[2] << "x"
+                                         << requested_shape[3] << ", skipping frame " << input_param.getFrameNumber();
+            if (bounding_boxes == &defaultROI) {
+                bounding_boxes = nullptr;
+            }
+            return false;
+        }
+        MO_LOG_FIRST_N(warning, 1) << "The network can't be reshaped to a batch of " << requested_shape[0] << ", running mini batches of "
+                                   << current[0];
     }
-    if (pixel_bounding_boxes.size() != network_input_shape[0] && input_detections == nullptr) {
-        reshapeNetwork(static_cast<unsigned int>(bounding_boxes->size()),
-            network_input_shape[1],
-            network_input_shape[2],
-            network_input_shape[3]);
+
+    preBatch(static_cast<int>(pixel_bounding_boxes.size()));
+    auto h_net_input = getNetImageInputHost();
+    if (!h_net_input.empty()) {
+        return forwardAllHost(pixel_bounding_boxes, h_net_input, defaultROI);
     }
 
     cv::cuda::GpuMat float_image;
@@ -108,7 +490,6 @@ bool aq::nodes::INeuralNet::forwardAll() {
         cv::cuda::multiply(float_image, cv::Scalar::all(static_cast<double>(pixel_scale)), float_image, 1.0, -1, stream());
     }
 
-    preBatch(static_cast<int>(pixel_bounding_boxes.size()));
     cv::cuda::GpuMat resized;
     auto             net_input = getNetImageInput();
     MO_ASSERT(net_input.size());
@@ -126,17 +507,9 @@ bool aq::nodes::INeuralNet::forwardAll() {
             cv::cuda::split(resized, net_input[j], stream());
             end = start + j + 1;
         }
+        padInput(net_input, end - start);
         if (forwardMinibatch()) {
-            std::vector<cv::Rect>         batch_bounding_boxes;
-            std::vector<DetectedObject2d> batch_detections;
-            for (size_t j = start; j < end; ++j) {
-                batch_bounding_boxes.push_back(pixel_bounding_boxes[j]);
-            }
-            if (input_detections != nullptr && bounding_boxes == &defaultROI) {
-                for (size_t j = start; j < end; ++j)
-                    batch_detections.push_back((*input_detections)[j]);
-            }
-            postMiniBatch(batch_bounding_boxes, batch_detections);
+            dispatchMiniBatch(pixel_bounding_boxes, start, end, defaultROI);
         }
     }
     postBatch();
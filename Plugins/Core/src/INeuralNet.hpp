@@ -1,7 +1,12 @@
 #include "Aquila/nodes/IClassifier.hpp"
 #include "CoreExport.hpp"
+#include "Utility/NodeProfiler.hpp"
 #include <Aquila/types/ObjectDetection.hpp>
 #include <Aquila/types/SyncedMemory.hpp>
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+#include <chrono>
+#include <deque>
 namespace aq {
 namespace nodes {
     class Core_EXPORT INeuralNet : virtual public IClassifier {
@@ -31,8 +36,44 @@ namespace nodes {
         TOOLTIP(image_scale, "Scale factor for input of network. 1.0 = network is resized to input image size, -1.0 = image is resized to network input size")
 
         PARAM(bool, swap_bgr, true)
+
+        PARAM(bool, cross_frame_batching, false)
+        TOOLTIP(cross_frame_batching, "Queue the rois of consecutive frames, or of every stream feeding this node, and run them in one forward pass. Requires a backend with a host input")
+        PARAM(int, max_batch_size, 8)
+        TOOLTIP(max_batch_size, "Number of queued rois that triggers a forward pass when cross_frame_batching is enabled")
+        PARAM(float, batch_deadline, 50.0f)
+        TOOLTIP(batch_deadline, "Milliseconds the oldest queued frame may wait before a partial batch is run")
+        STATUS(float, batch_fill, 0.0f)
+        STATUS(float, batch_queue_latency, 0.0f)
+
+        PARAM(std::vector<int>, batch_buckets, {1, 2, 4, 8, 16})
+        TOOLTIP(batch_buckets, "Batch sizes the network is shaped to. Roi counts are rounded up to the next bucket and the spare slots padded so the network keeps its shape between frames. Counts above the largest bucket, or any count if empty, are used as is")
+        STATUS(int, network_reshapes, 0)
+        STATUS(int, input_allocations, 0)
+
+        PARAM(bool, tiled_inference, false)
+        TOOLTIP(tiled_inference, "Run the network on overlapping tiles of the input instead of the whole image when no bounding_boxes or input_detections are connected")
+        PARAM(int, tile_width, 0)
+        TOOLTIP(tile_width, "Tile width in pixels, 0 uses the network input width")
+        PARAM(int, tile_height, 0)
+        TOOLTIP(tile_height, "Tile height in pixels, 0 uses the network input height")
+        PARAM(float, tile_overlap, 0.25f)
+        TOOLTIP(tile_overlap, "Fraction of a tile shared with its neighbour")
+        PARAM(int, tile_stride, 0)
+        TOOLTIP(tile_stride, "Pixels between tile origins, overrides tile_overlap when non zero")
+        PARAM(int, tile_batch_size, 16)
+        OUTPUT(std::vector<cv::Rect2f>, tiles, {})
+
+        // Runs every queued frame, connected to the frame grabber's end of stream
+        MO_SLOT(void, eos)
+
+        NODE_PROFILE_OUTPUTS
         MO_END
 
+        // Runs queued frames past batch_deadline before the regular processing, which only happens
+        // when a new input arrives
+        virtual bool process();
+
     protected:
         virtual bool processImpl();
 
@@ -41,6 +82,9 @@ namespace nodes {
         virtual cv::Scalar_<unsigned int> getNetworkShape() const = 0;
 
         virtual std::vector<std::vector<cv::cuda::GpuMat> > getNetImageInput(int requested_batch_size = 1) = 0;
+        // Host memory view of the network input, backends that run on the CPU return a non empty
+        // vector and forwardAll then preprocesses on the host instead of through getNetImageInput
+        virtual std::vector<std::vector<cv::Mat> > getNetImageInputHost(int requested_batch_size = 1);
 
         virtual void preBatch(int batch_size);
         virtual void postMiniBatch(const std::vector<cv::Rect>& batch_bb = std::vector<cv::Rect>(),
@@ -50,6 +94,67 @@ namespace nodes {
 
         virtual bool forwardAll();
         virtual bool forwardMinibatch() = 0;
+
+        // Tiles of tile_size covering image_size, stride apart except for the last row and column
+        // which are aligned with the image border. Row major, tiles larger than the image are clipped.
+        static std::vector<cv::Rect> tileImage(cv::Size image_size, cv::Size tile_size, cv::Size stride);
+
+        // Rounds num up to a batch bucket and reshapes the network only if its shape changes, a
+        // bucket the backend rejects is retried with num. Returns false if neither shape is accepted
+        bool reshapeInput(unsigned int num, unsigned int channels, unsigned int height, unsigned int width);
+        unsigned int batchBucket(unsigned int num) const;
+        // Zeroes the input slots past the last roi of a mini batch
+        void padInput(std::vector<std::vector<cv::Mat> >& net_input, size_t used);
+        void padInput(std::vector<std::vector<cv::cuda::GpuMat> >& net_input, size_t used);
+        // Backends increment this when they allocate an input buffer, reported per frame as input_allocations
+        int _input_allocations = 0;
+        int _network_reshapes  = 0;
+
+        // Preprocesses pixel_bounding_boxes into net_input on the host and runs the mini batches
+        bool forwardAllHost(const std::vector<cv::Rect>& pixel_bounding_boxes,
+            std::vector<std::vector<cv::Mat> >&          net_input,
+            std::vector<cv::Rect2f>&                     default_roi);
+        // Calls postMiniBatch with the rois [start, end) and their input detections
+        void dispatchMiniBatch(const std::vector<cv::Rect>& pixel_bounding_boxes, size_t start, size_t end,
+            const std::vector<cv::Rect2f>& default_roi);
+
+        // Cross frame batching. Frames are preprocessed as they arrive and queued; once max_batch_size
+        // rois are queued or the oldest frame exceeds batch_deadline the queued rois run in one forward
+        // pass. preBatch, postMiniBatch and postBatch are then called once per frame after that pass with
+        // currentInputParam() carrying the frame's data, timestamp and frame number, and
+        // _minibatch_offset the index of the frame's first roi in the network output.
+        struct QueuedFrame {
+            std::vector<std::vector<cv::Mat> >    net_input;
+            std::vector<cv::Rect>                 bounding_boxes;
+            std::vector<DetectedObject2d>         detections;
+            SyncedMemory                          image;
+            mo::OptionalTime_t                    timestamp;
+            size_t                                frame_number = 0;
+            std::chrono::steady_clock::time_point queued;
+        };
+        // Returns false if the backend has no host input and the frame has to be run directly
+        bool queueFrame(const std::vector<cv::Rect>& pixel_bounding_boxes, std::vector<cv::Rect2f>& default_roi);
+        // Runs queued frames holding up to max_rois rois, at least one frame. Falls back to running
+        // the frames one after the other if the network can't be reshaped to the whole batch
+        void forwardQueued(size_t max_rois);
+        // Runs queued frames while max_batch_size rois are queued or the oldest is past batch_deadline
+        void forwardDue();
+        void forwardAllQueued();
+        // Forwards the rois of one queued frame in mini batches of net_input.size()
+        void forwardQueuedFrame(QueuedFrame& frame, std::vector<std::vector<cv::Mat> >& net_input);
+        mo::ITParam<SyncedMemory>& currentInputParam();
+
+        std::deque<QueuedFrame>            _frame_queue;
+        size_t                             _queued_rois = 0;
+        cv::Scalar_<unsigned int>          _queued_shape;
+        // Roi planes of forwarded frames, reused by the next queued frames
+        std::vector<std::vector<cv::Mat> > _plane_pool;
+        size_t                             _minibatch_offset = 0;
+        SyncedMemory                       _batch_input;
+        mo::TParamPtr<SyncedMemory>        _batch_input_param;
+        mo::ITParam<SyncedMemory>*         _current_input = nullptr;
+
+        NodeProfiler                       _profiler;
     };
 }
 }
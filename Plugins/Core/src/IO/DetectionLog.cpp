@@ -0,0 +1,434 @@
+#include "DetectionLog.hpp"
+
+#include "Aquila/nodes/NodeInfo.hpp"
+#include "Aquila/types/ObjectDetectionSerialization.hpp"
+
+#include "MetaObject/params/detail/TInputParamPtrImpl.hpp"
+#include "MetaObject/params/detail/TParamPtrImpl.hpp"
+#include <MetaObject/logging/logging.hpp>
+
+#include "cereal/archives/json.hpp"
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace {
+const uint32_t kLogMagic    = 0x4C444545; // "EEDL"
+const uint32_t kRecordMagic = 0x52444545; // "EEDR"
+const uint32_t kLogVersion  = 2;
+const int64_t  kNoTimestamp = std::numeric_limits<int64_t>::min();
+
+// Encoded sizes, independent of the padding of the structs
+const size_t kFileHeaderSize   = 8;
+const size_t kRecordHeaderSize = 32;
+const size_t kIndexEntrySize   = 48;
+
+template <class T>
+char* putLE(char* dst, T value) {
+    const uint64_t v = static_cast<uint64_t>(value);
+    for (size_t i = 0; i < sizeof(T); ++i)
+        dst[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    return dst + sizeof(T);
+}
+
+template <class T>
+const char* getLE(const char* src, T& value) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        v |= static_cast<uint64_t>(static_cast<unsigned char>(src[i])) << (8 * i);
+    value = static_cast<T>(v);
+    return src + sizeof(T);
+}
+
+void encode(const DetectionLogFileHeader& header, char* dst) {
+    dst = putLE(dst, header.magic);
+    putLE(dst, header.version);
+}
+
+void decode(const char* src, DetectionLogFileHeader& header) {
+    src = getLE(src, header.magic);
+    getLE(src, header.version);
+}
+
+void encode(const DetectionLogRecordHeader& header, char* dst) {
+    dst = putLE(dst, header.magic);
+    dst = putLE(dst, header.payload_size);
+    dst = putLE(dst, header.frame_number);
+    dst = putLE(dst, header.timestamp_ns);
+    putLE(dst, header.image_index);
+}
+
+void decode(const char* src, DetectionLogRecordHeader& header) {
+    src = getLE(src, header.magic);
+    src = getLE(src, header.payload_size);
+    src = getLE(src, header.frame_number);
+    src = getLE(src, header.timestamp_ns);
+    getLE(src, header.image_index);
+}
+
+void encode(const DetectionLogIndexEntry& entry, char* dst) {
+    dst = putLE(dst, entry.frame_number);
+    dst = putLE(dst, entry.timestamp_ns);
+    dst = putLE(dst, entry.offset);
+    dst = putLE(dst, entry.image_index);
+    dst = putLE(dst, entry.payload_size);
+    dst = putLE(dst, entry.chunk);
+    dst = putLE(dst, entry.session);
+    putLE(dst, uint32_t(0));
+}
+
+void decode(const char* src, DetectionLogIndexEntry& entry) {
+    src = getLE(src, entry.frame_number);
+    src = getLE(src, entry.timestamp_ns);
+    src = getLE(src, entry.offset);
+    src = getLE(src, entry.image_index);
+    src = getLE(src, entry.payload_size);
+    src = getLE(src, entry.chunk);
+    getLE(src, entry.session);
+}
+
+int64_t toNs(const mo::OptionalTime_t& ts) {
+    if (!ts)
+        return kNoTimestamp;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(*ts).count();
+}
+
+mo::OptionalTime_t fromNs(int64_t ns) {
+    if (ns == kNoTimestamp)
+        return mo::OptionalTime_t();
+    return mo::Time_t(ns * mo::ns);
+}
+}
+
+std::string aq::nodes::detectionLogChunkPath(const std::string& dir, const std::string& stem, uint32_t chunk, const std::string& extension) {
+    std::stringstream ss;
+    ss << dir << "/" << stem << "_" << std::setw(6) << std::setfill('0') << chunk << extension;
+    return ss.str();
+}
+
+DetectionLogWriter::~DetectionLogWriter() {
+    close();
+}
+
+bool DetectionLogWriter::open(const std::string& dir, const std::string& stem, size_t max_chunk_bytes) {
+    close();
+    if (!boost::filesystem::is_directory(dir)) {
+        boost::filesystem::create_directories(dir);
+    }
+    _dir             = dir;
+    _stem            = stem;
+    _max_chunk_bytes = max_chunk_bytes;
+    _records         = 0;
+    _chunk           = 0;
+    while (boost::filesystem::exists(detectionLogChunkPath(dir, stem, _chunk, ".detlog"))) {
+        ++_chunk;
+    }
+    _session = _chunk;
+    return openChunk();
+}
+
+bool DetectionLogWriter::openChunk() {
+    _log_ofs.close();
+    _index_ofs.close();
+    _log_ofs.clear();
+    _index_ofs.clear();
+    _log_ofs.open(detectionLogChunkPath(_dir, _stem, _chunk, ".detlog"), std::ios::binary | std::ios::out | std::ios::trunc);
+    _index_ofs.open(detectionLogChunkPath(_dir, _stem, _chunk, ".detidx"), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!_log_ofs || !_index_ofs) {
+        MO_LOG(warning) << "Unable to open detection log chunk " << detectionLogChunkPath(_dir, _stem, _chunk, ".detlog");
+        _log_ofs.close();
+        _index_ofs.close();
+        return false;
+    }
+    DetectionLogFileHeader header;
+    header.magic   = kLogMagic;
+    header.version = kLogVersion;
+    char buffer[kFileHeaderSize];
+    encode(header, buffer);
+    _log_ofs.write(buffer, kFileHeaderSize);
+    _chunk_bytes = kFileHeaderSize;
+    return true;
+}
+
+void DetectionLogWriter::close() {
+    flush();
+    _log_ofs.close();
+    _index_ofs.close();
+}
+
+bool DetectionLogWriter::isOpen() const {
+    return _log_ofs.is_open();
+}
+
+bool DetectionLogWriter::append(const DetectionLogRecord& record) {
+    if (!isOpen())
+        return false;
+    std::ostringstream ss(std::ios::binary | std::ios::out);
+    {
+        cereal::PortableBinaryOutputArchive ar(ss);
+        ar(record.image_file);
+        ar(record.detections);
+    }
+    const std::string payload = ss.str();
+    const size_t      size    = kRecordHeaderSize + payload.size();
+    if (_max_chunk_bytes && _chunk_bytes + size > _max_chunk_bytes && _chunk_bytes > kFileHeaderSize) {
+        ++_chunk;
+        if (!openChunk())
+            return false;
+    }
+    DetectionLogRecordHeader header;
+    header.magic        = kRecordMagic;
+    header.payload_size = static_cast<uint32_t>(payload.size());
+    header.frame_number = record.frame_number;
+    header.timestamp_ns = toNs(record.timestamp);
+    header.image_index  = record.image_index;
+
+    DetectionLogIndexEntry entry;
+    entry.frame_number = header.frame_number;
+    entry.timestamp_ns = header.timestamp_ns;
+    entry.offset       = _chunk_bytes;
+    entry.image_index  = header.image_index;
+    entry.payload_size = header.payload_size;
+    entry.chunk        = _chunk;
+    entry.session      = _session;
+
+    char header_buffer[kRecordHeaderSize];
+    char entry_buffer[kIndexEntrySize];
+    encode(header, header_buffer);
+    encode(entry, entry_buffer);
+    _log_ofs.write(header_buffer, kRecordHeaderSize);
+    _log_ofs.write(payload.data(), payload.size());
+    _index_ofs.write(entry_buffer, kIndexEntrySize);
+    _chunk_bytes += size;
+    ++_records;
+    return static_cast<bool>(_log_ofs) && static_cast<bool>(_index_ofs);
+}
+
+void DetectionLogWriter::flush() {
+    // Log first so an index entry never refers to data that has not been handed to the OS
+    _log_ofs.flush();
+    _index_ofs.flush();
+}
+
+size_t DetectionLogWriter::records() const {
+    return _records;
+}
+
+bool DetectionLogReader::open(const std::string& dir, const std::string& stem) {
+    close();
+    for (uint32_t chunk = 0;; ++chunk) {
+        const std::string log_path   = detectionLogChunkPath(dir, stem, chunk, ".detlog");
+        const std::string index_path = detectionLogChunkPath(dir, stem, chunk, ".detidx");
+        if (!boost::filesystem::exists(log_path))
+            break;
+        if (!boost::filesystem::exists(index_path) || boost::filesystem::file_size(index_path) < kIndexEntrySize)
+            continue;
+        Chunk c;
+        try {
+            c.log.open(log_path);
+            c.index.open(index_path);
+        } catch (std::exception& e) {
+            MO_LOG(warning) << "Unable to map " << log_path << ": " << e.what();
+            continue;
+        }
+        DetectionLogFileHeader header = DetectionLogFileHeader();
+        if (c.log.size() >= kFileHeaderSize)
+            decode(c.log.data(), header);
+        if (header.magic != kLogMagic || header.version != kLogVersion) {
+            MO_LOG(warning) << log_path << " is not a version " << kLogVersion << " detection log";
+            continue;
+        }
+        c.num_entries = c.index.size() / kIndexEntrySize;
+        // Drop entries of records that did not make it to disk completely
+        DetectionLogIndexEntry last;
+        while (c.num_entries) {
+            decode(c.index.data() + (c.num_entries - 1) * kIndexEntrySize, last);
+            if (last.offset + kRecordHeaderSize + last.payload_size <= c.log.size())
+                break;
+            --c.num_entries;
+        }
+        if (c.num_entries == 0)
+            continue;
+        c.session = last.session;
+        _chunk_start.push_back(_size);
+        _size += c.num_entries;
+        _chunks.push_back(std::move(c));
+    }
+    return _size != 0;
+}
+
+void DetectionLogReader::close() {
+    _chunks.clear();
+    _chunk_start.clear();
+    _size = 0;
+}
+
+size_t DetectionLogReader::size() const {
+    return _size;
+}
+
+DetectionLogIndexEntry DetectionLogReader::entry(size_t idx) const {
+    const size_t           chunk = std::upper_bound(_chunk_start.begin(), _chunk_start.end(), idx) - _chunk_start.begin() - 1;
+    DetectionLogIndexEntry e;
+    decode(_chunks[chunk].index.data() + (idx - _chunk_start[chunk]) * kIndexEntrySize, e);
+    return e;
+}
+
+bool DetectionLogReader::read(size_t idx, DetectionLogRecord& record) const {
+    if (idx >= _size)
+        return false;
+    const size_t                 chunk = std::upper_bound(_chunk_start.begin(), _chunk_start.end(), idx) - _chunk_start.begin() - 1;
+    const DetectionLogIndexEntry e     = entry(idx);
+    const char*                  data  = _chunks[chunk].log.data() + e.offset;
+    DetectionLogRecordHeader     header;
+    decode(data, header);
+    if (header.magic != kRecordMagic || header.payload_size != e.payload_size) {
+        MO_LOG(warning) << "Corrupt detection log record " << idx;
+        return false;
+    }
+    boost::iostreams::stream<boost::iostreams::array_source> is(data + kRecordHeaderSize, e.payload_size);
+    try {
+        cereal::PortableBinaryInputArchive ar(is);
+        ar(record.image_file);
+        record.detections.clear();
+        ar(record.detections);
+    } catch (std::exception& ex) {
+        MO_LOG(warning) << "Unable to deserialize detection log record " << idx << ": " << ex.what();
+        return false;
+    }
+    record.frame_number = header.frame_number;
+    record.timestamp    = fromNs(header.timestamp_ns);
+    record.image_index  = header.image_index;
+    record.session      = e.session;
+    return true;
+}
+
+std::vector<uint32_t> DetectionLogReader::sessions() const {
+    std::vector<uint32_t> output;
+    for (const auto& chunk : _chunks) {
+        if (output.empty() || output.back() != chunk.session)
+            output.push_back(chunk.session);
+    }
+    return output;
+}
+
+size_t DetectionLogReader::find(uint32_t session, size_t frame_number) const {
+    // A session's chunks are consecutive, frame numbers only increase within it
+    size_t first = _size;
+    size_t last  = _size;
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        if (_chunks[i].session != session)
+            continue;
+        if (first == _size)
+            first = _chunk_start[i];
+        last = _chunk_start[i] + _chunks[i].num_entries;
+    }
+    size_t count = last - first;
+    while (count > 0) {
+        size_t step = count / 2;
+        if (entry(first + step).frame_number < frame_number) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first == last ? _size : first;
+}
+
+size_t aq::nodes::convertDetectionLogToJson(const std::string& log_dir,
+    const std::string&                                         log_stem,
+    const std::string&                                         output_dir,
+    const std::string&                                         annotation_stem,
+    bool                                                       pad) {
+    DetectionLogReader reader;
+    if (!reader.open(log_dir, log_stem))
+        return 0;
+    if (!boost::filesystem::is_directory(output_dir)) {
+        boost::filesystem::create_directories(output_dir);
+    }
+    DetectionLogRecord record;
+    size_t             written = 0;
+    for (size_t i = 0; i < reader.size(); ++i) {
+        if (!reader.read(i, record))
+            continue;
+        std::stringstream ss;
+        if (pad)
+            ss << output_dir << "/" << annotation_stem << std::setw(8) << std::setfill('0') << record.image_index << ".json";
+        else
+            ss << output_dir << "/" << annotation_stem << record.image_index << ".json";
+        std::ofstream ofs(ss.str());
+        cereal::JSONOutputArchive ar(ofs);
+        ar(cereal::make_nvp("ImageFile", record.image_file));
+        ar(cereal::make_nvp("detections", record.detections));
+        ++written;
+    }
+    return written;
+}
+
+void DetectionLogPlayback::restart() {
+    _next_record = 0;
+}
+
+void DetectionLogPlayback::export_json() {
+    if (json_directory.string().empty())
+        return;
+    size_t count = convertDetectionLogToJson(input_directory.string(), annotation_stem, json_directory.string(), annotation_stem);
+    MO_LOG(info) << "Exported " << count << " detection records to " << json_directory.string();
+}
+
+bool DetectionLogPlayback::processImpl() {
+    if (input_directory_param.modified() || annotation_stem_param.modified()) {
+        _reader.open(input_directory.string(), annotation_stem);
+        _next_record = 0;
+        record_count_param.updateData(static_cast<int>(_reader.size()));
+        input_directory_param.modified(false);
+        annotation_stem_param.modified(false);
+    }
+    if (_reader.size() == 0)
+        return false;
+    DetectionLogRecord record;
+    if (image) {
+        // Frames without detections are not logged, emit an empty list for them
+        const std::vector<uint32_t> sessions = _reader.sessions();
+        const uint32_t selected = session < 0 ? sessions.back() : static_cast<uint32_t>(session);
+        size_t fn  = image_param.getFrameNumber();
+        size_t idx = _reader.find(selected, fn);
+        if (idx == _reader.size() || _reader.entry(idx).frame_number != fn || !_reader.read(idx, record)) {
+            record              = DetectionLogRecord();
+            record.frame_number = fn;
+        }
+        detections_param.updateData(record.detections, mo::tag::_param = image_param, mo::tag::_context = _ctx.get());
+        image_file_param.updateData(record.image_file, mo::tag::_param = image_param, mo::tag::_context = _ctx.get());
+        return true;
+    }
+    if (_next_record >= _reader.size()) {
+        if (!loop)
+            return false;
+        _next_record = 0;
+    }
+    if (!_reader.read(_next_record++, record))
+        return false;
+    if (record.timestamp) {
+        detections_param.updateData(record.detections, mo::tag::_timestamp = *record.timestamp, mo::tag::_frame_number = record.frame_number, _ctx.get());
+        image_file_param.updateData(record.image_file, mo::tag::_timestamp = *record.timestamp, mo::tag::_frame_number = record.frame_number, _ctx.get());
+    } else {
+        detections_param.updateData(record.detections, mo::tag::_frame_number = record.frame_number, _ctx.get());
+        image_file_param.updateData(record.image_file, mo::tag::_frame_number = record.frame_number, _ctx.get());
+    }
+    return true;
+}
+
+MO_REGISTER_CLASS(DetectionLogPlayback)
@@ -0,0 +1,147 @@
+#pragma once
+#include "Aquila/nodes/Node.hpp"
+#include "Aquila/types/ObjectDetection.hpp"
+#include "Aquila/types/SyncedMemory.hpp"
+#include "CoreExport.hpp"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace aq {
+namespace nodes {
+    // Append only container for detection records.
+    // A log is a sequence of chunks <stem>_NNNNNN.detlog, each starting with a DetectionLogFileHeader
+    // followed by records laid out as DetectionLogRecordHeader + payload, where the payload is a
+    // portable binary cereal archive of the image file name and the detections.
+    // Every chunk has a sibling <stem>_NNNNNN.detidx made of fixed size DetectionLogIndexEntry,
+    // the index entry is written after its record so a record without an index entry is an
+    // incomplete write and is ignored by the reader.
+    // Headers and index entries are stored field by field in little endian order, the structs below
+    // are their decoded form. Every DetectionLogWriter::open starts a session, identified by the
+    // first chunk it wrote. Frame numbers increase within a session and restart with the next one.
+    struct DetectionLogFileHeader {
+        uint32_t magic;
+        uint32_t version;
+    };
+
+    struct DetectionLogRecordHeader {
+        uint32_t magic;
+        uint32_t payload_size;
+        uint64_t frame_number;
+        int64_t  timestamp_ns;
+        uint64_t image_index;
+    };
+
+    struct DetectionLogIndexEntry {
+        uint64_t frame_number;
+        int64_t  timestamp_ns;
+        uint64_t offset; // of the DetectionLogRecordHeader within the chunk
+        uint64_t image_index;
+        uint32_t payload_size;
+        uint32_t chunk;
+        uint32_t session;
+    };
+
+    struct Core_EXPORT DetectionLogRecord {
+        size_t                                  frame_number = 0;
+        mo::OptionalTime_t                      timestamp;
+        // Index the writer numbered the image and annotation files with
+        size_t                                  image_index = 0;
+        uint32_t                                session     = 0;
+        std::string                             image_file;
+        aq::NClassDetectedObject::DetectionList detections;
+    };
+
+    class Core_EXPORT DetectionLogWriter {
+    public:
+        ~DetectionLogWriter();
+        // Always starts a new chunk after any existing ones, previously written chunks are never modified
+        bool open(const std::string& dir, const std::string& stem, size_t max_chunk_bytes = 256 * 1024 * 1024);
+        void close();
+        bool isOpen() const;
+        bool append(const DetectionLogRecord& record);
+        void flush();
+        size_t records() const;
+
+    private:
+        bool openChunk();
+
+        std::string   _dir;
+        std::string   _stem;
+        std::ofstream _log_ofs;
+        std::ofstream _index_ofs;
+        size_t        _max_chunk_bytes = 0;
+        size_t        _chunk_bytes     = 0;
+        size_t        _records         = 0;
+        uint32_t      _chunk           = 0;
+        uint32_t      _session         = 0;
+    };
+
+    class Core_EXPORT DetectionLogReader {
+    public:
+        // Maps every chunk of the log, records appended after open are not visible
+        bool open(const std::string& dir, const std::string& stem);
+        void close();
+        size_t size() const;
+        // Records are addressed by their position in the log, idx < size()
+        DetectionLogIndexEntry entry(size_t idx) const;
+        bool read(size_t idx, DetectionLogRecord& record) const;
+        // Sessions in the log in the order they were written
+        std::vector<uint32_t> sessions() const;
+        // Position of the first record of session with a frame number >= frame_number, size() if
+        // there is none
+        size_t find(uint32_t session, size_t frame_number) const;
+
+    private:
+        struct Chunk {
+            boost::iostreams::mapped_file_source log;
+            boost::iostreams::mapped_file_source index;
+            size_t                               num_entries = 0;
+            uint32_t                             session     = 0;
+        };
+        std::vector<Chunk>  _chunks;
+        std::vector<size_t> _chunk_start;
+        size_t              _size = 0;
+    };
+
+    std::string Core_EXPORT detectionLogChunkPath(const std::string& dir, const std::string& stem, uint32_t chunk, const std::string& extension);
+
+    // Writes one <annotation_stem>NNNNNNNN.json per record in the layout used by DetectionWriter,
+    // numbered with the record's image index so it matches its image file. Returns the number of
+    // files written.
+    size_t Core_EXPORT convertDetectionLogToJson(const std::string& log_dir,
+        const std::string&                                          log_stem,
+        const std::string&                                          output_dir,
+        const std::string&                                          annotation_stem,
+        bool                                                        pad = true);
+
+    // Replays a detection log. If image is connected the record of the selected session matching
+    // the image's frame number is emitted, otherwise records are emitted in order.
+    class DetectionLogPlayback : public Node {
+    public:
+        MO_DERIVE(DetectionLogPlayback, Node)
+        PARAM(mo::ReadDirectory, input_directory, {})
+        PARAM(std::string, annotation_stem, "detection")
+        PARAM(mo::WriteDirectory, json_directory, {})
+        PARAM(bool, loop, false)
+        PARAM(int, session, -1)
+        TOOLTIP(session, "Writer session an image input is matched against, the number of the first chunk it wrote. -1 uses the last session")
+        OPTIONAL_INPUT(SyncedMemory, image, nullptr)
+        OUTPUT(aq::NClassDetectedObject::DetectionList, detections, {})
+        OUTPUT(std::string, image_file, {})
+        STATUS(int, record_count, 0)
+        MO_SLOT(void, restart)
+        MO_SLOT(void, export_json)
+        MO_END;
+
+    protected:
+        bool processImpl();
+        DetectionLogReader _reader;
+        size_t             _next_record = 0;
+    };
+}
+}
@@ -8,6 +8,7 @@
 #include "MetaObject/params/detail/TInputParamPtrImpl.hpp"
 #include "MetaObject/params/detail/TParamPtrImpl.hpp"
 #include "MetaObject/serialization/SerializationFactory.hpp"
+#include <MetaObject/logging/logging.hpp>
 #include <MetaObject/thread/boost_thread.hpp>
 
 #include "cereal/archives/json.hpp"
@@ -21,27 +22,36 @@
 using namespace aq;
 using namespace aq::nodes;
 
-int findNextIndex(const std::string& dir, const std::string& extension, const std::string& stem) {
-    boost::filesystem::path               path(dir);
-    boost::filesystem::directory_iterator end;
-    int                                   frame_count = 0;
-    for (boost::filesystem::directory_iterator itr(path); itr != end; ++itr) {
-        std::string ext = itr->path().extension().string();
-        if (ext == extension) {
-            std::string stem = itr->path().stem().string();
-            if (stem.find(stem) == 0) {
-                auto start = stem.find_last_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ-_");
-                auto end   = stem.find_last_of("0123456789");
-                if (stem.size() && end != std::string::npos) {
-                    int idx     = boost::lexical_cast<int>(stem.substr(start == std::string::npos ? 0 : start + 1, end));
-                    frame_count = std::max(frame_count, idx + 1);
-                }
-            }
+// Indices reserved in the manifest ahead of the files actually written
+static const int kIndexReserve = 256;
+
+// Full scan fallback used when a directory has no index manifest
+template <class Iterator>
+int scanNextIndex(const std::string& dir, const std::string& extension, const std::string& stem) {
+    Iterator end;
+    int      frame_count = 0;
+    for (Iterator itr{boost::filesystem::path(dir)}; itr != end; ++itr) {
+        if (itr->path().extension().string() != extension)
+            continue;
+        std::string name = itr->path().stem().string();
+        if (name.find(stem) != 0)
+            continue;
+        auto start = name.find_last_not_of("0123456789");
+        start      = start == std::string::npos ? 0 : start + 1;
+        if (start < name.size()) {
+            int idx     = boost::lexical_cast<int>(name.substr(start));
+            frame_count = std::max(frame_count, idx + 1);
         }
     }
     return frame_count;
 }
 
+int findNextIndex(const std::string& dir, const std::string& extension, const std::string& stem, bool recursive = false) {
+    if (recursive)
+        return scanNextIndex<boost::filesystem::recursive_directory_iterator>(dir, extension, stem);
+    return scanNextIndex<boost::filesystem::directory_iterator>(dir, extension, stem);
+}
+
 aq::NClassDetectedObject::DetectionList pruneDetections(const std::vector<DetectedObject>& input, int object_class) {
     aq::NClassDetectedObject::DetectionList detections;
     bool                                    found;
@@ -102,98 +112,151 @@ aq::NClassDetectedObject::DetectionList pruneDetections(const aq::NClassDetected
 }
 
 IDetectionWriter::~IDetectionWriter() {
-    if (_write_thread && !IsRuntimeDelete()) {
-        _write_thread->interrupt();
-        _write_thread->join();
+    _write_queue.stop();
+    if (!_manifest.directory().empty()) {
+        _manifest.set(image_stem + "." + extension.getEnum(), static_cast<int>(frame_count));
+        _manifest.save();
     }
 }
 
 void IDetectionWriter::nodeInit(bool firstInit) {
-    if (firstInit) {
-        _write_queue.reset(new WriteQueue_t());
-        _write_thread.reset(new boost::thread(&IDetectionWriter::writeThread, this));
-    }
+    _write_queue.start([this](WriteData_t& data) { this->write(data); }, "DetectionWriter");
 }
 
 bool IDetectionWriter::processImpl() {
+    syncWriteQueueParams(*this, _write_queue);
+    syncEncodePoolParams(*this, _encode_pool);
     if (output_directory_param.modified()) {
+        // frame_count is advanced by the write thread, finish pending writes before rescanning
+        _write_queue.flush();
+        _encode_pool.flush();
+        if (!_manifest.directory().empty()) {
+            _manifest.set(image_stem + "." + extension.getEnum(), static_cast<int>(frame_count));
+            _manifest.save();
+        }
+        int next = 0;
         if (!boost::filesystem::exists(output_directory)) {
             boost::filesystem::create_directories(output_directory);
-        } else {
+            _manifest.load(output_directory.string());
+        } else if (!_manifest.load(output_directory.string()) || !_manifest.get(image_stem + "." + extension.getEnum(), next)) {
             // check if files exist, if they do, determine the current index and start appending
             int json_count = findNextIndex(output_directory.string(), ".json", annotation_stem);
             int img_count  = findNextIndex(output_directory.string(), "." + extension.getEnum(), image_stem);
-            frame_count    = std::max<size_t>(img_count, std::max<size_t>(json_count, frame_count));
+            next           = std::max(img_count, json_count);
         }
+        frame_count     = std::max<size_t>(next, frame_count);
+        _reserved_count = _manifest.reserve(image_stem + "." + extension.getEnum(), static_cast<int>(frame_count), kIndexReserve);
         output_directory_param.modified(false);
     }
     auto detections = pruneDetections(*this->detections, object_class);
 
     if (detections.size() || skip_empty == false) {
-        cv::Mat h_mat = image->getMat(stream());
-        cuda::enqueue_callback([h_mat, this, detections]() {
-            this->_write_queue->enqueue(std::make_pair(h_mat, detections));
+        WriteData_t data;
+        data.image        = image->getMat(stream());
+        data.detections   = std::move(detections);
+        data.frame_number = image_param.getFrameNumber();
+        data.timestamp    = image_param.getTimestamp();
+        cuda::enqueue_callback([data, this]() {
+            this->_write_queue.enqueue(data);
         },
             stream());
     }
     return true;
 }
 
-void DetectionWriter::writeThread() {
-    WriteData_t data;
-    mo::setThisThreadName("DetectionWriter");
-    while (!boost::this_thread::interruption_requested()) {
-        if (this->_write_queue->try_dequeue(data)) {
-            std::stringstream ss;
-            ss << output_directory.string();
-            if (pad)
-                ss << "/" << annotation_stem << std::setw(8) << std::setfill('0') << frame_count << ".json";
-            else
-                ss << "/" << annotation_stem << frame_count << ".json";
-            std::ofstream ofs;
-            ofs.open(ss.str());
-            cereal::JSONOutputArchive ar(ofs);
-            ss.str("");
-            if (pad)
-                ss << output_directory.string() << "/" << image_stem << std::setw(8) << std::setfill('0') << frame_count << "." << extension.getEnum();
-            else
-                ss << output_directory.string() << "/" << image_stem << frame_count << "." << extension.getEnum();
-            cv::imwrite(ss.str(), data.first);
-            ss.str("");
-            if (pad)
-                ss << image_stem << std::setw(8) << std::setfill('0') << frame_count << "." << extension.getEnum();
-            else
-                ss << image_stem << frame_count << "." << extension.getEnum();
-            ar(cereal::make_nvp("ImageFile", ss.str()));
-            ar(cereal::make_nvp("detections", data.second));
-            ++frame_count;
+DetectionWriter::~DetectionWriter() {
+    _write_queue.stop();
+    _log.close();
+}
+
+void DetectionWriter::eos() {
+    _write_queue.flush();
+    boost::mutex::scoped_lock lock(_log_mtx);
+    _log.flush();
+}
+
+void DetectionWriter::write(WriteData_t& data) {
+    std::stringstream ss;
+    if (pad)
+        ss << image_stem << std::setw(8) << std::setfill('0') << frame_count << "." << extension.getEnum();
+    else
+        ss << image_stem << frame_count << "." << extension.getEnum();
+    const std::string image_file = ss.str();
+    _encode_pool.submit(data.image, output_directory.string() + "/" + image_file);
+
+    if (annotation_format.getValue() == binary_log) {
+        boost::mutex::scoped_lock lock(_log_mtx);
+        if (!_log.isOpen() || _log_dir != output_directory.string()) {
+            _log_dir = output_directory.string();
+            _log.open(_log_dir, annotation_stem, static_cast<size_t>(std::max(log_chunk_mb, 1)) * 1024 * 1024);
+        }
+        DetectionLogRecord record;
+        record.frame_number = data.frame_number;
+        record.timestamp    = data.timestamp;
+        record.image_index  = frame_count;
+        record.image_file   = image_file;
+        record.detections   = std::move(data.detections);
+        if (!_log.append(record)) {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to append to detection log in " << _log_dir;
         }
+    } else {
+        ss.str("");
+        ss << output_directory.string();
+        if (pad)
+            ss << "/" << annotation_stem << std::setw(8) << std::setfill('0') << frame_count << ".json";
+        else
+            ss << "/" << annotation_stem << frame_count << ".json";
+        std::ofstream             ofs(ss.str());
+        cereal::JSONOutputArchive ar(ofs);
+        ar(cereal::make_nvp("ImageFile", image_file));
+        ar(cereal::make_nvp("detections", data.detections));
+    }
+    ++frame_count;
+    if (static_cast<int>(frame_count) >= _reserved_count) {
+        _reserved_count = _manifest.reserve(image_stem + "." + extension.getEnum(), static_cast<int>(frame_count), kIndexReserve);
     }
 }
 
 MO_REGISTER_CLASS(DetectionWriter)
 
 void DetectionWriterFolder::nodeInit(bool firstInit) {
-    if (firstInit) {
-        _write_thread = boost::thread(
-            [this]() {
-                std::pair<cv::Mat, std::string> data;
-                while (!boost::this_thread::interruption_requested()) {
-                    if (_write_queue.try_dequeue(data)) {
-                        cv::imwrite(data.second, data.first);
-                    }
-                }
-            });
-    }
+    _write_queue.start(
+        [this](std::pair<cv::Mat, std::string>& data) {
+            _encode_pool.submit(data.first, data.second);
+        },
+        "DetectionWriterFolder");
 }
 
 DetectionWriterFolder::~DetectionWriterFolder() {
-    if (_write_thread.joinable()) {
-        _write_thread.interrupt();
-        _write_thread.join();
+    _write_queue.stop();
+    _summary.close();
+    if (!_manifest.directory().empty()) {
+        saveManifest(_frame_count);
+    }
+}
+
+void DetectionWriterFolder::setManifestLabels() {
+    for (size_t i = 0; i < _per_class_count.size() && i < _manifest_labels.size(); ++i) {
+        _manifest.set("label:" + _manifest_labels[i], _per_class_count[i]);
     }
-    _summary_ar.reset();
-    _summary_ofs.reset();
+}
+
+void DetectionWriterFolder::saveManifest(int next) {
+    _manifest.set(image_stem + "." + extension.getEnum(), next);
+    setManifestLabels();
+    _manifest.save();
+}
+
+void DetectionWriterFolder::compact_summary() {
+    if (_summary_path.empty())
+        return;
+    size_t count = compactNDJson(_summary_path, root_dir.string() + "/summary.json");
+    MO_LOG(info) << "Compacted " << count << " summary records into " << root_dir.string() << "/summary.json";
+}
+
+void DetectionWriterFolder::eos() {
+    _write_queue.flush();
+    _summary.flush(true);
 }
 
 struct FrameDetections {
@@ -216,43 +279,79 @@ struct FrameDetections {
 };
 
 struct WritePair {
-    WritePair(const aq::NClassDetectedObject& det, const std::string& name)
+    WritePair(const aq::NClassDetectedObject& det, const std::string& name, size_t fn)
         : detection(det)
-        , patch_name(name) {}
+        , patch_name(name)
+        , frame_number(fn) {}
     DetectedObject_<2, -1> detection;
     std::string patch_name;
+    size_t      frame_number;
     template <class AR>
     void serialize(AR& ar) {
-        ar(CEREAL_NVP(detection), CEREAL_NVP(patch_name));
+        ar(CEREAL_NVP(detection), CEREAL_NVP(patch_name), CEREAL_NVP(frame_number));
+    }
+};
+
+struct SummaryHeader {
+    std::string dataset_name;
+    template <class AR>
+    void serialize(AR& ar) {
+        ar(CEREAL_NVP(dataset_name));
     }
 };
 
 bool DetectionWriterFolder::processImpl() {
-    if (!_summary_ofs) {
+    syncWriteQueueParams(*this, _write_queue);
+    syncEncodePoolParams(*this, _encode_pool);
+    if (summary_batch_size_param.modified() || summary_sync_interval_s_param.modified()) {
+        _summary.setBatchSize(std::max(summary_batch_size, 1));
+        _summary.setSyncInterval(summary_sync_interval_s);
+        summary_batch_size_param.modified(false);
+        summary_sync_interval_s_param.modified(false);
+    }
+    // Frames without detections write no lines, the interval still has to be honored
+    _summary.poll();
+    if (!_summary.isOpen() || _summary_path != root_dir.string() + "/summary.ndjson") {
         if (!boost::filesystem::is_directory(root_dir)) {
             boost::filesystem::create_directories(root_dir);
         }
-        _summary_ofs.reset(new std::ofstream());
-        _summary_ofs->open(root_dir.string() + "/summary.json");
-        _summary_ar.reset(new cereal::JSONOutputArchive(*_summary_ofs));
-        (*_summary_ar)(CEREAL_NVP(dataset_name));
+        // Appends to the summary of a previous run in the same root_dir
+        _summary_path = root_dir.string() + "/summary.ndjson";
+        if (_summary.open(_summary_path)) {
+            SummaryHeader header{dataset_name};
+            _summary.write(header);
+        }
     }
     if (root_dir_param.modified()) {
-        for (int i = 0; i < labels->size(); ++i) {
-            int frame_count = 0;
+        if (!_manifest.directory().empty()) {
+            saveManifest(_frame_count);
+        }
+        _per_class_count.clear();
+        _per_class_count.resize(labels->size(), 0);
+        _manifest_labels = *labels;
+        for (size_t i = 0; i < labels->size(); ++i) {
             if (!boost::filesystem::is_directory(root_dir.string() + "/" + (*labels)[i])) {
                 boost::filesystem::create_directories(root_dir.string() + "/" + (*labels)[i]);
-            } else {
-                frame_count = findNextIndex(root_dir.string() + "/" + (*labels)[i], "." + extension.getEnum(), image_stem);
             }
-            _frame_count = std::max(_frame_count, frame_count);
         }
+        int next = 0;
+        if (_manifest.load(root_dir.string()) && _manifest.get(image_stem + "." + extension.getEnum(), next)) {
+            for (size_t i = 0; i < labels->size(); ++i) {
+                _manifest.get("label:" + (*labels)[i], _per_class_count[i]);
+            }
+        } else {
+            // No manifest, crops live in <label>/<subfolder>/ so every label folder is scanned recursively
+            for (size_t i = 0; i < labels->size(); ++i) {
+                next = std::max(next, findNextIndex(root_dir.string() + "/" + (*labels)[i], "." + extension.getEnum(), image_stem, true));
+            }
+        }
+        _frame_count = std::max(_frame_count, next);
         if (start_count != -1)
             _frame_count = start_count;
         root_dir_param.modified(false);
-        _per_class_count.clear();
-        _per_class_count.resize(labels->size(), 0);
         start_count = _frame_count;
+        setManifestLabels();
+        _reserved_count = _manifest.reserve(image_stem + "." + extension.getEnum(), _frame_count, kIndexReserve);
     }
 
     aq::NClassDetectedObject::DetectionList detections;
@@ -262,7 +361,6 @@ bool DetectionWriterFolder::processImpl() {
         detections = pruneDetections(*this->multiclass_detections, object_class);
     }
 
-    std::vector<WritePair> written_detections;
     if (image->getSyncState() == image->DEVICE_UPDATED) {
         const cv::cuda::GpuMat img = image->getGpuMat(stream());
         cv::Rect               img_rect(cv::Point(0, 0), img.size());
@@ -294,10 +392,10 @@ bool DetectionWriterFolder::processImpl() {
             },
                 stream());
             ss = std::stringstream();
-            ss << (*labels)[idx] << "/" << std::setw(4) << std::setfill('0') << _per_class_count[idx] / max_subfolder_size;
+            ss << (*labels)[idx] << "/" << std::setw(4) << std::setfill('0') << _per_class_count[idx] / max_subfolder_size << "/";
             ss << image_stem << std::setw(8) << std::setfill('0') << _frame_count << "." + extension.getEnum();
-            save_name = ss.str();
-            written_detections.emplace_back(detection, save_name);
+            WritePair record(detection, ss.str(), image_param.getFrameNumber());
+            _summary.write(record);
         }
     } else {
         cv::Mat  img = image->getMat(stream());
@@ -318,7 +416,7 @@ bool DetectionWriterFolder::processImpl() {
                 ss << folderss.str() << "/";
             }
 
-            ss << image_stem << std::setw(8) << std::setfill('0') << _frame_count++ << "." + extension.getEnum();
+            ss << image_stem << std::setw(8) << std::setfill('0') << _frame_count << "." + extension.getEnum();
             save_name = ss.str();
             cuda::enqueue_callback([this, rect, img, save_name]() {
                 cv::Mat save_img; //(cv::Mat::getStdAllocator());
@@ -327,10 +425,16 @@ bool DetectionWriterFolder::processImpl() {
                 this->_write_queue.enqueue(std::make_pair(save_img, save_name));
             },
                 stream());
+            ss = std::stringstream();
+            ss << (*labels)[idx] << "/" << std::setw(4) << std::setfill('0') << _per_class_count[idx] / max_subfolder_size << "/";
+            ss << image_stem << std::setw(8) << std::setfill('0') << _frame_count++ << "." + extension.getEnum();
+            WritePair record(detection, ss.str(), image_param.getFrameNumber());
+            _summary.write(record);
         }
     }
-    if (written_detections.size()) {
-        (*_summary_ar)(written_detections);
+    if (_frame_count >= _reserved_count) {
+        setManifestLabels();
+        _reserved_count = _manifest.reserve(image_stem + "." + extension.getEnum(), _frame_count, kIndexReserve);
     }
     return true;
 }
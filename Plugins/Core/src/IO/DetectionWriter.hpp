@@ -2,9 +2,13 @@
 #include "Aquila/nodes/Node.hpp"
 #include "Aquila/types/ObjectDetection.hpp"
 #include "Aquila/types/SyncedMemory.hpp"
-#include "MetaObject/core/detail/ConcurrentQueue.hpp"
 #include "MetaObject/thread/ThreadHandle.hpp"
 #include "MetaObject/thread/ThreadPool.hpp"
+#include "DetectionLog.hpp"
+#include "EncodePool.hpp"
+#include "IndexManifest.hpp"
+#include "NDJsonWriter.hpp"
+#include "WriteQueue.hpp"
 namespace aq {
 namespace nodes {
     enum Extension {
@@ -14,10 +18,20 @@ namespace nodes {
         bmp
     };
 
+    enum AnnotationFormat {
+        json_per_frame, // one cereal JSON file per image
+        binary_log      // DetectionLog chunks, see DetectionLog.hpp
+    };
+
     class IDetectionWriter : public Node {
     public:
-        typedef std::pair<cv::Mat, aq::NClassDetectedObject::DetectionList> WriteData_t;
-        typedef moodycamel::ConcurrentQueue<WriteData_t> WriteQueue_t;
+        struct WriteData_t {
+            cv::Mat                                 image;
+            aq::NClassDetectedObject::DetectionList detections;
+            size_t                                  frame_number;
+            mo::OptionalTime_t                      timestamp;
+        };
+        typedef WriteQueue<WriteData_t> WriteQueue_t;
         ~IDetectionWriter();
         MO_DERIVE(IDetectionWriter, Node)
         PARAM(mo::WriteDirectory, output_directory, {})
@@ -27,24 +41,37 @@ namespace nodes {
         PARAM(bool, skip_empty, true)
         PARAM(bool, pad, true)
         ENUM_PARAM(extension, jpg, png, tiff, bmp)
+        ENUM_PARAM(annotation_format, json_per_frame, binary_log)
+        PARAM(int, log_chunk_mb, 256)
         INPUT(SyncedMemory, image, nullptr)
         INPUT(std::vector<DetectedObject>, detections, nullptr)
-        PROPERTY(std::shared_ptr<boost::thread>, _write_thread, {})
-        PROPERTY(std::shared_ptr<WriteQueue_t>, _write_queue, {})
+        WRITE_QUEUE_PARAMS
+        ENCODE_POOL_PARAMS
         MO_END
     protected:
         bool processImpl();
         void nodeInit(bool firstInit);
-        virtual void writeThread() = 0;
-        size_t       frame_count   = 0;
+        virtual void write(WriteData_t& data) = 0;
+        size_t          frame_count     = 0;
+        int             _reserved_count = 0;
+        IndexManifest   _manifest;
+        ImageEncodePool _encode_pool;
+        WriteQueue_t    _write_queue;
     };
 
     class DetectionWriter : public IDetectionWriter {
     public:
+        // write() is virtual, the queue must be drained before this object is torn down
+        ~DetectionWriter();
         MO_DERIVE(DetectionWriter, IDetectionWriter)
+        // Connected to the frame grabber's end of stream, makes the log readable before shutdown
+        MO_SLOT(void, eos)
         MO_END
     protected:
-        virtual void writeThread();
+        virtual void write(WriteData_t& data);
+        DetectionLogWriter _log;
+        boost::mutex       _log_mtx; // eos flushes from the grabber thread
+        std::string        _log_dir;
     };
 
 
@@ -64,17 +91,28 @@ namespace nodes {
         OPTIONAL_INPUT(std::vector<DetectedObject>, detections, nullptr)
         OPTIONAL_INPUT(aq::NClassDetectedObject::DetectionList, multiclass_detections, nullptr)
         PARAM(int, start_count, -1)
+        PARAM(int, summary_batch_size, 64)
+        PARAM(double, summary_sync_interval_s, 5.0)
+        MO_SLOT(void, compact_summary)
+        MO_SLOT(void, eos)
+        WRITE_QUEUE_PARAMS
+        ENCODE_POOL_PARAMS
         MO_END;
 
     protected:
         void nodeInit(bool firstInit);
         bool processImpl();
-        int  _frame_count;
-        moodycamel::ConcurrentQueue<std::pair<cv::Mat, std::string> > _write_queue;
-        boost::thread                              _write_thread;
-        std::vector<int>                           _per_class_count;
-        std::shared_ptr<std::ofstream>             _summary_ofs;
-        std::shared_ptr<cereal::JSONOutputArchive> _summary_ar;
+        void setManifestLabels();
+        void saveManifest(int next);
+        int  _frame_count    = 0;
+        int  _reserved_count = 0;
+        IndexManifest                                _manifest;
+        std::vector<std::string>                     _manifest_labels;
+        ImageEncodePool                              _encode_pool;
+        WriteQueue<std::pair<cv::Mat, std::string> > _write_queue;
+        std::vector<int>                             _per_class_count;
+        NDJsonWriter                                 _summary;
+        std::string                                  _summary_path;
     };
 }
 }
@@ -0,0 +1,193 @@
+#include "EncodePool.hpp"
+#include <MetaObject/logging/logging.hpp>
+#include <MetaObject/thread/boost_thread.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <fstream>
+
+using namespace aq;
+using namespace aq::nodes;
+
+ImageEncodePool::ImageEncodePool(int num_threads, size_t capacity)
+    : _capacity(capacity) {
+    start(num_threads);
+}
+
+ImageEncodePool::~ImageEncodePool() {
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        _closed = true;
+    }
+    stop();
+}
+
+void ImageEncodePool::start(int num_threads) {
+    _num_threads = std::max(num_threads, 1);
+    _stopping    = false;
+    for (int i = 0; i < _num_threads; ++i) {
+        _workers.emplace_back([this]() {
+            mo::setThisThreadName("ImageEncodePool");
+            work();
+        });
+    }
+}
+
+void ImageEncodePool::stop() {
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        _stopping = true;
+    }
+    _job_cv.notify_all();
+    _done_cv.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+    _workers.clear();
+}
+
+void ImageEncodePool::setNumThreads(int num_threads) {
+    if (std::max(num_threads, 1) == _num_threads)
+        return;
+    stop();
+    start(num_threads);
+}
+
+void ImageEncodePool::setCapacity(size_t capacity) {
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        _capacity = capacity;
+    }
+    _done_cv.notify_all();
+}
+
+bool ImageEncodePool::submit(const cv::Mat& img, const std::string& path, const Callback_t& on_written) {
+    boost::mutex::scoped_lock lock(_mtx);
+    if (_closed) {
+        MO_LOG(warning) << "Dropping " << path << ", the encode pool is shutting down";
+        return false;
+    }
+    // Pending counts both queued and encoded but not yet committed images
+    while (_capacity != 0 && (_next_seq - _next_commit) >= _capacity && !_stopping) {
+        _done_cv.wait(lock);
+    }
+    Job job;
+    job.seq        = _next_seq++;
+    job.img        = img;
+    job.path       = path;
+    job.on_written = on_written;
+    _jobs.push_back(std::move(job));
+    lock.unlock();
+    _job_cv.notify_one();
+    return true;
+}
+
+void ImageEncodePool::flush() {
+    boost::mutex::scoped_lock lock(_mtx);
+    while (_next_commit != _next_seq) {
+        _done_cv.wait(lock);
+    }
+}
+
+size_t ImageEncodePool::queueDepth() const {
+    boost::mutex::scoped_lock lock(_mtx);
+    return _next_seq - _next_commit;
+}
+
+size_t ImageEncodePool::written() const {
+    boost::mutex::scoped_lock lock(_mtx);
+    return _written;
+}
+
+double ImageEncodePool::meanEncodeMs() const {
+    boost::mutex::scoped_lock lock(_mtx);
+    return _mean_ms;
+}
+
+double ImageEncodePool::maxEncodeMs() const {
+    boost::mutex::scoped_lock lock(_mtx);
+    return _max_ms;
+}
+
+void ImageEncodePool::work() {
+    while (true) {
+        Job job;
+        {
+            boost::mutex::scoped_lock lock(_mtx);
+            while (_jobs.empty() && !_stopping) {
+                _job_cv.wait(lock);
+            }
+            if (_jobs.empty())
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        Result result;
+        result.path       = std::move(job.path);
+        result.on_written = std::move(job.on_written);
+        auto start        = std::chrono::steady_clock::now();
+        try {
+            result.ok = cv::imencode(boost::filesystem::path(result.path).extension().string(), job.img, result.buffer);
+        } catch (cv::Exception& e) {
+            MO_LOG(warning) << "Unable to encode " << result.path << ": " << e.what();
+            result.ok = false;
+        }
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        {
+            boost::mutex::scoped_lock lock(_mtx);
+            _mean_ms = _encoded++ == 0 ? elapsed : 0.9 * _mean_ms + 0.1 * elapsed;
+            _max_ms  = std::max(_max_ms, elapsed);
+            _results.emplace(job.seq, std::move(result));
+        }
+        commit();
+    }
+}
+
+void ImageEncodePool::commit() {
+    // Only one thread writes files at a time, whoever holds the lock writes every
+    // result that is next in sequence, including ones finished by other workers.
+    while (true) {
+        {
+            boost::mutex::scoped_lock commit_lock(_commit_mtx, boost::try_to_lock);
+            if (!commit_lock.owns_lock())
+                return;
+            while (commitNext()) {
+            }
+        }
+        // A worker that failed try_lock above relies on the holder to pick up its result
+        boost::mutex::scoped_lock lock(_mtx);
+        if (_results.find(_next_commit) == _results.end())
+            return;
+    }
+}
+
+bool ImageEncodePool::commitNext() {
+    Result result;
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        auto                      itr = _results.find(_next_commit);
+        if (itr == _results.end())
+            return false;
+        result = std::move(itr->second);
+        _results.erase(itr);
+    }
+    if (result.ok) {
+        std::ofstream ofs(result.path, std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(result.buffer.data()), result.buffer.size());
+        if (!ofs) {
+            MO_LOG(warning) << "Unable to write " << result.path;
+        }
+    }
+    if (result.on_written) {
+        result.on_written();
+    }
+    {
+        boost::mutex::scoped_lock lock(_mtx);
+        ++_next_commit;
+        ++_written;
+    }
+    _done_cv.notify_all();
+    return true;
+}
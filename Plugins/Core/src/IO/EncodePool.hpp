@@ -0,0 +1,102 @@
+#pragma once
+#include "CoreExport.hpp"
+#include <opencv2/core.hpp>
+
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace aq {
+namespace nodes {
+    // Encodes images on a pool of threads and writes them to disk.
+    // Files are written in submission order regardless of which worker finished first,
+    // so file names and counters assigned by the caller stay deterministic.
+    class Core_EXPORT ImageEncodePool {
+    public:
+        typedef std::function<void()> Callback_t;
+
+        ImageEncodePool(int num_threads = 2, size_t capacity = 64);
+        ~ImageEncodePool();
+
+        // Drains pending work and restarts with num_threads workers
+        void setNumThreads(int num_threads);
+        void setCapacity(size_t capacity);
+
+        // Blocks while capacity images are pending.
+        // on_written is called after the file is on disk, in submission order.
+        // Returns false, and logs the dropped image, once the pool is being destroyed.
+        bool submit(const cv::Mat& img, const std::string& path, const Callback_t& on_written = Callback_t());
+
+        // Block until all submitted images have been written
+        void flush();
+
+        size_t queueDepth() const;
+        size_t written() const;
+        // Exponential moving average of the per image encode time
+        double meanEncodeMs() const;
+        double maxEncodeMs() const;
+
+    private:
+        struct Job {
+            size_t      seq;
+            cv::Mat     img;
+            std::string path;
+            Callback_t  on_written;
+        };
+        struct Result {
+            std::vector<uchar> buffer;
+            std::string        path;
+            Callback_t         on_written;
+            bool               ok;
+        };
+
+        void start(int num_threads);
+        void stop();
+        void work();
+        void commit();
+        bool commitNext();
+
+        mutable boost::mutex       _mtx;
+        boost::mutex               _commit_mtx;
+        boost::condition_variable  _job_cv;
+        boost::condition_variable  _done_cv;
+        std::vector<boost::thread> _workers;
+        std::deque<Job>            _jobs;
+        std::map<size_t, Result>   _results;
+        size_t                     _capacity;
+        size_t                     _next_seq    = 0;
+        size_t                     _next_commit = 0;
+        size_t                     _written     = 0;
+        size_t                     _encoded     = 0;
+        int                        _num_threads = 0;
+        double                     _mean_ms     = 0.0;
+        double                     _max_ms      = 0.0;
+        bool                       _stopping    = false;
+        // Set by the destructor, a restart from setNumThreads keeps accepting images
+        bool                       _closed      = false;
+    };
+
+    // Applies a node's modified ENCODE_POOL_PARAMS to its pool and publishes the pool status
+    template <class NodeT>
+    void syncEncodePoolParams(NodeT& node, ImageEncodePool& pool) {
+        if (node.encode_threads_param.modified()) {
+            pool.setNumThreads(node.encode_threads);
+            node.encode_threads_param.modified(false);
+        }
+        node.encode_queue_depth_param.updateData(static_cast<int>(pool.queueDepth()));
+        node.encode_latency_ms_param.updateData(pool.meanEncodeMs());
+    }
+}
+}
+
+// Parameters of a node encoding images through an ImageEncodePool, placed inside its MO_DERIVE block
+#define ENCODE_POOL_PARAMS                  \
+    PARAM(int, encode_threads, 2)           \
+    STATUS(int, encode_queue_depth, 0)      \
+    STATUS(double, encode_latency_ms, 0.0)
@@ -27,6 +27,8 @@ bool ImageWriter::processImpl()
         break;
     }
 
+    syncEncodePoolParams(*this, *_encode_pool);
+
     ++frame_count;
     if(frequency == 0 && request_write == false)
         return true;
@@ -43,14 +45,15 @@ bool ImageWriter::processImpl()
         std::string save_name = ss.str();
         if(input_image->getSyncState() < SyncedMemory::DEVICE_UPDATED)
         {
-            cv::imwrite(save_name, input_image->getMat(stream()));
+            _encode_pool->submit(input_image->getMat(stream()), save_name);
         }else
         {
             input_image->synchronize(stream());
             cv::Mat mat = input_image->getMat(stream());
-            cuda::enqueue_callback_async([mat, save_name]()->void
+            std::shared_ptr<ImageEncodePool> pool = _encode_pool;
+            cuda::enqueue_callback_async([mat, save_name, pool]()->void
             {
-                cv::imwrite(save_name, mat);
+                pool->submit(mat, save_name);
             }, stream());
         }
         frameSkip = 0;
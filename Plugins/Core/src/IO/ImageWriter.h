@@ -2,6 +2,8 @@
 
 
 #include <src/precompiled.hpp>
+#include "EncodePool.hpp"
+#include <memory>
 RUNTIME_COMPILER_SOURCEDEPENDENCY
 RUNTIME_MODIFIABLE_INCLUDE
 namespace aq
@@ -35,11 +37,14 @@ namespace aq
         #endif
             STATUS(int, frame_count, 0)
             PARAM(bool, request_write, false)
+            ENCODE_POOL_PARAMS
             MO_SLOT(void, snap)
         MO_END;
     protected:
         bool processImpl();
-        
+        // Shared with the stream callbacks that submit device images, which can run after the node is gone
+        std::shared_ptr<ImageEncodePool> _encode_pool = std::make_shared<ImageEncodePool>();
+
     };
     }
 }
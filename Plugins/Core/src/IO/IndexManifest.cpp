@@ -0,0 +1,121 @@
+#include "IndexManifest.hpp"
+#include <MetaObject/logging/logging.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace {
+std::string manifestPath(const std::string& dir) {
+    return dir + "/.index_manifest";
+}
+
+bool syncFile(FILE* file) {
+#ifdef _MSC_VER
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Makes the rename itself durable, directories can not be synced on Windows
+void syncDirectory(const std::string& dir) {
+#ifndef _MSC_VER
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+}
+
+bool IndexManifest::load(const std::string& dir) {
+    _dir = dir;
+    _values.clear();
+    std::ifstream ifs(manifestPath(dir));
+    if (!ifs)
+        return false;
+    // One "key<tab>value" per line, keys may contain spaces
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto pos = line.find_last_of('\t');
+        if (pos == std::string::npos)
+            continue;
+        try {
+            _values[line.substr(0, pos)] = boost::lexical_cast<int>(line.substr(pos + 1));
+        } catch (boost::bad_lexical_cast&) {
+            MO_LOG(warning) << "Ignoring malformed line in " << manifestPath(dir) << ": " << line;
+        }
+    }
+    return !_values.empty();
+}
+
+bool IndexManifest::get(const std::string& key, int& value) const {
+    auto itr = _values.find(key);
+    if (itr == _values.end())
+        return false;
+    value = itr->second;
+    return true;
+}
+
+void IndexManifest::set(const std::string& key, int value) {
+    _values[key] = value;
+}
+
+bool IndexManifest::save() const {
+    if (_dir.empty())
+        return false;
+    const std::string path = manifestPath(_dir);
+    const std::string tmp  = path + ".tmp";
+    std::stringstream ss;
+    for (const auto& value : _values) {
+        ss << value.first << '\t' << value.second << '\n';
+    }
+    const std::string contents = ss.str();
+    // The rename must not reach the disk before the data it points to
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        MO_LOG(warning) << "Unable to open " << tmp;
+        return false;
+    }
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok      = fflush(file) == 0 && ok;
+    ok      = syncFile(file) && ok;
+    fclose(file);
+    if (!ok) {
+        MO_LOG(warning) << "Unable to write " << tmp;
+        return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        MO_LOG(warning) << "Unable to update " << path << ": " << ec.message();
+        return false;
+    }
+    syncDirectory(_dir);
+    return true;
+}
+
+int IndexManifest::reserve(const std::string& key, int next, int block) {
+    set(key, next + block);
+    save();
+    return next + block;
+}
+
+const std::string& IndexManifest::directory() const {
+    return _dir;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "CoreExport.hpp"
+
+#include <map>
+#include <string>
+
+namespace aq {
+namespace nodes {
+    // Per directory record of the next free file index, persisted as <dir>/.index_manifest.
+    // Writers reserve indices in blocks: the saved value is ahead of what has actually been
+    // written, so after a crash the writer resumes past any file it may have produced and
+    // the manifest only needs to be rewritten once per block.
+    class Core_EXPORT IndexManifest {
+    public:
+        // Returns false if the directory has no manifest, a full scan is needed in that case
+        bool load(const std::string& dir);
+        bool get(const std::string& key, int& value) const;
+        void set(const std::string& key, int value);
+        // Writes and syncs a temporary file, renames it over the manifest and syncs the directory
+        bool save() const;
+
+        // Records next + block for key, returns the index at which the next reservation is needed
+        int reserve(const std::string& key, int next, int block = 256);
+
+        const std::string& directory() const;
+
+    private:
+        std::string                _dir;
+        std::map<std::string, int> _values;
+    };
+}
+}
@@ -0,0 +1,175 @@
+#include "NDJsonWriter.hpp"
+#include <MetaObject/logging/logging.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace {
+void syncFile(FILE* file) {
+#ifdef _MSC_VER
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+// Cuts a trailing partial line left behind by a crash, returns the resulting size
+boost::uintmax_t truncatePartialLine(const std::string& path) {
+    boost::uintmax_t size = boost::filesystem::file_size(path);
+    if (size == 0)
+        return 0;
+    std::ifstream    ifs(path, std::ios::binary);
+    boost::uintmax_t end = size;
+    char             c   = 0;
+    while (end > 0) {
+        ifs.seekg(end - 1);
+        ifs.get(c);
+        if (c == '\n')
+            break;
+        --end;
+    }
+    ifs.close();
+    if (end != size) {
+        MO_LOG(warning) << "Discarding " << size - end << " bytes of an incomplete record at the end of " << path;
+        boost::filesystem::resize_file(path, end);
+    }
+    return end;
+}
+}
+
+NDJsonWriter::NDJsonWriter(size_t batch_size, double sync_interval_s)
+    : _batch_size(batch_size)
+    , _sync_interval_s(sync_interval_s) {
+}
+
+NDJsonWriter::~NDJsonWriter() {
+    close();
+}
+
+bool NDJsonWriter::open(const std::string& path) {
+    close();
+    boost::uintmax_t size = 0;
+    if (boost::filesystem::exists(path)) {
+        size = truncatePartialLine(path);
+    }
+    _file = fopen(path.c_str(), "ab");
+    if (!_file) {
+        MO_LOG(warning) << "Unable to open " << path;
+        return false;
+    }
+    _lines     = 0;
+    _last_sync = std::chrono::steady_clock::now();
+    return size == 0;
+}
+
+void NDJsonWriter::close() {
+    if (_file) {
+        flush(true);
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool NDJsonWriter::isOpen() const {
+    return _file != nullptr;
+}
+
+void NDJsonWriter::setBatchSize(size_t batch_size) {
+    _batch_size = batch_size;
+    if (_buffered >= _batch_size) {
+        flush();
+    }
+}
+
+void NDJsonWriter::setSyncInterval(double sync_interval_s) {
+    _sync_interval_s = sync_interval_s;
+}
+
+void NDJsonWriter::writeLine(std::string line) {
+    // The archive pretty prints, newlines inside JSON strings are escaped so every raw newline is formatting
+    line.erase(std::remove(line.begin(), line.end(), '\n'), line.end());
+    _buffer += line;
+    _buffer += '\n';
+    ++_buffered;
+    ++_lines;
+    if (_buffered >= _batch_size ||
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - _last_sync).count() >= _sync_interval_s) {
+        flush();
+    }
+}
+
+void NDJsonWriter::flush(bool sync) {
+    if (!_file)
+        return;
+    if (!_buffer.empty()) {
+        if (fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size()) {
+            MO_LOG(warning) << "Failed to write " << _buffered << " summary records";
+        }
+        fflush(_file);
+        _buffer.clear();
+        _buffered = 0;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (sync || std::chrono::duration<double>(now - _last_sync).count() >= _sync_interval_s) {
+        syncFile(_file);
+        _last_sync = now;
+    }
+}
+
+void NDJsonWriter::poll() {
+    if (_file && std::chrono::duration<double>(std::chrono::steady_clock::now() - _last_sync).count() >= _sync_interval_s) {
+        flush(true);
+    }
+}
+
+size_t NDJsonWriter::lines() const {
+    return _lines;
+}
+
+size_t aq::nodes::compactNDJson(const std::string& ndjson_path, const std::string& json_path) {
+    std::ifstream ifs(ndjson_path);
+    if (!ifs) {
+        MO_LOG(warning) << "Unable to open " << ndjson_path;
+        return 0;
+    }
+    const std::string tmp_path = json_path + ".tmp";
+    std::ofstream     ofs(tmp_path);
+    if (!ofs) {
+        MO_LOG(warning) << "Unable to open " << tmp_path;
+        return 0;
+    }
+    ofs << "{\n    \"records\": [";
+    std::string line;
+    size_t      count = 0;
+    while (std::getline(ifs, line)) {
+        if (line.size() < 2 || line.front() != '{' || line.back() != '}')
+            continue;
+        ofs << (count ? ",\n        " : "\n        ") << line;
+        ++count;
+    }
+    ofs << "\n    ]\n}\n";
+    ofs.close();
+    if (!ofs) {
+        MO_LOG(warning) << "Failed writing " << tmp_path;
+        return 0;
+    }
+    // Readers of json_path never see a half written document
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_path, json_path, ec);
+    if (ec) {
+        MO_LOG(warning) << "Unable to rename " << tmp_path << " to " << json_path << ": " << ec.message();
+        return 0;
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "CoreExport.hpp"
+#include <cereal/archives/json.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+namespace aq {
+namespace nodes {
+    // Newline delimited JSON, one record per line.
+    // Lines are buffered and written in batches of batch_size or once sync_interval has passed,
+    // whichever comes first, at which point the file is also fsync'd. Reopening an existing file appends to it after
+    // discarding a partially written last line.
+    class Core_EXPORT NDJsonWriter {
+    public:
+        NDJsonWriter(size_t batch_size = 64, double sync_interval_s = 5.0);
+        ~NDJsonWriter();
+
+        // Returns true if the file did not exist or was empty
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const;
+
+        void setBatchSize(size_t batch_size);
+        void setSyncInterval(double sync_interval_s);
+
+        // Appends the fields written by value.serialize as a single JSON object
+        template <class T>
+        void write(T& value);
+        void writeLine(std::string line);
+
+        // Writes buffered lines, sync additionally forces them to disk
+        void flush(bool sync = false);
+        // Flushes and syncs if sync_interval has passed, for callers that stop writing lines for a while
+        void poll();
+
+        size_t lines() const;
+
+    private:
+        FILE*                                 _file = nullptr;
+        std::string                           _buffer;
+        size_t                                _buffered   = 0;
+        size_t                                _lines      = 0;
+        size_t                                _batch_size;
+        double                                _sync_interval_s;
+        std::chrono::steady_clock::time_point _last_sync;
+    };
+
+    // Streams an NDJSON summary into a single JSON document {"records": [ ... ]} without
+    // holding more than one line in memory. Lines that are not complete JSON objects are skipped.
+    // Returns the number of records written.
+    size_t Core_EXPORT compactNDJson(const std::string& ndjson_path, const std::string& json_path);
+
+    template <class T>
+    void NDJsonWriter::write(T& value) {
+        std::stringstream ss;
+        {
+            cereal::JSONOutputArchive ar(ss, cereal::JSONOutputArchive::Options::NoIndent());
+            value.serialize(ar);
+        }
+        writeLine(ss.str());
+    }
+}
+}
@@ -10,42 +10,35 @@ using namespace aq;
 using namespace aq::nodes;
 
 VideoWriter::~VideoWriter() {
-    _write_thread.interrupt();
-    _write_thread.join();
+    _write_queue.stop();
 }
 
 void VideoWriter::nodeInit(bool firstInit) {
-    _write_thread = boost::thread(
-        [this]() {
-            size_t                         video_frame_number = 0;
-            std::unique_ptr<std::ofstream> ofs;
-            mo::setThisThreadName("VideoWriter");
-            while (!boost::this_thread::interruption_requested()) {
-                WriteData data;
-                if (_write_queue.try_dequeue(data) && h_writer) {
-                    mo::scoped_profile profile("Writing video");
-                    h_writer->write(data.img);
-                    if (!ofs && write_metadata) {
-                        ofs.reset(new std::ofstream(outdir.string() + "/" + metadata_stem + ".txt"));
-                        (*ofs) << dataset_name << std::endl;
-                    }
-                    if (ofs) {
-                        (*ofs) << video_frame_number << " " << data.fn;
-                        if (data.ts)
-                            (*ofs) << " " << *data.ts;
-                        (*ofs) << std::endl;
-                    }
-                    ++video_frame_number;
-                } else {
-                    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
-                }
-            }
-        });
+    _write_queue.start([this](WriteData& data) { write(data); }, "VideoWriter");
+}
+
+void VideoWriter::write(WriteData& data) {
+    if (!h_writer)
+        return;
+    mo::scoped_profile profile("Writing video");
+    h_writer->write(data.img);
+    if (!_metadata_ofs && write_metadata) {
+        _metadata_ofs.reset(new std::ofstream(outdir.string() + "/" + metadata_stem + ".txt"));
+        (*_metadata_ofs) << dataset_name << std::endl;
+    }
+    if (_metadata_ofs) {
+        (*_metadata_ofs) << _video_frame_number << " " << data.fn;
+        if (data.ts)
+            (*_metadata_ofs) << " " << *data.ts;
+        (*_metadata_ofs) << std::endl;
+    }
+    ++_video_frame_number;
 }
 
 bool VideoWriter::processImpl() {
     if (image->empty())
         return false;
+    syncWriteQueueParams(*this, _write_queue);
     if (h_writer == nullptr && d_writer == nullptr) {
         if (!boost::filesystem::exists(outdir)) {
             boost::system::error_code ec;
@@ -93,6 +86,7 @@ bool VideoWriter::processImpl() {
 }
 
 void VideoWriter::write_out() {
+    _write_queue.flush();
     d_writer.release();
     h_writer.release();
 }
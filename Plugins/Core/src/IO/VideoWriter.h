@@ -6,7 +6,8 @@
 #include "RuntimeObjectSystem/RuntimeSourceDependency.h"
 #include "MetaObject/thread/ThreadHandle.hpp"
 #include "MetaObject/thread/ThreadPool.hpp"
-#include "MetaObject/core/detail/ConcurrentQueue.hpp"
+#include "WriteQueue.hpp"
+#include <fstream>
 RUNTIME_COMPILER_SOURCEDEPENDENCY
 RUNTIME_MODIFIABLE_INCLUDE
 namespace aq
@@ -30,17 +31,20 @@ namespace nodes
             PARAM(bool, write_metadata, false)
             PARAM(std::string, metadata_stem, "metadata")
             PARAM(std::string, dataset_name, "")
+            WRITE_QUEUE_PARAMS
         MO_END;
         void nodeInit(bool firstInit);
     protected:
         bool processImpl();
-        boost::thread _write_thread;
         struct WriteData{
             cv::Mat img;
             boost::optional<mo::Time_t> ts;
             size_t fn;
         };
-        moodycamel::ConcurrentQueue<WriteData> _write_queue;
+        void write(WriteData& data);
+        WriteQueue<WriteData> _write_queue;
+        size_t _video_frame_number = 0;
+        std::unique_ptr<std::ofstream> _metadata_ofs;
     };
 #ifdef HAVE_FFMPEG
     class VideoWriterFFMPEG: public Node
@@ -0,0 +1,205 @@
+#pragma once
+#include <MetaObject/logging/logging.hpp>
+#include <MetaObject/thread/boost_thread.hpp>
+
+#include <boost/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <string>
+
+namespace aq {
+namespace nodes {
+    // What enqueue does when the queue already holds capacity items
+    enum WriteQueuePolicy {
+        BlockOnFull, // wait for the writer thread to catch up
+        DropNewest,  // discard the item being enqueued
+        DropOldest   // discard the oldest queued item
+    };
+
+    // Bounded queue serviced by a single writer thread.
+    // The writer thread sleeps on a condition variable while the queue is empty
+    // and drains everything that was enqueued before stop() returns. An exception
+    // thrown by the handler is logged and the item is lost.
+    template <class T>
+    class WriteQueue {
+    public:
+        typedef std::function<void(T&)> Handler_t;
+
+        WriteQueue(size_t capacity = 100, WriteQueuePolicy policy = BlockOnFull)
+            : _capacity(capacity)
+            , _policy(policy) {
+        }
+
+        ~WriteQueue() {
+            stop();
+        }
+
+        void start(const Handler_t& handler, const std::string& thread_name) {
+            stop();
+            boost::mutex::scoped_lock lock(_mtx);
+            _handler  = handler;
+            _name     = thread_name;
+            _stopping = false;
+            _thread   = boost::thread([this, thread_name]() {
+                mo::setThisThreadName(thread_name);
+                run();
+            });
+        }
+
+        // Drain the remaining items and join the writer thread
+        void stop() {
+            {
+                boost::mutex::scoped_lock lock(_mtx);
+                _stopping = true;
+            }
+            _data_cv.notify_all();
+            _space_cv.notify_all();
+            if (_thread.joinable() && _thread.get_id() != boost::this_thread::get_id()) {
+                _thread.join();
+            }
+        }
+
+        // Returns false if data, or an older item, was dropped due to the queue policy
+        // or because the queue is stopped
+        bool enqueue(T&& data) {
+            boost::mutex::scoped_lock lock(_mtx);
+            // Nothing would write the item once the writer thread has drained and exited
+            if (_stopping) {
+                ++_dropped;
+                return false;
+            }
+            bool accepted = true;
+            if (_capacity != 0 && _queue.size() >= _capacity) {
+                switch (_policy) {
+                case BlockOnFull:
+                    while (_queue.size() >= _capacity && !_stopping) {
+                        _space_cv.wait(lock);
+                    }
+                    if (_stopping) {
+                        ++_dropped;
+                        return false;
+                    }
+                    break;
+                case DropNewest:
+                    ++_dropped;
+                    return false;
+                case DropOldest:
+                    _queue.pop_front();
+                    ++_dropped;
+                    accepted = false;
+                    break;
+                }
+            }
+            _queue.push_back(std::move(data));
+            lock.unlock();
+            _data_cv.notify_one();
+            return accepted;
+        }
+
+        bool enqueue(const T& data) {
+            T copy(data);
+            return enqueue(std::move(copy));
+        }
+
+        // Block until everything enqueued so far has been handled
+        void flush() {
+            boost::mutex::scoped_lock lock(_mtx);
+            while ((!_queue.empty() || _busy) && _thread.joinable()) {
+                _space_cv.wait(lock);
+            }
+        }
+
+        void setCapacity(size_t capacity) {
+            {
+                boost::mutex::scoped_lock lock(_mtx);
+                _capacity = capacity;
+            }
+            _space_cv.notify_all();
+        }
+
+        void setPolicy(WriteQueuePolicy policy) {
+            {
+                boost::mutex::scoped_lock lock(_mtx);
+                _policy = policy;
+            }
+            _space_cv.notify_all();
+        }
+
+        size_t size() const {
+            boost::mutex::scoped_lock lock(_mtx);
+            return _queue.size();
+        }
+
+        size_t dropped() const {
+            boost::mutex::scoped_lock lock(_mtx);
+            return _dropped;
+        }
+
+    private:
+        void run() {
+            boost::mutex::scoped_lock lock(_mtx);
+            while (true) {
+                while (_queue.empty() && !_stopping) {
+                    _data_cv.wait(lock);
+                }
+                if (_queue.empty()) {
+                    break;
+                }
+                T data = std::move(_queue.front());
+                _queue.pop_front();
+                _busy = true;
+                lock.unlock();
+                _space_cv.notify_all();
+                try {
+                    _handler(data);
+                } catch (std::exception& e) {
+                    MO_LOG(warning) << _name << " failed to write an item: " << e.what();
+                } catch (...) {
+                    MO_LOG(warning) << _name << " failed to write an item";
+                }
+                lock.lock();
+                _busy = false;
+                if (_queue.empty()) {
+                    _space_cv.notify_all();
+                }
+            }
+        }
+
+        mutable boost::mutex      _mtx;
+        boost::condition_variable _data_cv;
+        boost::condition_variable _space_cv;
+        std::deque<T>             _queue;
+        Handler_t                 _handler;
+        std::string               _name;
+        boost::thread             _thread;
+        size_t                    _capacity;
+        WriteQueuePolicy          _policy;
+        size_t                    _dropped  = 0;
+        bool                      _stopping = false;
+        bool                      _busy     = false;
+    };
+
+    // Applies a node's modified WRITE_QUEUE_PARAMS to its queue and publishes the queue depth
+    template <class NodeT, class T>
+    void syncWriteQueueParams(NodeT& node, WriteQueue<T>& queue) {
+        if (node.queue_capacity_param.modified() || node.queue_policy_param.modified()) {
+            queue.setCapacity(std::max(node.queue_capacity, 0));
+            queue.setPolicy(static_cast<WriteQueuePolicy>(node.queue_policy.getValue()));
+            node.queue_capacity_param.modified(false);
+            node.queue_policy_param.modified(false);
+        }
+        node.write_queue_depth_param.updateData(static_cast<int>(queue.size()));
+    }
+}
+}
+
+// Parameters of a node writing through a WriteQueue, placed inside its MO_DERIVE block
+#define WRITE_QUEUE_PARAMS                                          \
+    PARAM(int, queue_capacity, 100)                                 \
+    ENUM_PARAM(queue_policy, BlockOnFull, DropNewest, DropOldest)   \
+    STATUS(int, write_queue_depth, 0)
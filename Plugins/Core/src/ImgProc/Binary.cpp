@@ -12,22 +12,32 @@ bool MorphologyFilter::processImpl()
     {
         if (structuring_element_type_param.modified() || morphology_type_param.modified() ||
             anchor_point_param.modified() || iterations_param.modified() ||
-            filter == nullptr)
+            structuring_element_size_param.modified())
         {
             structuring_element_param.updateData(
                 cv::getStructuringElement(
                     structuring_element_type.currentSelection,
                     ::cv::Size(structuring_element_size, structuring_element_size), anchor_point));
-
-            filter = ::cv::cuda::createMorphologyFilter(
-                morphology_type.currentSelection, input_image->getMat(stream()).type(),
-                structuring_element, anchor_point, iterations);
-
+            filter.release();
             structuring_element_size_param.modified(false);
             morphology_type_param.modified(false);
             anchor_point_param.modified(false);
             iterations_param.modified(false);
         }
+        if(input_image->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+        {
+            cv::Mat out;
+            cv::morphologyEx(input_image->getMat(stream()), out, morphology_type.currentSelection,
+                             structuring_element, anchor_point, iterations);
+            this->output_param.updateData(out, mo::tag::_param = input_image_param, _ctx.get());
+            return true;
+        }
+        if(filter == nullptr)
+        {
+            filter = ::cv::cuda::createMorphologyFilter(
+                morphology_type.currentSelection, input_image->getType(),
+                structuring_element, anchor_point, iterations);
+        }
         cv::cuda::GpuMat out;
         filter->apply(input_image->getGpuMat(stream()), out, stream());
         this->output_param.updateData(out, mo::tag::_param = input_image_param, _ctx.get());
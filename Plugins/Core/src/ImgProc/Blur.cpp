@@ -7,9 +7,18 @@ using namespace aq;
 using namespace aq::nodes;
 
 bool MedianBlur::processImpl(){
+    if(input->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+    {
+        cv::Mat output;
+        cv::medianBlur(input->getMat(stream()), output, window_size);
+        output_param.updateData(output, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     if(!_median_filter || window_size_param.modified() || partition_param.modified())
     {
         _median_filter = cv::cuda::createMedianFilter(input->getDepth(), window_size, partition);
+        window_size_param.modified(false);
+        partition_param.modified(false);
     }
     cv::cuda::GpuMat output;
     if(input->getChannels() != 1 && false)
@@ -126,6 +126,34 @@ bool DrawDetections::processImpl()
 
 bool Normalize::processImpl()
 {
+    if(input_image->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+    {
+        cv::Mat normalized;
+        if(input_image->getChannels() == 1)
+        {
+            cv::normalize(input_image->getMat(stream()),
+                normalized,
+                alpha,
+                beta,
+                norm_type.currentSelection, input_image->getDepth(),
+                mask == NULL ? cv::noArray(): mask->getMat(stream()));
+            normalized_output_param.updateData(normalized, input_image_param.getTimestamp(), _ctx.get());
+            return true;
+        }
+        std::vector<cv::Mat> channels;
+        cv::split(input_image->getMat(stream()), channels);
+        for(int i = 0; i < channels.size(); ++i)
+        {
+            cv::normalize(channels[i], channels[i],
+                alpha,
+                beta,
+                norm_type.getValue(), input_image->getDepth(),
+                mask == NULL ? cv::noArray() : mask->getMat(stream()));
+        }
+        cv::merge(channels, normalized);
+        normalized_output_param.updateData(normalized, input_image_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     cv::cuda::GpuMat normalized;
 
     if(input_image->getChannels() == 1)
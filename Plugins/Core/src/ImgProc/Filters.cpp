@@ -7,6 +7,13 @@ using namespace aq::nodes;
 
 bool Canny::processImpl()
 {
+    if(input->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+    {
+        cv::Mat edges;
+        cv::Canny(input->getMat(stream()), edges, low_thresh, high_thresh, aperature_size, L2_gradient);
+        edges_param.updateData(edges, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     if(low_thresh_param.modified() || 
         high_thresh_param.modified() || 
         aperature_size_param.modified() || 
@@ -14,6 +21,10 @@ bool Canny::processImpl()
         detector == nullptr)
     {
         detector = cv::cuda::createCannyEdgeDetector(low_thresh, high_thresh, aperature_size, L2_gradient);
+        low_thresh_param.modified(false);
+        high_thresh_param.modified(false);
+        aperature_size_param.modified(false);
+        L2_gradient_param.modified(false);
     }
     cv::cuda::GpuMat edges;
     detector->detect(input->getGpuMat(stream()), edges, stream());
@@ -1,8 +1,38 @@
 #include "Histogram.hpp"
+#include "HistogramHost.hpp"
 #include "opencv2/cudaimgproc.hpp"
 #include "Aquila/nodes/NodeInfo.hpp"
+#include <opencv2/imgproc.hpp>
 using namespace aq::nodes;
 
+namespace
+{
+    // cv::cuda::histRange has no mask, and for small images the download is cheaper than the launch
+    bool binOnHost(const aq::SyncedMemory& input, const aq::SyncedMemory* mask, int host_max_pixels)
+    {
+#ifdef HAVE_CUDA
+        return input.getSyncState() < aq::SyncedMemory::DEVICE_UPDATED || mask != nullptr ||
+               input.getSize().area() <= host_max_pixels;
+#else
+        (void)input; (void)mask; (void)host_max_pixels;
+        return true;
+#endif
+    }
+
+    // Host copies of input and mask, waits for the download if either was on the device
+    void downloadInputs(const aq::SyncedMemory& input, const aq::SyncedMemory* mask, cv::Mat& image, cv::Mat& h_mask,
+                        cv::cuda::Stream& stream)
+    {
+        const bool on_device = input.getSyncState() >= aq::SyncedMemory::DEVICE_UPDATED ||
+                               (mask && mask->getSyncState() >= aq::SyncedMemory::DEVICE_UPDATED);
+        image = input.getMat(stream);
+        if(mask)
+            h_mask = mask->getMat(stream);
+        if(on_device)
+            stream.waitForCompletion();
+    }
+}
+
 bool HistogramRange::processImpl()
 {
     if(lower_bound_param.modified() || upper_bound_param.modified() || bins_param.modified())
@@ -12,6 +42,20 @@ bool HistogramRange::processImpl()
         upper_bound_param.modified(false);
         bins_param.modified(false);
     }
+    if(binOnHost(*input, mask, host_max_pixels))
+    {
+        cv::Mat in, h_mask, hist;
+        downloadInputs(*input, mask, in, h_mask, stream());
+        // levels holds the bin edges, one row of bins per channel
+        if(!histogramHost(in, h_mask, levels.getMat(stream()), hist))
+        {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to bin image of depth " << in.depth() << ", expected CV_8U, CV_16U, CV_16S or CV_32F"
+                                         << " levels and a CV_8UC1 mask of the same size";
+            return false;
+        }
+        histogram_param.updateData(hist, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     if(input->getChannels() == 1 || input->getChannels() == 4)
     {
         cv::cuda::GpuMat hist;
@@ -37,7 +81,7 @@ void HistogramRange::updateLevels(int type)
     {
         if(type == CV_32F)
             h_mat.at<float>(i) = val;
-        if(type == CV_8U)
+        else
             h_mat.at<int>(i) = val;
     }
     levels_param.updateData(h_mat);
@@ -45,10 +89,29 @@ void HistogramRange::updateLevels(int type)
 
 bool Histogram::processImpl()
 {
+    if(binOnHost(*input, mask, host_max_pixels))
+    {
+        // Same layout as cv::cuda::histogram, one interleaved CV_32SC(N) row
+        cv::Mat in, h_mask, planar;
+        downloadInputs(*input, mask, in, h_mask, stream());
+        const bool is_8u = in.depth() == CV_8U;
+        if(!histogramHost(in, h_mask, is_8u ? 256 : 1000, is_8u ? 0.0f : min, is_8u ? 256.0f : max, planar))
+        {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to bin image of depth " << in.depth() << " over [" << min << ", " << max << ")";
+            return false;
+        }
+        cv::Mat hist = planar.t();
+        histogram_param.updateData(hist.reshape(in.channels(), 1), input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
+#ifdef HAVE_CUDA
     cv::cuda::GpuMat bins, hist;
     cv::cuda::histogram(input->getGpuMat(stream()), bins, hist, min, max, stream());
     histogram_param.updateData(hist, input_param.getTimestamp(), _ctx.get());
     return true;
+#else
+    return false;
+#endif
 }
 
 MO_REGISTER_CLASS(HistogramRange)
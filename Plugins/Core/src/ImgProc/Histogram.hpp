@@ -20,6 +20,9 @@ namespace nodes{
             PARAM(double, upper_bound, 1.0)
             PARAM(int, bins, 100)
             INPUT(SyncedMemory, input, nullptr)
+            OPTIONAL_INPUT(SyncedMemory, mask, nullptr)
+            PARAM(int, host_max_pixels, 1 << 16)
+            TOOLTIP(host_max_pixels, "Device images up to this many pixels are binned on the host where a kernel launch costs more than the download")
             OUTPUT(SyncedMemory, histogram, SyncedMemory())
             OUTPUT(SyncedMemory, levels, SyncedMemory())
         MO_END;
@@ -31,6 +34,9 @@ namespace nodes{
     public:
         MO_DERIVE(Histogram, Node)
             INPUT(SyncedMemory, input, nullptr)
+            OPTIONAL_INPUT(SyncedMemory, mask, nullptr)
+            PARAM(int, host_max_pixels, 1 << 16)
+            TOOLTIP(host_max_pixels, "Pixel count up to which device images are binned on the host")
             PARAM(float, min, 0)
             PARAM(float, max, 256)
             OUTPUT(SyncedMemory, histogram, {})
@@ -6,6 +6,26 @@
 using namespace aq::nodes;
 
 bool HistogramEqualization::processImpl() {
+    if (input->getSyncState() < aq::SyncedMemory::DEVICE_UPDATED) {
+        cv::Mat              output;
+        std::vector<cv::Mat> channels;
+        if (!per_channel) {
+            cv::Mat hsv;
+            cv::cvtColor(input->getMat(stream()), hsv, cv::COLOR_BGR2HSV);
+            cv::split(hsv, channels);
+            cv::equalizeHist(channels[2], channels[2]);
+            cv::merge(channels, hsv);
+            cv::cvtColor(hsv, output, cv::COLOR_HSV2BGR);
+        } else {
+            cv::split(input->getMat(stream()), channels);
+            for (int i = 0; i < channels.size(); ++i) {
+                cv::equalizeHist(channels[i], channels[i]);
+            }
+            cv::merge(channels, output);
+        }
+        output_param.updateData(output, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     cv::cuda::GpuMat              output;
     std::vector<cv::cuda::GpuMat> channels;
     if (!per_channel) {
@@ -34,6 +54,23 @@ bool HistogramEqualization::processImpl() {
 MO_REGISTER_CLASS(HistogramEqualization)
 
 bool CLAHE::processImpl() {
+    if (input->getSyncState() < aq::SyncedMemory::DEVICE_UPDATED) {
+        if (!_h_clahe || clip_limit_param.modified() || grid_size_param.modified()) {
+            _h_clahe = cv::createCLAHE(clip_limit, cv::Size(grid_size, grid_size));
+            clip_limit_param.modified(false);
+            grid_size_param.modified(false);
+        }
+        cv::Mat hsv;
+        cv::cvtColor(input->getMat(stream()), hsv, cv::COLOR_BGR2HSV);
+        std::vector<cv::Mat> channels;
+        cv::split(hsv, channels);
+        _h_clahe->apply(channels[2], channels[2]);
+        cv::Mat output;
+        cv::merge(channels, hsv);
+        cv::cvtColor(hsv, output, cv::COLOR_HSV2BGR);
+        output_param.updateData(output, mo::tag::_param = input_param, mo::tag::_context = _ctx.get());
+        return true;
+    }
     if (!_clahe || clip_limit_param.modified() || grid_size_param.modified()) {
         _clahe = cv::cuda::createCLAHE(clip_limit, cv::Size(grid_size, grid_size));
         clip_limit_param.modified(false);
@@ -2,6 +2,7 @@
 #include <Aquila/nodes/Node.hpp>
 #include <Aquila/types/SyncedMemory.hpp>
 #include <opencv2/cudaimgproc.hpp>
+#include <opencv2/imgproc.hpp>
 
 namespace aq
 {
@@ -30,6 +31,7 @@ namespace aq
         protected:
             bool processImpl();
             cv::Ptr<cv::cuda::CLAHE> _clahe;
+            cv::Ptr<cv::CLAHE> _h_clahe;
         };
     }
 }
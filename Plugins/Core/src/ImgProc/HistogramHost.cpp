@@ -0,0 +1,339 @@
+#include "HistogramHost.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+using namespace aq::nodes;
+
+namespace
+{
+    // Smaller images are binned on the calling thread, below this a band is not worth a task
+    const int MinBandPixels = 64 * 1024;
+    // Consecutive pixels are counted in different copies of the histogram so runs of equal values
+    // don't serialize on one counter
+    const int Copies = 4;
+
+    struct Binning
+    {
+        int          bins    = 0;
+        float        lower   = 0.0f;
+        float        upper   = 0.0f;
+        float        scale   = 0.0f;
+        // Explicit edges, bins + 1 values, or null for equal width bins
+        const float* edges   = nullptr;
+        bool         uniform = true;
+        // Bin of every 8 bit value
+        std::vector<int> lut;
+    };
+
+    // Values outside of [lower, upper) and NaN go to the overflow bin, bins
+    inline int uniformBin(float v, const Binning& b)
+    {
+        if(!(v >= b.lower && v < b.upper))
+            return b.bins;
+        return std::min(static_cast<int>((v - b.lower) * b.scale), b.bins - 1);
+    }
+
+    inline int searchBin(float v, const Binning& b)
+    {
+        if(!(v >= b.lower && v < b.upper))
+            return b.bins;
+        return static_cast<int>(std::upper_bound(b.edges, b.edges + b.bins + 1, v) - b.edges) - 1;
+    }
+
+#if CV_SIMD128
+    struct VectorBinning
+    {
+        explicit VectorBinning(const Binning& b):
+            lower(cv::v_setall_f32(b.lower)), upper(cv::v_setall_f32(b.upper)), scale(cv::v_setall_f32(b.scale)),
+            last(cv::v_setall_s32(b.bins - 1)), overflow(cv::v_setall_s32(b.bins))
+        {
+        }
+
+        inline cv::v_int32x4 operator()(const cv::v_float32x4& v) const
+        {
+            const cv::v_float32x4 valid = (v >= lower) & (v < upper);
+            const cv::v_int32x4   index = cv::v_min(cv::v_trunc((v - lower) * scale), last);
+            return cv::v_select(cv::v_reinterpret_as_s32(valid), index, overflow);
+        }
+
+        cv::v_float32x4 lower, upper, scale;
+        cv::v_int32x4   last, overflow;
+    };
+#endif
+
+    // Bin index of count values. Equal width bins are computed 4 values at a time, explicit edges are
+    // searched per value.
+    void binValues(const float* src, int count, const Binning& b, int* index)
+    {
+        int i = 0;
+        if(!b.uniform)
+        {
+            for(; i < count; ++i)
+                index[i] = searchBin(src[i], b);
+            return;
+        }
+#if CV_SIMD128
+        const VectorBinning vb(b);
+        for(; i <= count - 4; i += 4)
+            cv::v_store(index + i, vb(cv::v_load(src + i)));
+#endif
+        for(; i < count; ++i)
+            index[i] = uniformBin(src[i], b);
+    }
+
+    void binValues(const ushort* src, int count, const Binning& b, int* index)
+    {
+        int i = 0;
+        if(!b.uniform)
+        {
+            for(; i < count; ++i)
+                index[i] = searchBin(src[i], b);
+            return;
+        }
+#if CV_SIMD128
+        const VectorBinning vb(b);
+        for(; i <= count - 8; i += 8)
+        {
+            cv::v_uint32x4 lo, hi;
+            cv::v_expand(cv::v_load(src + i), lo, hi);
+            cv::v_store(index + i, vb(cv::v_cvt_f32(cv::v_reinterpret_as_s32(lo))));
+            cv::v_store(index + i + 4, vb(cv::v_cvt_f32(cv::v_reinterpret_as_s32(hi))));
+        }
+#endif
+        for(; i < count; ++i)
+            index[i] = uniformBin(src[i], b);
+    }
+
+    void binValues(const short* src, int count, const Binning& b, int* index)
+    {
+        int i = 0;
+        if(!b.uniform)
+        {
+            for(; i < count; ++i)
+                index[i] = searchBin(src[i], b);
+            return;
+        }
+#if CV_SIMD128
+        const VectorBinning vb(b);
+        for(; i <= count - 8; i += 8)
+        {
+            cv::v_int32x4 lo, hi;
+            cv::v_expand(cv::v_load(src + i), lo, hi);
+            cv::v_store(index + i, vb(cv::v_cvt_f32(lo)));
+            cv::v_store(index + i + 4, vb(cv::v_cvt_f32(hi)));
+        }
+#endif
+        for(; i < count; ++i)
+            index[i] = uniformBin(src[i], b);
+    }
+
+    // Counts one row, bin(i) is the bin of the i'th interleaved value
+    template<class BinOf>
+    inline void countRow(int* hist, int cols, int cn, int stride, const uchar* valid, const BinOf& bin)
+    {
+        for(int x = 0; x < cols; ++x)
+        {
+            if(valid && !valid[x])
+                continue;
+            int* h = hist + (x & (Copies - 1)) * cn * stride;
+            for(int c = 0; c < cn; ++c)
+                ++h[c * stride + bin(x * cn + c)];
+        }
+    }
+
+    // Bins one band of rows per invocation into that band's private histogram
+    class HistogramBody: public cv::ParallelLoopBody
+    {
+    public:
+        HistogramBody(const cv::Mat& image, const cv::Mat& mask, const Binning& binning, int num_bands,
+                      std::vector<std::vector<int>>& band_hists):
+            image(image), mask(mask), binning(binning), num_bands(num_bands), band_hists(band_hists)
+        {
+        }
+
+        void operator()(const cv::Range& range) const
+        {
+            const int cn     = image.channels();
+            const int count  = image.cols * cn;
+            const int stride = binning.bins + 1;
+            const int depth  = image.depth();
+            std::vector<int> index(depth == CV_8U ? 0 : count);
+            for(int band = range.start; band < range.end; ++band)
+            {
+                std::vector<int>& hist = band_hists[band];
+                hist.assign(static_cast<size_t>(Copies) * cn * stride, 0);
+                const int y0 = static_cast<int>(static_cast<int64_t>(image.rows) * band / num_bands);
+                const int y1 = static_cast<int>(static_cast<int64_t>(image.rows) * (band + 1) / num_bands);
+                for(int y = y0; y < y1; ++y)
+                {
+                    const uchar* valid = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+                    if(depth == CV_8U)
+                    {
+                        const uchar* src = image.ptr<uchar>(y);
+                        const int*   lut = binning.lut.data();
+                        countRow(hist.data(), image.cols, cn, stride, valid, [src, lut](int i) { return lut[src[i]]; });
+                        continue;
+                    }
+                    if(depth == CV_16U)
+                        binValues(image.ptr<ushort>(y), count, binning, index.data());
+                    else if(depth == CV_16S)
+                        binValues(image.ptr<short>(y), count, binning, index.data());
+                    else
+                        binValues(image.ptr<float>(y), count, binning, index.data());
+                    const int* idx = index.data();
+                    countRow(hist.data(), image.cols, cn, stride, valid, [idx](int i) { return idx[i]; });
+                }
+            }
+        }
+
+    private:
+        const cv::Mat& image;
+        const cv::Mat& mask;
+        const Binning& binning;
+        int num_bands;
+        std::vector<std::vector<int>>& band_hists;
+    };
+
+    bool computeHistogram(const cv::Mat& image, const cv::Mat& mask, Binning& binning, cv::Mat& hist)
+    {
+        const int depth = image.depth();
+        if(depth != CV_8U && depth != CV_16U && depth != CV_16S && depth != CV_32F)
+            return false;
+        if(!mask.empty() && (mask.type() != CV_8UC1 || mask.size() != image.size()))
+            return false;
+        if(depth == CV_8U)
+        {
+            binning.lut.resize(256);
+            for(int v = 0; v < 256; ++v)
+                binning.lut[v] = binning.edges ? searchBin(float(v), binning) : uniformBin(float(v), binning);
+        }
+
+        const int cn        = image.channels();
+        const int stride    = binning.bins + 1;
+        const int num_bands = std::max(1, std::min(std::min(cv::getNumThreads(), image.rows),
+                                                   static_cast<int>(image.total() / MinBandPixels)));
+        std::vector<std::vector<int>> band_hists(num_bands);
+        HistogramBody body(image, mask, binning, num_bands, band_hists);
+        if(num_bands == 1)
+            body(cv::Range(0, 1));
+        else
+            cv::parallel_for_(cv::Range(0, num_bands), body, num_bands);
+
+        hist.create(cn, binning.bins, CV_32S);
+        hist.setTo(cv::Scalar::all(0));
+        for(const auto& band : band_hists)
+        {
+            for(int copy = 0; copy < Copies; ++copy)
+            {
+                for(int c = 0; c < cn; ++c)
+                {
+                    const int* src = band.data() + (copy * cn + c) * stride;
+                    int*       dst = hist.ptr<int>(c);
+                    for(int i = 0; i < binning.bins; ++i)
+                        dst[i] += src[i];
+                }
+            }
+        }
+        return true;
+    }
+}
+
+bool aq::nodes::histogramHost(const cv::Mat& image, const cv::Mat& mask, int bins, float lower, float upper, cv::Mat& hist)
+{
+    if(bins <= 0 || !(upper > lower))
+        return false;
+    Binning binning;
+    binning.bins  = bins;
+    binning.lower = lower;
+    binning.upper = upper;
+    binning.scale = bins / (upper - lower);
+    return computeHistogram(image, mask, binning, hist);
+}
+
+bool aq::nodes::histogramHost(const cv::Mat& image, const cv::Mat& mask, const cv::Mat& edges, cv::Mat& hist)
+{
+    if(edges.total() < 2 || edges.channels() != 1 || (edges.depth() != CV_32S && edges.depth() != CV_32F))
+        return false;
+    cv::Mat e;
+    edges.reshape(1, 1).convertTo(e, CV_32F);
+    const float* edge = e.ptr<float>();
+    Binning binning;
+    binning.bins  = e.cols - 1;
+    binning.lower = edge[0];
+    binning.upper = edge[binning.bins];
+    binning.scale = binning.bins / (binning.upper - binning.lower);
+    binning.edges = edge;
+    const float width = (binning.upper - binning.lower) / binning.bins;
+    for(int i = 0; i < binning.bins; ++i)
+    {
+        if(!(edge[i + 1] > edge[i]))
+            return false;
+        if(std::abs(edge[i] - (binning.lower + i * width)) > width * 1e-4f)
+            binning.uniform = false;
+    }
+    return computeHistogram(image, mask, binning, hist);
+}
+
+std::vector<int> aq::nodes::otsuThresholds(const cv::Mat& hist, int levels)
+{
+    std::vector<int> thresholds;
+    if(hist.empty() || hist.channels() != 1)
+        return thresholds;
+    cv::Mat h;
+    hist.row(0).convertTo(h, CV_64F);
+    const int n = h.cols;
+    levels = std::min(std::max(levels, 2), n);
+    if(levels < 2)
+        return thresholds;
+
+    // The between class variance is, up to constants, the sum over classes of S^2 / P with P the
+    // class count and S the class sum of bin indices
+    std::vector<double> P(n + 1, 0.0), S(n + 1, 0.0);
+    const double* counts = h.ptr<double>();
+    for(int i = 0; i < n; ++i)
+    {
+        P[i + 1] = P[i] + counts[i];
+        S[i + 1] = S[i] + counts[i] * i;
+    }
+    auto score = [&P, &S](int i, int j) {
+        const double p = P[j] - P[i];
+        const double s = S[j] - S[i];
+        return p > 0.0 ? s * s / p : 0.0;
+    };
+
+    // best[j]: best score of bins [0, j) split into k + 1 classes, split[k][j] the start of the last class
+    const double lowest = -std::numeric_limits<double>::max();
+    std::vector<double> best(n + 1, lowest), next(n + 1);
+    std::vector<std::vector<int>> split(levels, std::vector<int>(n + 1, 0));
+    for(int j = 1; j <= n; ++j)
+        best[j] = score(0, j);
+    for(int k = 1; k < levels; ++k)
+    {
+        std::fill(next.begin(), next.end(), lowest);
+        for(int j = k + 1; j <= n; ++j)
+        {
+            for(int i = k; i < j; ++i)
+            {
+                const double value = best[i] + score(i, j);
+                if(value > next[j])
+                {
+                    next[j]     = value;
+                    split[k][j] = i;
+                }
+            }
+        }
+        best.swap(next);
+    }
+    thresholds.resize(levels - 1);
+    int j = n;
+    for(int k = levels - 1; k > 0; --k)
+    {
+        j = split[k][j];
+        thresholds[k - 1] = j;
+    }
+    return thresholds;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "CoreExport.hpp"
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace aq
+{
+    namespace nodes
+    {
+        // Per channel histograms of a CV_8U, CV_16U, CV_16S or CV_32F image on the host. Bands of rows
+        // are binned into private histograms on the OpenCV thread pool and summed, small images run on
+        // the calling thread. hist receives a channels x bins CV_32S matrix. Values outside of the bins
+        // and pixels where mask is zero are not counted, mask is empty or CV_8UC1 of the image size.
+        // Returns false for unsupported image or mask types.
+
+        // bins of equal width over [lower, upper)
+        Core_EXPORT bool histogramHost(const cv::Mat& image, const cv::Mat& mask, int bins, float lower, float upper,
+                                       cv::Mat& hist);
+        // Explicit bin edges, a row of bins + 1 increasing CV_32S or CV_32F values. v is counted in bin i
+        // if edges[i] <= v < edges[i + 1]. Equally spaced edges use the vectorized path.
+        Core_EXPORT bool histogramHost(const cv::Mat& image, const cv::Mat& mask, const cv::Mat& edges, cv::Mat& hist);
+
+        // Multi level Otsu: the levels - 1 bin indices splitting a histogram row into levels classes with
+        // the largest between class variance, class k holding bins [t[k - 1], t[k]). Solved by dynamic
+        // programming in O(levels * bins^2), levels = 2 is the classic Otsu threshold.
+        Core_EXPORT std::vector<int> otsuThresholds(const cv::Mat& hist, int levels = 2);
+    }
+}
@@ -1,12 +1,18 @@
 #include "NonMaxSuppression.h"
-
-
+#include <opencv2/core/hal/intrin.hpp>
+#include <limits>
 
 using namespace aq;
 using namespace aq::nodes;
 bool MinMax::processImpl()
 {
-    cv::cuda::minMax(input->getGpuMat(stream()), &min_value, &max_value);
+    if(input->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+    {
+        cv::minMaxLoc(input->getMat(stream()).reshape(1), &min_value, &max_value);
+    }else
+    {
+        cv::cuda::minMax(input->getGpuMat(stream()), &min_value, &max_value);
+    }
     min_value_param.emitUpdate(input_param.getTimestamp(), _ctx.get());
     max_value_param.emitUpdate(input_param.getTimestamp(), _ctx.get());
     return true;
@@ -19,6 +25,45 @@ bool Threshold::processImpl()
         max_param.updateData(*input_max * input_percent);
     if(input_min)
         min_param.updateData(*input_min * input_percent);
+    if(input->getSyncState() < SyncedMemory::DEVICE_UPDATED)
+    {
+        const cv::Mat& in = input->getMat(stream());
+        cv::Mat upper_mask, lower_mask;
+        if(two_sided)
+        {
+            if(source_value)
+            {
+                cv::threshold(in, upper_mask, max, replace_value, inverse? 3 : 4);
+            }else
+            {
+                cv::threshold(in, upper_mask, max, replace_value, inverse ? 1 : 0);
+            }
+        }
+        if(truncate)
+        {
+            cv::threshold(in, lower_mask, min, replace_value, 2);
+        }else
+        {
+            if(source_value)
+            {
+                cv::threshold(in, lower_mask, min, 0.0, inverse? 4 : 3);
+            }else
+            {
+                cv::threshold(in, lower_mask, min, replace_value, inverse? 1: 0);
+            }
+        }
+        cv::Mat mask;
+        if(upper_mask.empty())
+        {
+            mask = lower_mask;
+        }else
+        {
+            cv::bitwise_and(upper_mask, lower_mask, mask);
+        }
+        mask.convertTo(mask, input->getType());
+        mask_param.updateData(mask, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     cv::cuda::GpuMat upper_mask, lower_mask;
     if(two_sided)
     {
@@ -58,64 +103,148 @@ bool Threshold::processImpl()
 }
 
 
-/*cv::cuda::GpuMat NonMaxSuppression::doProcess(cv::cuda::GpuMat &img, cv::cuda::Stream& stream)
+namespace
 {
-    // initialise the block mask and destination
-    const int M = img.rows;
-    const int N = img.cols;
-    cv::Mat src(img);
-    int sz = *getParameter<int>("Size")->Data();
-
-    cv::Mat mask;
-    if(auto maskParam = getParameter<cv::cuda::GpuMat>(1)->Data())
-        if(!maskParam->empty())
-            maskParam->download(mask, stream);
-    stream.waitForCompletion();
-    const bool masked = !mask.empty();
-    cv::Mat block = 255*cv::Mat_<uint8_t>::ones(cv::Size(2*sz+1,2*sz+1));
-    cv::Mat dst = cv::Mat_<uint8_t>::zeros(src.size());
-
-    // iterate over image blocks
-    for (int m = 0; m < M; m+=sz+1) {
-        for (int n = 0; n < N; n+=sz+1) {
-            cv::Point  ijmax;
-            double vcmax, vnmax;
-
-            // get the maximal candidate within the block
-            cv::Range ic(m, cv::min(m+sz+1,M));
-            cv::Range jc(n, cv::min(n+sz+1,N));
-
-            cv::minMaxLoc(src(ic,jc), NULL, &vcmax, NULL, &ijmax, masked ? mask(ic,jc) : cv::noArray());
-
-
-            cv::Point cc = ijmax + cv::Point(jc.start,ic.start);
-
-            // search the neighbours centered around the candidate for the true maxima
-            cv::Range in(cv::max(cc.y-sz,0), cv::min(cc.y+sz+1,M));
-            cv::Range jn(cv::max(cc.x-sz,0), cv::min(cc.x+sz+1,N));
+    // out[x] = max over the n rows of rows[i][x]
+    void maxRows(const float* const* rows, int n, float* out, int width)
+    {
+        int x = 0;
+#if CV_SIMD128
+        for(; x <= width - 4; x += 4)
+        {
+            cv::v_float32x4 v = cv::v_load(rows[0] + x);
+            for(int i = 1; i < n; ++i)
+                v = cv::v_max(v, cv::v_load(rows[i] + x));
+            cv::v_store(out + x, v);
+        }
+#endif
+        for(; x < width; ++x)
+        {
+            float v = rows[0][x];
+            for(int i = 1; i < n; ++i)
+                v = std::max(v, rows[i][x]);
+            out[x] = v;
+        }
+    }
 
-            // mask out the block whose maxima we already know
-            cv::Mat_<uint8_t> blockmask;
-            block(cv::Range(0,in.size()), cv::Range(0,jn.size())).copyTo(blockmask);
-            cv::Range iis(ic.start-in.start, cv::min(ic.start-in.start+sz+1, in.size()));
-            cv::Range jis(jc.start-jn.start, cv::min(jc.start-jn.start+sz+1, jn.size()));
-            blockmask(iis, jis) = cv::Mat_<uint8_t>::zeros(cv::Size(jis.size(),iis.size()));
+    // out[x] = max(in[x - r], ..., in[x + r]), in must be readable from -r to width + r
+    void maxCols(const float* in, float* out, int width, int r)
+    {
+        int x = 0;
+#if CV_SIMD128
+        for(; x <= width - 4; x += 4)
+        {
+            cv::v_float32x4 v = cv::v_load(in + x - r);
+            for(int k = -r + 1; k <= r; ++k)
+                v = cv::v_max(v, cv::v_load(in + x + k));
+            cv::v_store(out + x, v);
+        }
+#endif
+        for(; x < width; ++x)
+        {
+            float v = in[x - r];
+            for(int k = -r + 1; k <= r; ++k)
+                v = std::max(v, in[x + k]);
+            out[x] = v;
+        }
+    }
 
-            cv::minMaxLoc(src(in,jn), NULL, &vnmax, NULL, &ijmax, masked ? mask(in,jn).mul(blockmask) : blockmask);
-            //cv::Point cn = ijmax + cv::Point(jn.start, in.start);
+    // Separable max filter followed by the peak test, one band of rows per invocation
+    class NonMaxSuppressionBody: public cv::ParallelLoopBody
+    {
+    public:
+        NonMaxSuppressionBody(const cv::Mat& src, const cv::Mat& mask, cv::Mat& dst, int radius, float threshold,
+                              int num_bands, std::vector<std::vector<cv::KeyPoint>>& keypoints):
+            src(src), mask(mask), dst(dst), radius(radius), threshold(threshold), num_bands(num_bands), keypoints(keypoints)
+        {
+        }
 
-            // if the block centre is also the neighbour centre, then it's a local maxima
-            if (vcmax > vnmax) {
-                dst.at<uint8_t>(cc.y, cc.x) = 255;
+        void operator()(const cv::Range& range) const
+        {
+            const int width = src.cols;
+            std::vector<float> padded(width + 2 * radius, -std::numeric_limits<float>::max());
+            std::vector<float> local_max(width);
+            std::vector<const float*> rows(2 * radius + 1);
+            for(int band = range.start; band < range.end; ++band)
+            {
+                const int y0 = src.rows * band / num_bands;
+                const int y1 = src.rows * (band + 1) / num_bands;
+                std::vector<cv::KeyPoint>& band_keypoints = keypoints[band];
+                for(int y = y0; y < y1; ++y)
+                {
+                    int n = 0;
+                    for(int i = std::max(y - radius, 0); i <= std::min(y + radius, src.rows - 1); ++i)
+                        rows[n++] = src.ptr<float>(i);
+                    maxRows(rows.data(), n, padded.data() + radius, width);
+                    maxCols(padded.data() + radius, local_max.data(), width, radius);
+
+                    const float* value = src.ptr<float>(y);
+                    const uchar* valid = mask.empty() ? nullptr : mask.ptr<uchar>(y);
+                    uchar* out = dst.ptr<uchar>(y);
+                    for(int x = 0; x < width; ++x)
+                    {
+                        if(value[x] >= local_max[x] && value[x] > threshold && (!valid || valid[x]))
+                        {
+                            out[x] = 255;
+                            band_keypoints.emplace_back(cv::Point2f(float(x), float(y)), float(2 * radius + 1), -1.0f, value[x]);
+                        }else
+                        {
+                            out[x] = 0;
+                        }
+                    }
+                }
             }
         }
+
+    private:
+        const cv::Mat& src;
+        const cv::Mat& mask;
+        cv::Mat& dst;
+        int radius;
+        float threshold;
+        int num_bands;
+        std::vector<std::vector<cv::KeyPoint>>& keypoints;
+    };
+}
+
+bool NonMaxSuppression::processImpl()
+{
+    if(input->getChannels() != 1)
+    {
+        MO_LOG_EVERY_N(warning, 100) << "NonMaxSuppression expects a single channel input, got " << input->getChannels();
+        return false;
+    }
+    const bool on_device = input->getSyncState() >= SyncedMemory::DEVICE_UPDATED ||
+                           (mask && mask->getSyncState() >= SyncedMemory::DEVICE_UPDATED);
+    cv::Mat src = input->getMat(stream());
+    cv::Mat h_mask;
+    if(mask)
+        h_mask = mask->getMat(stream());
+    if(on_device)
+        stream().waitForCompletion();
+    if(src.depth() != CV_32F)
+        src.convertTo(src, CV_32F);
+    if(!h_mask.empty() && (h_mask.size() != src.size() || h_mask.type() != CV_8UC1))
+    {
+        MO_LOG_EVERY_N(warning, 100) << "NonMaxSuppression mask must be CV_8UC1 with the same size as the input";
+        return false;
     }
-    cv::cuda::GpuMat maxMask;
-    maxMask.upload(dst, stream);
-    updateParameter("Output Mask", maxMask);
-    return maxMask;
-}*/
+    const int radius = std::max(size, 0);
+    cv::Mat dst(src.size(), CV_8UC1);
+    // Bands of at least 32 rows keep the (2 * radius) rows of overlap per band cheap
+    const int num_bands = std::max(1, std::min(cv::getNumThreads() * 2, src.rows / 32));
+    std::vector<std::vector<cv::KeyPoint>> band_keypoints(num_bands);
+    cv::parallel_for_(cv::Range(0, num_bands),
+                      NonMaxSuppressionBody(src, h_mask, dst, radius, static_cast<float>(threshold), num_bands, band_keypoints),
+                      num_bands);
+    std::vector<cv::KeyPoint> points;
+    for(const auto& band : band_keypoints)
+        points.insert(points.end(), band.begin(), band.end());
+    suppressed_output_param.updateData(dst, input_param.getTimestamp(), _ctx.get());
+    keypoints_param.updateData(points, input_param.getTimestamp(), _ctx.get());
+    return true;
+}
 
-//MO_REGISTER_CLASS(NonMaxSuppression, Image, Processing)
+MO_REGISTER_CLASS(NonMaxSuppression)
 MO_REGISTER_CLASS(MinMax)
 MO_REGISTER_CLASS(Threshold)
@@ -41,15 +41,21 @@ namespace aq
             bool processImpl();
         };
 
+        // Marks pixels that are the maximum of the (2 * size + 1)^2 window centered on them
+        // and above threshold. Pixels on a plateau at the window maximum are all kept.
         class NonMaxSuppression: public Node
         {
         public:
             MO_DERIVE(NonMaxSuppression, Node)
                 PARAM(int, size, 5);
+                PARAM(double, threshold, 0.0);
                 INPUT(SyncedMemory, input, nullptr);
-                INPUT(SyncedMemory, mask, nullptr);
+                OPTIONAL_INPUT(SyncedMemory, mask, nullptr);
                 OUTPUT(SyncedMemory, suppressed_output, SyncedMemory());
+                OUTPUT(std::vector<cv::KeyPoint>, keypoints, {});
             MO_END;
+        protected:
+            bool processImpl();
         };
     }
 }
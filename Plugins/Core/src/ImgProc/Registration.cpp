@@ -1,6 +1,8 @@
 
 #include "Registration.h"
+#ifdef HAVE_CUDA
 #include <thrust/transform.h>
+#endif
 #include <opencv2/core/cuda_stream_accessor.hpp>
 
 
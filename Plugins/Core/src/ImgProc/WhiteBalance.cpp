@@ -10,12 +10,17 @@ using namespace cv;
 
 bool WhiteBalance::processImpl()
 {
+#ifdef HAVE_CUDA
     cv::cuda::GpuMat output;
     auto lower = cv::Scalar(lower_blue, lower_green, lower_red);
     auto upper = cv::Scalar(upper_blue, upper_green, upper_red);
     applyWhiteBalance(input->getGpuMat(stream()),
                       output, lower, upper, rois, weight, dtype, stream());
     output_param.updateData(output, input_param.getTimestamp(), _ctx.get());
+#else
+    MO_LOG_EVERY_N(warning, 100) << "WhiteBalance requires a CUDA build, use StaticWhiteBalance instead";
+    return false;
+#endif
     /*const cv::Mat& in = input->getMat(stream());
     cv::Mat out;
     stream().waitForCompletion();
@@ -95,6 +100,22 @@ MO_REGISTER_CLASS(WhiteBalance)
 
 bool StaticWhiteBalance::processImpl()
 {
+    if(input->getSyncState() < aq::SyncedMemory::DEVICE_UPDATED)
+    {
+        std::vector<cv::Mat> channels;
+        cv::split(input->getMat(stream()), channels);
+        for(int i = 0; i < 3; ++i)
+        {
+            // Clamp to [low, high] then stretch, equivalent to the trunc / setTo sequence below
+            cv::min(channels[i], high[i], channels[i]);
+            cv::max(channels[i], low[i], channels[i]);
+            cv::normalize(channels[i], channels[i], min, max, cv::NORM_MINMAX, dtype);
+        }
+        cv::Mat output;
+        cv::merge(channels, output);
+        output_param.updateData(output, input_param.getTimestamp(), _ctx.get());
+        return true;
+    }
     const cv::cuda::GpuMat& in = input->getGpuMat(stream());
     std::vector<cv::cuda::GpuMat> channels;
     cv::cuda::split(in, channels, stream());
@@ -116,6 +137,10 @@ MO_REGISTER_CLASS(StaticWhiteBalance)
 
 bool WhiteBalanceMean::processImpl()
 {
+#ifndef HAVE_CUDA
+    MO_LOG_EVERY_N(warning, 100) << "WhiteBalanceMean requires a CUDA build";
+    return false;
+#else
     const cv::cuda::GpuMat& in = input->getGpuMat(stream());
     std::vector<cv::cuda::GpuMat> channels;
     channels.resize(in.channels());
@@ -181,6 +206,7 @@ bool WhiteBalanceMean::processImpl()
     //cv::cuda::multiply(in, gain, output, 1, -1, stream());
     output_param.updateData(output, input_param.getTimestamp(), _ctx.get());
     return true;
+#endif
 }
 
 MO_REGISTER_CLASS(WhiteBalanceMean);
@@ -1,6 +1,8 @@
 #include "Cuda.h"
+#ifdef HAVE_CUDA
 #include <cuda.h>
 #include <cuda_runtime_api.h>
+#endif
 
 
 
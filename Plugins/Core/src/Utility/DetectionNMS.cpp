@@ -0,0 +1,325 @@
+#include "DetectionNMS.hpp"
+#include <Aquila/nodes/NodeInfo.hpp>
+#include "MetaObject/params/detail/TInputParamPtrImpl.hpp"
+#include "MetaObject/params/detail/TParamPtrImpl.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace
+{
+    // Uniform grid over the boxes' extent with cells about the size of an average box,
+    // each box is listed in every cell it covers
+    class BoxGrid
+    {
+    public:
+        explicit BoxGrid(const std::vector<cv::Rect2f>& boxes):
+            _boxes(boxes)
+        {
+            if(boxes.empty())
+                return;
+            float min_x = boxes[0].x, min_y = boxes[0].y, max_x = boxes[0].br().x, max_y = boxes[0].br().y;
+            double mean_size = 0.0;
+            for(const auto& box : boxes)
+            {
+                min_x = std::min(min_x, box.x);
+                min_y = std::min(min_y, box.y);
+                max_x = std::max(max_x, box.br().x);
+                max_y = std::max(max_y, box.br().y);
+                mean_size += std::max(box.width, box.height);
+            }
+            mean_size /= boxes.size();
+            const float cell = std::max(static_cast<float>(mean_size), 1e-3f);
+            _origin = cv::Point2f(min_x, min_y);
+            _cols = std::min(static_cast<int>((max_x - min_x) / cell) + 1, 256);
+            _rows = std::min(static_cast<int>((max_y - min_y) / cell) + 1, 256);
+            _cell_w = std::max((max_x - min_x) / _cols, 1e-3f);
+            _cell_h = std::max((max_y - min_y) / _rows, 1e-3f);
+
+            // Compressed row storage: count, prefix sum, fill
+            _offsets.assign(_cols * _rows + 1, 0);
+            for(const auto& box : boxes)
+                forEachCell(box, [this](int cell_idx) { ++_offsets[cell_idx + 1]; });
+            for(size_t i = 1; i < _offsets.size(); ++i)
+                _offsets[i] += _offsets[i - 1];
+            _indices.resize(_offsets.back());
+            std::vector<int> fill(_offsets.begin(), _offsets.end() - 1);
+            for(int i = 0; i < static_cast<int>(boxes.size()); ++i)
+                forEachCell(boxes[i], [&](int cell_idx) { _indices[fill[cell_idx]++] = i; });
+            _stamp.assign(boxes.size(), -1);
+        }
+
+        // Calls f(j) once for every box j sharing a cell with box i
+        template<class F>
+        void forEachNeighbour(int i, const F& f)
+        {
+            forEachCell(_boxes[i], [&](int cell_idx) {
+                for(int k = _offsets[cell_idx]; k < _offsets[cell_idx + 1]; ++k)
+                {
+                    const int j = _indices[k];
+                    if(j != i && _stamp[j] != i)
+                    {
+                        _stamp[j] = i;
+                        f(j);
+                    }
+                }
+            });
+        }
+
+    private:
+        template<class F>
+        void forEachCell(const cv::Rect2f& box, const F& f) const
+        {
+            const int x0 = clampCol(static_cast<int>((box.x - _origin.x) / _cell_w));
+            const int x1 = clampCol(static_cast<int>((box.br().x - _origin.x) / _cell_w));
+            const int y0 = clampRow(static_cast<int>((box.y - _origin.y) / _cell_h));
+            const int y1 = clampRow(static_cast<int>((box.br().y - _origin.y) / _cell_h));
+            for(int y = y0; y <= y1; ++y)
+                for(int x = x0; x <= x1; ++x)
+                    f(y * _cols + x);
+        }
+        int clampCol(int x) const { return std::max(0, std::min(x, _cols - 1)); }
+        int clampRow(int y) const { return std::max(0, std::min(y, _rows - 1)); }
+
+        const std::vector<cv::Rect2f>& _boxes;
+        cv::Point2f _origin;
+        float _cell_w = 1.0f;
+        float _cell_h = 1.0f;
+        int _cols = 0;
+        int _rows = 0;
+        std::vector<int> _offsets;
+        std::vector<int> _indices;
+        std::vector<int> _stamp;
+    };
+
+    float overlap(const cv::Rect2f& a, const cv::Rect2f& b, bool over_min)
+    {
+        const float inter = (a & b).area();
+        if(inter <= 0.0f)
+            return 0.0f;
+        const float denom = over_min ? std::min(a.area(), b.area()) : a.area() + b.area() - inter;
+        return denom > 0.0f ? inter / denom : 0.0f;
+    }
+}
+
+std::vector<int> aq::nodes::suppressBoxes(const std::vector<cv::Rect2f>& boxes,
+                                          std::vector<float>&            scores,
+                                          const std::vector<int>&        labels,
+                                          const std::vector<int>&        tiles,
+                                          const BoxSuppressionParams&    params,
+                                          std::vector<int>*              suppressed_by)
+{
+    const int n = static_cast<int>(boxes.size());
+    std::vector<int> kept;
+    std::vector<int> by(n, -1);
+    std::vector<char> done(n, 0);
+    BoxGrid grid(boxes);
+
+    // Overlap of j with the selected box i and the threshold it is compared against, or a
+    // negative overlap if the two boxes never interact
+    auto compare = [&](int i, int j, float& threshold) -> float {
+        if(!labels.empty() && labels[i] != labels[j])
+            return -1.0f;
+        const bool cross_tile = !tiles.empty() && tiles[i] != tiles[j];
+        threshold = cross_tile ? params.cross_tile_threshold : params.iou_threshold;
+        return overlap(boxes[i], boxes[j], cross_tile);
+    };
+
+    if(params.method == HardNMS)
+    {
+        std::vector<int> order(n);
+        for(int i = 0; i < n; ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&scores](int a, int b) { return scores[a] > scores[b]; });
+        for(int i : order)
+        {
+            if(done[i])
+                continue;
+            done[i] = 1;
+            kept.push_back(i);
+            grid.forEachNeighbour(i, [&](int j) {
+                float threshold = 0.0f;
+                if(!done[j] && compare(i, j, threshold) > threshold)
+                {
+                    done[j] = 1;
+                    by[j] = i;
+                }
+            });
+        }
+    }else
+    {
+        // Max heap with lazy deletion, entries whose score no longer matches are stale
+        typedef std::pair<float, int> Entry_t;
+        std::priority_queue<Entry_t> heap;
+        // Boxes that start below the threshold are dropped like the ones that decay below it
+        for(int i = 0; i < n; ++i)
+        {
+            if(scores[i] < params.score_threshold)
+                done[i] = 1;
+            else
+                heap.emplace(scores[i], i);
+        }
+        while(!heap.empty())
+        {
+            const Entry_t top = heap.top();
+            heap.pop();
+            const int i = top.second;
+            if(done[i] || top.first != scores[i])
+                continue;
+            done[i] = 1;
+            kept.push_back(i);
+            grid.forEachNeighbour(i, [&](int j) {
+                float threshold = 0.0f;
+                const float o = done[j] ? -1.0f : compare(i, j, threshold);
+                if(o <= 0.0f)
+                    return;
+                if(params.method == LinearSoftNMS)
+                {
+                    if(o <= threshold)
+                        return;
+                    scores[j] *= 1.0f - o;
+                }else
+                {
+                    scores[j] *= std::exp(-o * o / params.sigma);
+                }
+                by[j] = i;
+                if(scores[j] < params.score_threshold)
+                    done[j] = 1;
+                else
+                    heap.emplace(scores[j], j);
+            });
+        }
+    }
+    // Soft NMS records the last box that decayed each box, survivors were not suppressed
+    for(int i : kept)
+        by[i] = -1;
+    if(suppressed_by)
+        suppressed_by->swap(by);
+    return kept;
+}
+
+BoxSuppressionParams DetectionNMS::suppressionParams() const
+{
+    BoxSuppressionParams params;
+    params.method = static_cast<SuppressionMethod>(method.getValue());
+    params.iou_threshold = iou_threshold;
+    params.sigma = std::max(sigma, 1e-6f);
+    params.score_threshold = score_threshold;
+    return params;
+}
+
+bool DetectionNMS::processImpl()
+{
+    const std::vector<DetectedObject>& detections = *input;
+    std::vector<cv::Rect2f> boxes;
+    std::vector<float> scores;
+    std::vector<int> labels;
+    boxes.reserve(detections.size());
+    scores.reserve(detections.size());
+    for(const auto& det : detections)
+    {
+        boxes.push_back(det.bounding_box);
+        scores.push_back(det.classification.confidence);
+        if(class_aware)
+            labels.push_back(det.classification.classNumber);
+    }
+    std::vector<int> kept = suppressBoxes(boxes, scores, labels, std::vector<int>(), suppressionParams());
+    std::vector<DetectedObject> out;
+    out.reserve(kept.size());
+    for(int i : kept)
+    {
+        out.push_back(detections[i]);
+        out.back().classification.confidence = scores[i];
+    }
+    output_param.updateData(out, mo::tag::_param = input_param, _ctx.get());
+    return true;
+}
+
+void aq::nodes::mergeTiledDetections(std::vector<DetectedObject>& detections,
+                                     const std::vector<int>&      tiles,
+                                     const BoxSuppressionParams&  params,
+                                     bool                         class_aware,
+                                     bool                         merge_boxes)
+{
+    const size_t n = detections.size();
+    std::vector<cv::Rect2f> boxes(n);
+    std::vector<float> scores(n);
+    std::vector<int> labels;
+    for(size_t i = 0; i < n; ++i)
+    {
+        boxes[i] = detections[i].bounding_box;
+        scores[i] = detections[i].classification.confidence;
+        if(class_aware)
+            labels.push_back(detections[i].classification.classNumber);
+    }
+
+    std::vector<int> suppressed_by;
+    std::vector<int> kept = suppressBoxes(boxes, scores, labels, tiles, params, &suppressed_by);
+
+    if(merge_boxes && !tiles.empty())
+    {
+        // A box cut by a tile border is grown back by the pieces found in neighbouring tiles
+        std::vector<cv::Rect2f> merged = boxes;
+        for(size_t j = 0; j < n; ++j)
+        {
+            const int i = suppressed_by[j];
+            if(i >= 0 && tiles[i] != tiles[j])
+                merged[i] |= boxes[j];
+        }
+        boxes.swap(merged);
+    }
+
+    std::vector<DetectedObject> out;
+    out.reserve(kept.size());
+    for(int i : kept)
+    {
+        out.push_back(detections[i]);
+        out.back().bounding_box = boxes[i];
+        out.back().classification.confidence = scores[i];
+    }
+    detections.swap(out);
+}
+
+bool TiledDetectionNMS::processImpl()
+{
+    if(bounding_boxes == nullptr || bounding_boxes->empty())
+        return DetectionNMS::processImpl();
+
+    // Tiles are normalized to the image the same way INeuralNet interprets bounding_boxes
+    auto shape = image->getShape();
+    std::vector<cv::Rect2f> tile_rects;
+    for(const auto& roi : *bounding_boxes)
+    {
+        tile_rects.emplace_back(roi.x * shape[2], roi.y * shape[1], roi.width * shape[2], roi.height * shape[1]);
+    }
+
+    std::vector<DetectedObject> detections = *input;
+    std::vector<int> tiles(detections.size(), 0);
+    for(size_t i = 0; i < detections.size(); ++i)
+    {
+        // A box belongs to the tile that contains most of it
+        float best = -1.0f;
+        for(size_t t = 0; t < tile_rects.size(); ++t)
+        {
+            const float area = (detections[i].bounding_box & tile_rects[t]).area();
+            if(area > best)
+            {
+                best = area;
+                tiles[i] = static_cast<int>(t);
+            }
+        }
+    }
+
+    BoxSuppressionParams params = suppressionParams();
+    params.cross_tile_threshold = cross_tile_threshold;
+    mergeTiledDetections(detections, tiles, params, class_aware, merge_boxes);
+    output_param.updateData(detections, mo::tag::_param = input_param, _ctx.get());
+    return true;
+}
+
+MO_REGISTER_CLASS(DetectionNMS)
+MO_REGISTER_CLASS(TiledDetectionNMS)
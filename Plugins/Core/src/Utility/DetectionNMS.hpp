@@ -0,0 +1,84 @@
+#pragma once
+#include "CoreExport.hpp"
+#include <Aquila/nodes/Node.hpp>
+#include <Aquila/types/ObjectDetection.hpp>
+#include <Aquila/types/SyncedMemory.hpp>
+
+namespace aq
+{
+    namespace nodes
+    {
+        enum SuppressionMethod
+        {
+            HardNMS,
+            LinearSoftNMS,  // score *= 1 - iou for iou above the threshold
+            GaussianSoftNMS // score *= exp(-iou^2 / sigma)
+        };
+
+        struct Core_EXPORT BoxSuppressionParams
+        {
+            SuppressionMethod method          = HardNMS;
+            float             iou_threshold   = 0.5f;
+            float             sigma           = 0.5f;
+            // Soft NMS drops boxes once their score decays below this
+            float             score_threshold = 0.001f;
+            // Boxes from different tiles are compared by intersection over the smaller box since
+            // a tile border truncates one of them
+            float             cross_tile_threshold = 0.5f;
+        };
+
+        // Greedy NMS / soft NMS using a uniform grid to find overlapping candidates.
+        // labels restricts suppression to boxes with the same label and tiles marks which tile each
+        // box came from, either may be empty. On return scores hold the decayed scores and
+        // suppressed_by[i] is the box that suppressed i, or -1 if i was kept.
+        // Returns the kept indices in the order they were selected.
+        Core_EXPORT std::vector<int> suppressBoxes(const std::vector<cv::Rect2f>& boxes,
+                                                   std::vector<float>&            scores,
+                                                   const std::vector<int>&        labels,
+                                                   const std::vector<int>&        tiles,
+                                                   const BoxSuppressionParams&    params,
+                                                   std::vector<int>*              suppressed_by = nullptr);
+
+        // Suppresses and merges detections found in overlapping tiles of one image, tiles[i] is the
+        // tile detection i was found in. Used by TiledDetectionNMS and by network output handlers
+        // that see the tile of each detection directly.
+        Core_EXPORT void mergeTiledDetections(std::vector<DetectedObject>& detections,
+                                              const std::vector<int>&      tiles,
+                                              const BoxSuppressionParams&  params,
+                                              bool                         class_aware,
+                                              bool                         merge_boxes);
+
+        class DetectionNMS: public Node
+        {
+        public:
+            MO_DERIVE(DetectionNMS, Node)
+                INPUT(std::vector<DetectedObject>, input, nullptr)
+                ENUM_PARAM(method, HardNMS, LinearSoftNMS, GaussianSoftNMS)
+                PARAM(float, iou_threshold, 0.5f)
+                PARAM(float, sigma, 0.5f)
+                PARAM(float, score_threshold, 0.001f)
+                PARAM(bool, class_aware, true)
+                OUTPUT(std::vector<DetectedObject>, output, {})
+            MO_END
+        protected:
+            bool processImpl();
+            BoxSuppressionParams suppressionParams() const;
+        };
+
+        // Merges detections produced per region of interest, such as the tiles passed to INeuralNet
+        // through bounding_boxes. Within a tile this is DetectionNMS, across tiles overlapping boxes are
+        // compared by intersection over the smaller box and optionally merged into their union.
+        class TiledDetectionNMS: public DetectionNMS
+        {
+        public:
+            MO_DERIVE(TiledDetectionNMS, DetectionNMS)
+                INPUT(SyncedMemory, image, nullptr)
+                OPTIONAL_INPUT(std::vector<cv::Rect2f>, bounding_boxes, nullptr)
+                PARAM(float, cross_tile_threshold, 0.5f)
+                PARAM(bool, merge_boxes, true)
+            MO_END
+        protected:
+            bool processImpl();
+        };
+    }
+}
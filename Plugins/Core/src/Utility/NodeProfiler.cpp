@@ -0,0 +1,168 @@
+#include "NodeProfiler.hpp"
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace aq::nodes;
+
+namespace
+{
+    // Index of the highest set bit, v must be non zero
+    inline int highestBit(uint64_t v)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, v);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(v);
+#endif
+    }
+
+    inline uint64_t toMicroseconds(NodeProfiler::Clock::duration d)
+    {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        return us > 0 ? static_cast<uint64_t>(us) : 0;
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t us)
+{
+    if (us < 2 * SubBuckets)
+    {
+        return static_cast<size_t>(us);
+    }
+    // Keep the top 5 bits, (us >> shift) is then in [16, 32)
+    const int shift = highestBit(us) - 4;
+    return static_cast<size_t>(shift) * SubBuckets + static_cast<size_t>(us >> shift);
+}
+
+double LatencyHistogram::bucketValue(size_t index)
+{
+    if (index < 2 * SubBuckets)
+    {
+        return static_cast<double>(index);
+    }
+    const size_t   shift    = index / SubBuckets - 1;
+    const uint64_t mantissa = index - shift * SubBuckets;
+    const uint64_t lower    = mantissa << shift;
+    return static_cast<double>(lower) + static_cast<double>(uint64_t(1) << shift) * 0.5;
+}
+
+void LatencyHistogram::record(uint64_t us)
+{
+    _buckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(us, std::memory_order_relaxed);
+    uint64_t current = _max.load(std::memory_order_relaxed);
+    while (us > current && !_max.compare_exchange_weak(current, us, std::memory_order_relaxed))
+    {
+    }
+    // Published last so a reader never sees more samples than bucket counts
+    _count.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : _buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_release);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return _count.load(std::memory_order_acquire);
+}
+
+double LatencyHistogram::mean() const
+{
+    const uint64_t n = count();
+    return n ? static_cast<double>(_sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+uint64_t LatencyHistogram::max() const
+{
+    return _max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    const uint64_t n = count();
+    if (n == 0)
+    {
+        return 0.0;
+    }
+    p = std::min(std::max(p, 0.0), 1.0);
+    const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * n + 0.5), 1);
+    uint64_t       seen = 0;
+    for (size_t i = 0; i < _buckets.size(); ++i)
+    {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            // The bucket center can exceed the largest recorded value
+            return std::min(bucketValue(i), static_cast<double>(max()));
+        }
+    }
+    return static_cast<double>(max());
+}
+
+void NodeProfiler::begin()
+{
+    if (_reset_requested.exchange(false))
+    {
+        reset();
+    }
+    _start = Clock::now();
+    // Time since the previous call returned is time spent waiting on upstream nodes
+    if (_previous_end != Clock::time_point())
+    {
+        _wait.record(toMicroseconds(_start - _previous_end));
+    }
+    if (_last_publish == Clock::time_point())
+    {
+        _last_publish = _start;
+    }
+}
+
+void NodeProfiler::end()
+{
+    _previous_end = Clock::now();
+    _process.record(toMicroseconds(_previous_end - _start));
+    ++_calls_since_publish;
+}
+
+void NodeProfiler::reset()
+{
+    _process.reset();
+    _wait.reset();
+    _start               = Clock::time_point();
+    _previous_end        = Clock::time_point();
+    _last_publish        = Clock::time_point();
+    _calls_since_publish = 0;
+    _throughput          = 0.0;
+}
+
+bool NodeProfiler::shouldPublish(std::chrono::milliseconds period)
+{
+    const Clock::time_point now     = Clock::now();
+    const auto              elapsed = now - _last_publish;
+    if (_last_publish == Clock::time_point() || elapsed < period)
+    {
+        return false;
+    }
+    _throughput          = _calls_since_publish / std::chrono::duration<double>(elapsed).count();
+    _calls_since_publish = 0;
+    _last_publish        = now;
+    return true;
+}
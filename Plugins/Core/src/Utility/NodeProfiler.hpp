@@ -0,0 +1,133 @@
+#pragma once
+#include "CoreExport.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace aq
+{
+    namespace nodes
+    {
+        // Log linear histogram of microsecond durations. Values below 32 us get their own bucket,
+        // above that every power of two is split into 16 buckets so a percentile is within about 3%
+        // of the recorded value. Recording is a few relaxed atomic increments, readers see a
+        // consistent enough snapshot without blocking the writer.
+        class Core_EXPORT LatencyHistogram
+        {
+        public:
+            LatencyHistogram();
+            void record(uint64_t us);
+            void reset();
+            uint64_t count() const;
+            // Mean and max in us, 0 if empty
+            double mean() const;
+            uint64_t max() const;
+            // Value in us below which p (0 to 1) of the samples are, 0 if empty
+            double percentile(double p) const;
+
+        private:
+            // Shifts of up to 59 bits with 16 to 31 as the remaining mantissa
+            enum { SubBuckets = 16, NumBuckets = 61 * SubBuckets };
+            static size_t bucketIndex(uint64_t us);
+            // Center of the value range of a bucket
+            static double bucketValue(size_t index);
+
+            std::array<std::atomic<uint64_t>, NumBuckets> _buckets;
+            std::atomic<uint64_t>                        _count;
+            std::atomic<uint64_t>                        _sum;
+            std::atomic<uint64_t>                        _max;
+        };
+
+        // Records the wall time of each processing call, the time spent waiting for input between
+        // two calls and the throughput of a node. A profiled node puts NODE_PROFILE_OUTPUTS in its
+        // MO_DERIVE block, has a NodeProfiler _profiler member and NODE_PROFILE_IMPL(Class) in its
+        // source file, and starts processImpl with
+        //     NodeProfiler::Scope<Class> profile(_profiler, *this);
+        class Core_EXPORT NodeProfiler
+        {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            // Times the enclosing call and publishes the profile_* outputs of node once per second
+            template<class NodeT>
+            class Scope
+            {
+            public:
+                Scope(NodeProfiler& profiler, NodeT& node) : _profiler(profiler), _node(node) { _profiler.begin(); }
+                ~Scope()
+                {
+                    _profiler.end();
+                    if (_profiler.shouldPublish())
+                    {
+                        _profiler.publish(_node);
+                    }
+                }
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+            private:
+                NodeProfiler& _profiler;
+                NodeT&        _node;
+            };
+
+            void begin();
+            void end();
+            void reset();
+            // Clears the statistics at the next begin, callable from any thread
+            void requestReset() { _reset_requested = true; }
+
+            // True at most once per period, the caller then publishes the current percentiles.
+            // Throughput is updated to the calls per second since the previous publish.
+            bool shouldPublish(std::chrono::milliseconds period = std::chrono::milliseconds(1000));
+
+            const LatencyHistogram& processTime() const { return _process; }
+            const LatencyHistogram& waitTime() const { return _wait; }
+            double throughput() const { return _throughput; }
+
+            // Updates the status outputs declared by NODE_PROFILE_OUTPUTS, times in ms
+            template<class NodeT>
+            void publish(NodeT& node) const
+            {
+                node.profile_process_p50_param.updateData(static_cast<float>(_process.percentile(0.50) / 1000.0));
+                node.profile_process_p95_param.updateData(static_cast<float>(_process.percentile(0.95) / 1000.0));
+                node.profile_process_p99_param.updateData(static_cast<float>(_process.percentile(0.99) / 1000.0));
+                node.profile_wait_p50_param.updateData(static_cast<float>(_wait.percentile(0.50) / 1000.0));
+                node.profile_wait_p95_param.updateData(static_cast<float>(_wait.percentile(0.95) / 1000.0));
+                node.profile_wait_p99_param.updateData(static_cast<float>(_wait.percentile(0.99) / 1000.0));
+                node.profile_throughput_param.updateData(static_cast<float>(_throughput));
+            }
+
+        private:
+            LatencyHistogram  _process;
+            LatencyHistogram  _wait;
+            Clock::time_point _start;
+            Clock::time_point _previous_end;
+            Clock::time_point _last_publish;
+            uint64_t          _calls_since_publish = 0;
+            double            _throughput          = 0.0;
+            std::atomic<bool> _reset_requested{false};
+        };
+    }
+}
+
+// Status outputs read by the latency command of SimpleConsole, updated once a second with times in ms
+// since the node was created or profile_reset was called. Placed inside a node's MO_DERIVE block.
+#define NODE_PROFILE_OUTPUTS                      \
+    STATUS(float, profile_process_p50, 0.0f)      \
+    STATUS(float, profile_process_p95, 0.0f)      \
+    STATUS(float, profile_process_p99, 0.0f)      \
+    STATUS(float, profile_wait_p50, 0.0f)         \
+    STATUS(float, profile_wait_p95, 0.0f)         \
+    STATUS(float, profile_wait_p99, 0.0f)         \
+    STATUS(float, profile_throughput, 0.0f)       \
+    MO_SLOT(void, profile_reset)
+
+// Defines the profile_reset slot of NODE_PROFILE_OUTPUTS. The profiler is not synchronized, the reset is
+// applied by the processing thread.
+#define NODE_PROFILE_IMPL(NodeClass)              \
+    void NodeClass::profile_reset()               \
+    {                                             \
+        _profiler.requestReset();                 \
+    }
@@ -1,6 +1,14 @@
 #include "chunked_file_sink.h"
 #include <Aquila/framegrabbers/FrameGrabberInfo.hpp>
 #include <gst/base/gstbasesink.h>
+#include <gst/app/gstappsink.h>
+#include <MetaObject/thread/boost_thread.hpp>
+#include <boost/filesystem.hpp>
+#include <iomanip>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace aq;
 
 
@@ -13,55 +21,310 @@ int chunked_file_sink::loadTimeout()
     return 3000;
 }
 
+chunked_file_sink::~chunked_file_sink()
+{
+    // on_pull must not queue buffers for a writer that is being torn down
+    this->stop_pipeline();
+    stopWriter();
+}
+
 GstFlowReturn chunked_file_sink::on_pull()
 {
-    GstSample *sample = gst_base_sink_get_last_sample(GST_BASE_SINK(_appsink));
-    if(sample)
+    // Drain everything queued in the appsink, every buffer of the encoded stream is needed
+    while(GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(_appsink), 0))
     {
-        GstBuffer *buffer;
-        GstCaps *caps;
-        GstStructure *s;
-        GstMapInfo map;
-        caps = gst_sample_get_caps (sample);
-        if (!caps) 
+        GstBuffer* buffer = gst_sample_get_buffer(sample);
+        if(buffer == nullptr)
         {
-            MO_LOG(debug) << "could not get sample caps";
-            return GST_FLOW_OK;
+            gst_sample_unref(sample);
+            continue;
         }
-        s = gst_caps_get_structure (caps, 0);
-        gint width, height;
-        gboolean res; 
-        res = gst_structure_get_int (s, "width", &width);
-        res |= gst_structure_get_int (s, "height", &height);
-        //const gchar* format = gst_structure_get_string(s, "format");
-        if (!res) 
+        const size_t size = gst_buffer_get_size(buffer);
+        const bool keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        bool dropped = false;
         {
-            MO_LOG(debug) << "could not get snapshot dimension\n";
-            return GST_FLOW_OK;
+            boost::mutex::scoped_lock lock(_queue_mtx);
+            if(!_headers_complete && !_caps_headers)
+            {
+                // Muxers like matroskamux put the headers needed to start a file in the caps
+                GstCaps* caps = gst_sample_get_caps(sample);
+                const GValue* headers = caps ? gst_structure_get_value(gst_caps_get_structure(caps, 0), "streamheader") : nullptr;
+                if(headers && GST_VALUE_HOLDS_ARRAY(headers) && gst_value_array_get_size(headers) != 0)
+                {
+                    // The caps are authoritative, header buffers seen so far are the same data
+                    for(GstBuffer* header : _stream_headers)
+                        gst_buffer_unref(header);
+                    _stream_headers.clear();
+                    for(guint i = 0; i < gst_value_array_get_size(headers); ++i)
+                    {
+                        const GValue* header = gst_value_array_get_value(headers, i);
+                        if(GST_VALUE_HOLDS_BUFFER(header))
+                            _stream_headers.push_back(gst_buffer_ref(gst_value_get_buffer(header)));
+                    }
+                    _caps_headers = true;
+                }
+            }
+            if(!_headers_complete && GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER))
+            {
+                // Headers in front of the stream are written at the start of every segment, the
+                // muxer also pushes the caps streamheader as buffers so those are only kept without it
+                if(!_caps_headers)
+                    _stream_headers.push_back(gst_buffer_ref(buffer));
+                gst_sample_unref(sample);
+                continue;
+            }
+            _headers_complete = true;
+            if(_dropping && keyframe)
+            {
+                _dropping = false;
+            }
+            if(!_dropping && _queued_bytes + size > max_queued_bytes)
+            {
+                // Deltas without their keyframe are useless, drop until the next one
+                _dropping = true;
+            }
+            if(_dropping)
+            {
+                dropped = true;
+            }else
+            {
+                _queue.push_back(gst_buffer_ref(buffer));
+                _queued_bytes += size;
+            }
         }
-        buffer = gst_sample_get_buffer (sample);
-        if (gst_buffer_map (buffer, &map, GST_MAP_READ))
+        if(dropped)
         {
-            cv::Mat mapped(height, width, CV_8UC3);
-            memcpy(mapped.data, map.data, map.size);
-
+            MO_LOG_EVERY_N(warning, 100) << "Segment writing is falling behind, dropping buffers up to the next keyframe";
+            dropped_buffers_param.updateData(dropped_buffers + 1);
+        }else
+        {
+            _queue_cv.notify_one();
         }
-        gst_buffer_unmap(buffer, &map);
         gst_sample_unref(sample);
-        gst_buffer_unref(buffer);
     }
     return GST_FLOW_OK;
 }
+
+void chunked_file_sink::writerLoop()
+{
+    mo::setThisThreadName("chunked_file_sink");
+    while(true)
+    {
+        GstBuffer* buffer = nullptr;
+        {
+            boost::mutex::scoped_lock lock(_queue_mtx);
+            while(_queue.empty() && !_stop_writer)
+            {
+                _queue_cv.wait(lock);
+            }
+            if(_queue.empty())
+            {
+                break;
+            }
+            buffer = _queue.front();
+            _queue.pop_front();
+            _queued_bytes -= gst_buffer_get_size(buffer);
+        }
+        writeBuffer(buffer);
+        gst_buffer_unref(buffer);
+    }
+    closeSegment();
+}
+
+void chunked_file_sink::writeBuffer(GstBuffer* buffer)
+{
+    const bool keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    // Buffers without a timestamp are placed on the wall clock since the recording started
+    GstClockTime time = GST_BUFFER_PTS(buffer);
+    if(!GST_CLOCK_TIME_IS_VALID(time))
+        time = GST_BUFFER_DTS(buffer);
+    if(!GST_CLOCK_TIME_IS_VALID(time))
+        time = static_cast<GstClockTime>((boost::posix_time::microsec_clock::universal_time() - _recording_start).total_microseconds()) * GST_USECOND;
+
+    if(_file && keyframe)
+    {
+        const bool size_reached = chunk_size != 0 && _segment_bytes >= chunk_size;
+        const bool duration_reached = segment_duration > 0.0 && GST_CLOCK_TIME_IS_VALID(_segment_begin) &&
+            time >= _segment_begin && time - _segment_begin >= static_cast<GstClockTime>(segment_duration * GST_SECOND);
+        if(size_reached || duration_reached)
+        {
+            closeSegment();
+        }
+    }
+    if(_file == nullptr)
+    {
+        // A segment has to start with a keyframe to be playable on its own
+        if(!keyframe || !openSegment())
+            return;
+        _segment_begin = time;
+    }
+    GstMapInfo map;
+    if(gst_buffer_map(buffer, &map, GST_MAP_READ))
+    {
+        if(fwrite(map.data, 1, map.size, _file) != map.size)
+        {
+            MO_LOG(error) << "Unable to write to " << _segment_path;
+        }
+        _segment_bytes += map.size;
+        gst_buffer_unmap(buffer, &map);
+    }
+    GstClockTime end = time;
+    if(GST_BUFFER_DURATION_IS_VALID(buffer))
+        end += GST_BUFFER_DURATION(buffer);
+    if(!GST_CLOCK_TIME_IS_VALID(_segment_end) || end > _segment_end)
+        _segment_end = end;
+}
+
+bool chunked_file_sink::openSegment()
+{
+    boost::filesystem::path dir(output_directory.string());
+    if(dir.empty())
+        dir = ".";
+    if(!boost::filesystem::exists(dir))
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(dir, ec);
+        if(ec)
+        {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to create directory '" << dir << "' " << ec.message();
+            return false;
+        }
+    }
+    std::stringstream name;
+    // Names sort in recording order, retention relies on it. UTC so a DST change can't reorder them
+    name << file_prefix << "_" << boost::posix_time::to_iso_string(boost::posix_time::second_clock::universal_time()) << "Z"
+         << "_" << std::setfill('0') << std::setw(6) << _segment_index++ << extension;
+    _segment_path = (dir / name.str()).string();
+    _file = fopen(_segment_path.c_str(), "wb");
+    if(_file == nullptr)
+    {
+        MO_LOG_EVERY_N(warning, 100) << "Unable to open " << _segment_path;
+        return false;
+    }
+    // Large sequential writes, many streams share the disk
+    _file_buffer.resize(std::max<size_t>(write_buffer_size, 64 * 1024));
+    setvbuf(_file, _file_buffer.data(), _IOFBF, _file_buffer.size());
+#if !defined(_MSC_VER) && defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
+    // Reserve the expected size up front so the file is laid out contiguously, trimmed on close
+    if(chunk_size != 0)
+    {
+        posix_fallocate(fileno(_file), 0, static_cast<off_t>(chunk_size));
+    }
+#endif
+    _segment_bytes = 0;
+    _segment_end = GST_CLOCK_TIME_NONE;
+    boost::mutex::scoped_lock lock(_queue_mtx);
+    for(GstBuffer* header : _stream_headers)
+    {
+        GstMapInfo map;
+        if(gst_buffer_map(header, &map, GST_MAP_READ))
+        {
+            fwrite(map.data, 1, map.size, _file);
+            _segment_bytes += map.size;
+            gst_buffer_unmap(header, &map);
+        }
+    }
+    return true;
+}
+
+void chunked_file_sink::closeSegment()
+{
+    if(_file == nullptr)
+        return;
+    fflush(_file);
+#if !defined(_MSC_VER) && defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
+    if(ftruncate(fileno(_file), static_cast<off_t>(_segment_bytes)) != 0)
+    {
+        MO_LOG(warning) << "Unable to trim preallocated space of " << _segment_path;
+    }
+#endif
+    fclose(_file);
+    _file = nullptr;
+    _closed_segments.emplace_back(_segment_path, _segment_bytes);
+    _closed_bytes += _segment_bytes;
+    segment_count_param.updateData(segment_count + 1);
+    MO_LOG(debug) << "Closed " << _segment_path << " " << _segment_bytes << " bytes";
+    sig_segment_closed(_segment_path, mo::Time_t(_segment_begin * mo::ns), mo::Time_t(_segment_end * mo::ns));
+    _segment_bytes = 0;
+    _segment_begin = GST_CLOCK_TIME_NONE;
+    enforceRetention();
+}
+
+void chunked_file_sink::enforceRetention()
+{
+    while(!_closed_segments.empty() &&
+          ((max_segments > 0 && _closed_segments.size() > static_cast<size_t>(max_segments)) ||
+           (disk_budget != 0 && _closed_bytes > disk_budget)))
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(_closed_segments.front().first, ec);
+        if(ec)
+        {
+            MO_LOG(warning) << "Unable to remove " << _closed_segments.front().first << " " << ec.message();
+        }
+        _closed_bytes -= std::min(_closed_bytes, _closed_segments.front().second);
+        _closed_segments.pop_front();
+    }
+}
+
+void chunked_file_sink::stopWriter()
+{
+    if(_writer_thread.joinable())
+    {
+        {
+            boost::mutex::scoped_lock lock(_queue_mtx);
+            _stop_writer = true;
+        }
+        _queue_cv.notify_all();
+        _writer_thread.join();
+    }
+    for(GstBuffer* buffer : _queue)
+        gst_buffer_unref(buffer);
+    _queue.clear();
+    _queued_bytes = 0;
+    for(GstBuffer* buffer : _stream_headers)
+        gst_buffer_unref(buffer);
+    _stream_headers.clear();
+    _stop_writer = false;
+    _dropping = false;
+    _headers_complete = false;
+    _caps_headers = false;
+}
+
 bool chunked_file_sink::loadData(const std::string& file_path)
 {
+    this->stop_pipeline();
+    stopWriter();
     if(gstreamer_src_base::create_pipeline(file_path))
     {
-        _filesink = gst_bin_get_by_name(GST_BIN(_pipeline), "filesink0");
-        if(_filesink)
+        // Segments left by a previous run count towards retention
+        _closed_segments.clear();
+        _closed_bytes = 0;
+        boost::filesystem::path dir(output_directory.string());
+        if(dir.empty())
+            dir = ".";
+        if(boost::filesystem::is_directory(dir))
         {
-            this->start_pipeline();
-            return true;
+            std::vector<std::string> existing;
+            for(boost::filesystem::directory_iterator itr(dir), end; itr != end; ++itr)
+            {
+                const std::string name = itr->path().filename().string();
+                if(boost::filesystem::is_regular_file(itr->path()) && name.find(file_prefix + "_") == 0 &&
+                   itr->path().extension().string() == extension)
+                    existing.push_back(itr->path().string());
+            }
+            std::sort(existing.begin(), existing.end());
+            for(const auto& file : existing)
+            {
+                const size_t size = static_cast<size_t>(boost::filesystem::file_size(file));
+                _closed_segments.emplace_back(file, size);
+                _closed_bytes += size;
+            }
         }
+        _recording_start = boost::posix_time::microsec_clock::universal_time();
+        _writer_thread = boost::thread(&chunked_file_sink::writerLoop, this);
+        this->start_pipeline();
+        return true;
     }
     return false;
 }
@@ -143,7 +406,7 @@ bool GstreamerSink::processImpl()
     }
     if(_source && _feed_enabled)
     {
-        PushImage(*image, stream());
+        PushImage(*image, stream(), image_param.getTimestamp());
         return true;
     }
     return false;
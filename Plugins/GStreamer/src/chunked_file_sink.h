@@ -2,9 +2,19 @@
 
 #include "Aquila/framegrabbers/IFrameGrabber.hpp"
 #include "gstreamer.hpp"
+#include <MetaObject/params/Types.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdio>
+#include <deque>
 
 namespace aq
 {
+    // Records an encoded stream into rolling segment files. loadData takes a gstreamer pipeline
+    // ending in an appsink named mysink whose output is cut into independently playable
+    // segments, ie "rtspsrc location=... ! rtph264depay ! h264parse ! mpegtsmux ! appsink name=mysink".
+    // Segments are only cut before keyframes. Buffers are queued without copying and written on
+    // a separate thread, when the disk falls behind by more than max_queued_bytes buffers are
+    // dropped up to the next keyframe.
     class GStreamer_EXPORT chunked_file_sink:
         virtual public gstreamer_src_base, 
         virtual public nodes::IGrabber
@@ -13,13 +23,59 @@ namespace aq
         static int canLoad(const std::string& doc);
         static int loadTimeout();
         MO_DERIVE(chunked_file_sink, nodes::IGrabber)
+            PARAM(mo::WriteDirectory, output_directory, {})
+            PARAM(std::string, file_prefix, "segment")
+            PARAM(std::string, extension, ".ts")
             PARAM(size_t, chunk_size, 10 * 1024 * 1024)
+            TOOLTIP(chunk_size, "Bytes after which a segment is closed at the next keyframe, 0 for no limit")
+            PARAM(double, segment_duration, 60.0)
+            TOOLTIP(segment_duration, "Seconds after which a segment is closed at the next keyframe, 0 for no limit")
+            PARAM(int, max_segments, 0)
+            TOOLTIP(max_segments, "Number of closed segments kept on disk, 0 to keep all")
+            PARAM(size_t, disk_budget, 0)
+            TOOLTIP(disk_budget, "Total bytes of closed segments kept on disk, 0 for no limit")
+            PARAM(size_t, write_buffer_size, 4 * 1024 * 1024)
+            PARAM(size_t, max_queued_bytes, 64 * 1024 * 1024)
+            STATUS(int, segment_count, 0)
+            STATUS(size_t, dropped_buffers, 0)
+            MO_SIGNAL(void, segment_closed, std::string, mo::Time_t, mo::Time_t)
         MO_END;
+        ~chunked_file_sink();
         virtual bool loadData(const std::string& file_path);
         virtual GstFlowReturn on_pull();
     protected:
         bool grab(){return true;}
-        GstElement* _filesink;
+        void writerLoop();
+        void writeBuffer(GstBuffer* buffer);
+        bool openSegment();
+        void closeSegment();
+        void enforceRetention();
+        void stopWriter();
+
+        // Filled on the streaming thread, drained by the writer thread
+        std::deque<GstBuffer*>    _queue;
+        size_t                    _queued_bytes = 0;
+        bool                      _dropping = false;
+        bool                      _headers_complete = false;
+        bool                      _caps_headers = false;
+        bool                      _stop_writer = false;
+        boost::mutex              _queue_mtx;
+        boost::condition_variable _queue_cv;
+        boost::thread             _writer_thread;
+
+        std::vector<GstBuffer*>   _stream_headers;
+
+        // Writer thread state
+        FILE*                     _file = nullptr;
+        std::vector<char>         _file_buffer;
+        std::string               _segment_path;
+        size_t                    _segment_bytes = 0;
+        size_t                    _segment_index = 0;
+        GstClockTime              _segment_begin = GST_CLOCK_TIME_NONE;
+        GstClockTime              _segment_end = GST_CLOCK_TIME_NONE;
+        boost::posix_time::ptime  _recording_start;
+        std::deque<std::pair<std::string, size_t>> _closed_segments;
+        size_t                    _closed_bytes = 0;
     };
 
     class GStreamer_EXPORT JpegKeyframer:
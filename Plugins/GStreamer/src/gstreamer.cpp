@@ -9,6 +9,8 @@
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
 
+#include <chrono>
+
 #include <QtNetwork/qnetworkinterface.h>
 
 using namespace aq;
@@ -16,6 +18,12 @@ using namespace aq::nodes;
 
 typedef class gstreamer_sink_base App;
 
+// Frame time estimate of the RTSP servers, clock() measures cpu time which drifts from real time
+static time_t wallTimeMs()
+{
+    return static_cast<time_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 // handled messages from the pipeline
 static gboolean bus_message(GstBus * bus, GstMessage * message, void * app)
 {
@@ -84,6 +92,10 @@ gstreamer_sink_base::gstreamer_sink_base():
     _enough_data_id = 0;
     _feed_enabled = false;
     _caps_set = false;
+    _buffer_pool = nullptr;
+    _pool_buffer_size = 0;
+    _previous_pts = GST_CLOCK_TIME_NONE;
+    _previous_duration = GST_CLOCK_TIME_NONE;
 
     gst_debug_set_active(1);
 
@@ -138,6 +150,17 @@ void gstreamer_sink_base::cleanup()
         gst_object_unref(_source);
         _source = nullptr;
     }
+    if(_buffer_pool)
+    {
+        gst_buffer_pool_set_active(_buffer_pool, FALSE);
+        gst_object_unref(_buffer_pool);
+        _buffer_pool = nullptr;
+        _pool_buffer_size = 0;
+    }
+    _first_timestamp = mo::OptionalTime_t();
+    _previous_timestamp = mo::OptionalTime_t();
+    _previous_pts = GST_CLOCK_TIME_NONE;
+    _previous_duration = GST_CLOCK_TIME_NONE;
     gstreamer_base::cleanup();
 }
 
@@ -365,84 +388,108 @@ bool gstreamer_base::pause_pipeline()
     MO_LOG(debug) <<"Pausing pipeline";
     return true;
 }
-void gstreamer_sink_base::PushImage(TS<SyncedMemory> img, cv::cuda::Stream& stream)
+namespace
 {
-    MO_LOG_EVERY_N(debug, 100) << "Pushing image onto pipeline";
-    auto curTime = clock();
-    _delta = curTime - _prevTime;
-    _prevTime = curTime;
-    MO_LOG(trace) << "Estimated frame time: " << _delta << " ms";
-    if (!_caps_set)
+    // Keeps the image wrapped by a GstBuffer alive until gstreamer is done with it
+    struct WrappedImage
     {
-        if (set_caps(img.getMat(stream).size(), img.getMat(stream).channels()))
-        {
-            _caps_set = true;
-            start_pipeline();
-        }
+        cv::Mat image;
+        SyncedMemory owner;
+    };
+    void releaseWrappedImage(gpointer data)
+    {
+        delete static_cast<WrappedImage*>(data);
     }
+}
 
-    if (_feed_enabled)
+GstBuffer* gstreamer_sink_base::createBuffer(const cv::Mat& h_img, const SyncedMemory& img)
+{
+    // Raw video rows are padded to 4 bytes
+    const gsize row_size = static_cast<gsize>(h_img.cols * h_img.elemSize());
+    const gsize stride = GST_ROUND_UP_4(row_size);
+    const gsize size = stride * static_cast<gsize>(h_img.rows);
+    if(h_img.isContinuous() && row_size == stride)
     {
-        cv::Mat h_img = img.getMat(stream);
-        if(img.getSyncState() < img.DEVICE_UPDATED)
+        WrappedImage* wrapped = new WrappedImage{h_img, img};
+        return gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, h_img.data, size, 0, size, wrapped, &releaseWrappedImage);
+    }
+    if(_buffer_pool == nullptr || _pool_buffer_size != size)
+    {
+        if(_buffer_pool)
         {
-            gsize bufferlength = static_cast<gsize>(h_img.cols * h_img.rows * h_img.channels());
-            GstBuffer* buffer = gst_buffer_new_and_alloc(bufferlength);
-            GstMapInfo map;
-            gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_WRITE);
-            memcpy(map.data, h_img.data, map.size);
-            gst_buffer_unmap(buffer, &map);
-
-            GST_BUFFER_PTS(buffer) = img.frame_number;
-
-            GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(_delta, GST_SECOND, 1000);
-            _timestamp += GST_BUFFER_DURATION(buffer);
-
-            GstFlowReturn rw;
-            g_signal_emit_by_name(_source, "push-buffer", buffer, &rw);
-
-            if (rw != GST_FLOW_OK)
-            {
-                MO_LOG(error) << "Error pushing buffer into appsrc " << rw;
-            }
-            gst_buffer_unref(buffer);
-        }else
+            gst_buffer_pool_set_active(_buffer_pool, FALSE);
+            gst_object_unref(_buffer_pool);
+        }
+        _buffer_pool = gst_buffer_pool_new();
+        GstStructure* config = gst_buffer_pool_get_config(_buffer_pool);
+        gst_buffer_pool_config_set_params(config, nullptr, static_cast<guint>(size), 2, 0);
+        if(!gst_buffer_pool_set_config(_buffer_pool, config) || !gst_buffer_pool_set_active(_buffer_pool, TRUE))
         {
-            cuda::enqueue_callback_async(
-                [h_img, this]()->void
-            {
-                gsize bufferlength = static_cast<gsize>(h_img.cols * h_img.rows * h_img.channels());
-                GstBuffer* buffer = gst_buffer_new_and_alloc(bufferlength);
-                GstMapInfo map;
-                gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_WRITE);
-                memcpy(map.data, h_img.data, map.size);
-                gst_buffer_unmap(buffer, &map);
-
-                GST_BUFFER_PTS(buffer) = _timestamp;
+            MO_LOG(error) << "Unable to configure buffer pool for " << size << " byte frames";
+            gst_object_unref(_buffer_pool);
+            _buffer_pool = nullptr;
+            return nullptr;
+        }
+        _pool_buffer_size = size;
+    }
+    GstBuffer* buffer = nullptr;
+    if(gst_buffer_pool_acquire_buffer(_buffer_pool, &buffer, nullptr) != GST_FLOW_OK)
+    {
+        MO_LOG(error) << "Unable to acquire buffer from pool";
+        return nullptr;
+    }
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_WRITE);
+    for(int i = 0; i < h_img.rows; ++i)
+    {
+        memcpy(map.data + i * stride, h_img.ptr(i), row_size);
+    }
+    gst_buffer_unmap(buffer, &map);
+    return buffer;
+}
 
-                GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(_delta, GST_SECOND, 1000);
-                _timestamp += GST_BUFFER_DURATION(buffer);
+void gstreamer_sink_base::pushBuffer(const cv::Mat& h_img, const SyncedMemory& img, mo::OptionalTime_t ts)
+{
+    boost::mutex::scoped_lock lock(_push_mtx);
+    GstBuffer* buffer = createBuffer(h_img, img);
+    if(buffer == nullptr)
+        return;
+    mo::Time_t time = ts ? *ts : mo::Time_t(mo::getCurrentTime());
+    if(!_first_timestamp)
+        _first_timestamp = time;
+    if(_previous_timestamp && time <= *_previous_timestamp)
+    {
+        // The source looped or seeked backwards, continue the output timeline after the previous frame
+        const GstClockTime pts = _previous_pts + (_previous_duration != GST_CLOCK_TIME_NONE ? _previous_duration : GST_MSECOND);
+        _first_timestamp = mo::Time_t(time - std::chrono::nanoseconds(pts));
+    }
+    GST_BUFFER_PTS(buffer) = std::chrono::duration_cast<std::chrono::nanoseconds>(time - *_first_timestamp).count();
+    if(_previous_pts != GST_CLOCK_TIME_NONE)
+    {
+        GST_BUFFER_DURATION(buffer) = GST_BUFFER_PTS(buffer) - _previous_pts;
+    }
+    _previous_pts = GST_BUFFER_PTS(buffer);
+    _previous_duration = GST_BUFFER_DURATION(buffer);
+    _previous_timestamp = time;
 
-                GstFlowReturn rw;
-                g_signal_emit_by_name(_source, "push-buffer", buffer, &rw);
+    GstFlowReturn rw;
+    g_signal_emit_by_name(_source, "push-buffer", buffer, &rw);
 
-                if (rw != GST_FLOW_OK)
-                {
-                    MO_LOG(error) << "Error pushing buffer into appsrc " << rw;
-                }
-                gst_buffer_unref(buffer);
-            }, stream);
-        }
+    if (rw != GST_FLOW_OK)
+    {
+        MO_LOG(error) << "Error pushing buffer into appsrc " << rw;
     }
+    gst_buffer_unref(buffer);
+}
+
+void gstreamer_sink_base::PushImage(TS<SyncedMemory> img, cv::cuda::Stream& stream)
+{
+    PushImage(static_cast<SyncedMemory&>(img), stream, img.timestamp);
 }
 
-void gstreamer_sink_base::PushImage(SyncedMemory img, cv::cuda::Stream& stream)
+void gstreamer_sink_base::PushImage(SyncedMemory img, cv::cuda::Stream& stream, mo::OptionalTime_t ts)
 {
     MO_LOG_EVERY_N(debug, 100) << "Pushing image onto pipeline";
-    auto curTime = clock();
-    _delta = curTime - _prevTime;
-    _prevTime = curTime;
-    MO_LOG(trace) << "Estimated frame time: " << _delta << " ms";
     if (!_caps_set)
     {
         if (set_caps(img.getMat(stream).size(), img.getMat(stream).channels()))
@@ -457,51 +504,14 @@ void gstreamer_sink_base::PushImage(SyncedMemory img, cv::cuda::Stream& stream)
         cv::Mat h_img = img.getMat(stream);
         if(img.getSyncState() < img.DEVICE_UPDATED)
         {
-            int bufferlength = h_img.cols * h_img.rows * h_img.channels();
-            GstBuffer* buffer = gst_buffer_new_and_alloc(bufferlength);
-            GstMapInfo map;
-            gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_WRITE);
-            memcpy(map.data, h_img.data, map.size);
-            gst_buffer_unmap(buffer, &map);
-
-            GST_BUFFER_PTS(buffer) = _timestamp;
-
-            GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(_delta, GST_SECOND, 1000);
-            _timestamp += GST_BUFFER_DURATION(buffer);
-
-            GstFlowReturn rw;
-            g_signal_emit_by_name(_source, "push-buffer", buffer, &rw);
-
-            if (rw != GST_FLOW_OK)
-            {
-                MO_LOG(error) << "Error pushing buffer into appsrc " << rw;
-            }
-            gst_buffer_unref(buffer);
+            pushBuffer(h_img, img, ts);
         }else
         {
+            // The download is only complete once the stream reaches this point
             cuda::enqueue_callback_async(
-                [h_img, this]()->void
+                [h_img, img, ts, this]()->void
             {
-                gsize bufferlength = static_cast<gsize>(h_img.cols * h_img.rows * h_img.channels());
-                GstBuffer* buffer = gst_buffer_new_and_alloc(bufferlength);
-                GstMapInfo map;
-                gst_buffer_map(buffer, &map, (GstMapFlags)GST_MAP_WRITE);
-                memcpy(map.data, h_img.data, map.size);
-                gst_buffer_unmap(buffer, &map);
-
-                GST_BUFFER_PTS(buffer) = _timestamp;
-
-                GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(_delta, GST_SECOND, 1000);
-                _timestamp += GST_BUFFER_DURATION(buffer);
-
-                GstFlowReturn rw;
-                g_signal_emit_by_name(_source, "push-buffer", buffer, &rw);
-
-                if (rw != GST_FLOW_OK)
-                {
-                    MO_LOG(error) << "Error pushing buffer into appsrc " << rw;
-                }
-                gst_buffer_unref(buffer);
+                pushBuffer(h_img, img, ts);
             }, stream);
         }
     }
@@ -813,7 +823,7 @@ cv::cuda::GpuMat RTSP_server::doProcess(cv::cuda::GpuMat &img, cv::cuda::Stream
         imgSize = img.size();
         setup();
     }
-    auto curTime = clock();
+    auto curTime = wallTimeMs();
     delta = curTime - prevTime;
     prevTime = curTime;
     if (!g_main_loop_is_running(glib_MainLoop))
@@ -1044,7 +1054,7 @@ void RTSP_server_new::nodeInit(bool firstInit)
         GstRTSPMountPoints *mounts = nullptr;
         gst_debug_set_active(1);
         timestamp = 0;
-        prevTime = clock();
+        prevTime = wallTimeMs();
         if (!gst_is_initialized())
         {
             NODE_MO_LOG(debug) << "Initializing gstreamer";
@@ -1122,7 +1132,7 @@ void RTSP_server_new::nodeInit(bool firstInit)
 
 TS<SyncedMemory> RTSP_server_new::doProcess(TS<SyncedMemory> img, cv::cuda::Stream &stream)
 {
-    auto curTime = clock();
+    auto curTime = wallTimeMs();
     delta = curTime - prevTime;
     prevTime = curTime;
     cv::Mat h_image = img.getMat(stream);
@@ -1136,7 +1146,7 @@ TS<SyncedMemory> RTSP_server_new::doProcess(TS<SyncedMemory> img, cv::cuda::Stre
 /*cv::cuda::GpuMat RTSP_server_new::doProcess(cv::cuda::GpuMat &img, cv::cuda::Stream &stream)
 {
     imgSize = img.size();
-    auto curTime = clock();
+    auto curTime = wallTimeMs();
     delta = curTime - prevTime;
     prevTime = curTime;
     auto buf = hostBuffer.getFront();
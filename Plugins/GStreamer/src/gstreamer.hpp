@@ -109,17 +109,31 @@ namespace aq{
             virtual bool set_caps(cv::Size image_size, int channels, int depth = CV_8U);
             virtual bool set_caps(const std::string& caps);
 
-            void PushImage(aq::SyncedMemory img, cv::cuda::Stream& stream);
+            // The buffer PTS is ts relative to the first pushed frame, the wall clock is used when ts is not set
+            void PushImage(aq::SyncedMemory img, cv::cuda::Stream& stream, mo::OptionalTime_t ts = mo::OptionalTime_t());
             void PushImage(TS<aq::SyncedMemory> img, cv::cuda::Stream& stream);
             // Used for gstreamer to indicate that the appsrc needs to either feed data or stop feeding data
             virtual void start_feed();
             virtual void stop_feed();
         protected:
+            // Wraps the image memory without a copy when its rows are laid out as gstreamer expects
+            // raw video, the buffer keeps img alive until gstreamer releases it. Otherwise the image
+            // is copied into a buffer from _buffer_pool.
+            GstBuffer* createBuffer(const cv::Mat& h_img, const aq::SyncedMemory& img);
+            void pushBuffer(const cv::Mat& h_img, const aq::SyncedMemory& img, mo::OptionalTime_t ts);
+
             GstAppSrc*     _source; // The output of Aquila's processing pipeline and the input to the gstreamer pipeline
             guint           _need_data_id; // id for the need data signal
             guint           _enough_data_id; // id for the enough data signal
 
             bool _feed_enabled;
+            GstBufferPool*     _buffer_pool;
+            gsize              _pool_buffer_size;
+            boost::mutex       _push_mtx;
+            mo::OptionalTime_t _first_timestamp;
+            mo::OptionalTime_t _previous_timestamp;
+            GstClockTime       _previous_pts;
+            GstClockTime       _previous_duration;
             virtual void cleanup();
         };
         // Decpricated ?
@@ -82,7 +82,7 @@ bool tcpserver::processImpl()
     }
     if(_initialized)
     {
-        PushImage(*image, stream());
+        PushImage(*image, stream(), image_param.getTimestamp());
         return true;
     }
     return false;
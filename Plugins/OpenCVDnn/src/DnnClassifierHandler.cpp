@@ -0,0 +1,68 @@
+#include "DnnClassifierHandler.hpp"
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+#include <algorithm>
+
+using namespace aq::Dnn;
+
+std::map<int, int> DnnClassifierHandler::CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                          const std::vector<cv::Mat>& outputs)
+{
+    std::map<int, int> output;
+    for(size_t i = 0; i < outputs.size(); ++i)
+    {
+        const std::string type = layerType(net, output_names[i]);
+        if(type == "Softmax" || type == "Convolution" || type == "InnerProduct" || type == "Crop")
+        {
+            const cv::Mat& blob = outputs[i];
+            if(blob.dims == 2 || (blob.dims == 4 && blob.size[2] == 1 && blob.size[3] == 1))
+                output[static_cast<int>(i)] = 10;
+        }
+    }
+    return output;
+}
+
+void DnnClassifierHandler::startBatch()
+{
+    classified_detections.clear();
+}
+
+void DnnClassifierHandler::handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                        mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<aq::DetectedObject2d>& objs)
+{
+    if(output.empty())
+        return;
+    const int num = output.size[0];
+    const int num_classes = static_cast<int>(output.total() / num);
+    const float* data = output.ptr<float>();
+    for(int i = 0; i < num && i < static_cast<int>(bounding_boxes.size()); ++i)
+    {
+        const float* scores = data + i * num_classes;
+        const int idx = static_cast<int>(std::max_element(scores, scores + num_classes) - scores);
+        DetectedObject obj;
+        obj.timestamp = input_param.getTimestamp();
+        if(labels && static_cast<size_t>(idx) < labels->size())
+        {
+            obj.classification = Classification((*labels)[idx], scores[idx], idx);
+        }else
+        {
+            obj.classification = Classification("", scores[idx], idx);
+        }
+        obj.bounding_box = cv::Rect2f(bounding_boxes[i].x, bounding_boxes[i].y, bounding_boxes[i].width, bounding_boxes[i].height);
+        if(objs.size() == bounding_boxes.size())
+        {
+            obj.id = objs[i].id;
+            obj.framenumber = objs[i].framenumber;
+            obj.timestamp = objs[i].timestamp;
+            obj.bounding_box = objs[i].bounding_box;
+        }
+        classified_detections.push_back(obj);
+    }
+}
+
+void DnnClassifierHandler::endBatch(boost::optional<mo::Time_t> timestamp)
+{
+    classified_detections_param.emitUpdate(timestamp, _ctx.get());
+}
+
+MO_REGISTER_CLASS(DnnClassifierHandler)
@@ -0,0 +1,24 @@
+#pragma once
+#include "DnnNetHandler.hpp"
+
+namespace aq
+{
+    namespace Dnn
+    {
+        class DnnClassifierHandler: public NetHandler
+        {
+        public:
+            static std::map<int, int> CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                       const std::vector<cv::Mat>& outputs);
+
+            MO_DERIVE(DnnClassifierHandler, NetHandler)
+                OUTPUT(std::vector<DetectedObject>, classified_detections, {})
+                PARAM(float, classification_threshold, 0.5)
+            MO_END
+            virtual void startBatch();
+            virtual void handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                      mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<DetectedObject2d>& objs);
+            virtual void endBatch(boost::optional<mo::Time_t> timestamp);
+        };
+    }
+}
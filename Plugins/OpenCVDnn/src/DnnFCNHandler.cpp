@@ -0,0 +1,79 @@
+#include "DnnFCNHandler.hpp"
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+using namespace aq::Dnn;
+
+namespace
+{
+    // Channel at a time so the inner loop runs over contiguous memory
+    void argMax(const cv::Mat& blob, cv::Mat& label, cv::Mat& confidence)
+    {
+        const int channels = blob.size[1];
+        const int height = blob.size[2];
+        const int width = blob.size[3];
+        const int plane = height * width;
+        CV_Assert(channels < 256);
+        label.create(height, width, CV_8U);
+        confidence.create(height, width, CV_32F);
+        const float* data = blob.ptr<float>();
+        uchar* l = label.ptr<uchar>();
+        float* c = confidence.ptr<float>();
+        std::fill(l, l + plane, 0);
+        std::copy(data, data + plane, c);
+        for(int ch = 1; ch < channels; ++ch)
+        {
+            const float* src = data + ch * plane;
+            for(int i = 0; i < plane; ++i)
+            {
+                const bool greater = src[i] > c[i];
+                c[i] = greater ? src[i] : c[i];
+                l[i] = greater ? static_cast<uchar>(ch) : l[i];
+            }
+        }
+    }
+}
+
+std::map<int, int> DnnFCNHandler::CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                   const std::vector<cv::Mat>& outputs)
+{
+    std::map<int, int> output;
+    for(size_t i = 0; i < outputs.size(); ++i)
+    {
+        const std::string type = layerType(net, output_names[i]);
+        if(type == "Softmax" || type == "Convolution" || type == "Crop" || type == "Deconvolution")
+        {
+            const cv::Mat& blob = outputs[i];
+            if(blob.dims == 4 && blob.size[2] > 1 && blob.size[3] > 1)
+                output[static_cast<int>(i)] = 10;
+        }
+    }
+    return output;
+}
+
+void DnnFCNHandler::handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                 mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<aq::DetectedObject2d>& objs)
+{
+    (void)bounding_boxes;
+    (void)objs;
+    if(output.empty() || output.size[0] == 0)
+        return;
+    aq::SyncedMemory data;
+    input_param.getData(data);
+    const cv::Size input_image_size = data.getSize();
+
+    cv::Mat label, confidence;
+    argMax(output, label, confidence);
+
+    cv::Mat resized_label, resized_confidence;
+    cv::resize(label, resized_label, input_image_size, 0, 0, cv::INTER_NEAREST);
+    cv::resize(confidence, resized_confidence, input_image_size, 0, 0, cv::INTER_NEAREST);
+    resized_label.setTo(cv::Scalar::all(0), resized_confidence < min_confidence);
+
+    label_param.updateData(resized_label, input_param.getTimestamp(), _ctx.get());
+    confidence_param.updateData(resized_confidence, input_param.getTimestamp(), _ctx.get());
+}
+
+MO_REGISTER_CLASS(DnnFCNHandler)
@@ -0,0 +1,23 @@
+#pragma once
+#include "DnnNetHandler.hpp"
+
+namespace aq
+{
+    namespace Dnn
+    {
+        // Per pixel argmax of a [N, C, H, W] score map, resized to the input image
+        class DnnFCNHandler: public NetHandler
+        {
+        public:
+            static std::map<int, int> CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                       const std::vector<cv::Mat>& outputs);
+            MO_DERIVE(DnnFCNHandler, NetHandler)
+                OUTPUT(SyncedMemory, label, SyncedMemory())
+                OUTPUT(SyncedMemory, confidence, SyncedMemory())
+                PARAM(float, min_confidence, 10)
+            MO_END
+            virtual void handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                      mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<DetectedObject2d>& objs);
+        };
+    }
+}
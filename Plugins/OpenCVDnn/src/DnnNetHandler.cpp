@@ -0,0 +1,15 @@
+#include "DnnNetHandler.hpp"
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+std::string aq::Dnn::NetHandler::layerType(const cv::dnn::Net& net, const cv::String& output_name)
+{
+    // getLayer is not const in cv::dnn
+    cv::dnn::Net& mutable_net = const_cast<cv::dnn::Net&>(net);
+    cv::Ptr<cv::dnn::Layer> layer = mutable_net.getLayer(mutable_net.getLayerId(output_name));
+    return layer ? std::string(layer->type) : std::string();
+}
+
+void aq::Dnn::NetHandler::setOutputBlob(const std::vector<cv::String>& output_names, int output_index)
+{
+    output_blob_name = output_names[static_cast<size_t>(output_index)];
+}
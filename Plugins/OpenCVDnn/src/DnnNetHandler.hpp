@@ -0,0 +1,61 @@
+#pragma once
+#include "OpenCVDnnExport.hpp"
+#include <Aquila/core/Algorithm.hpp>
+#include <Aquila/types/ObjectDetection.hpp>
+#include <Aquila/types/SyncedMemory.hpp>
+#include <MetaObject/object/IMetaObjectInfo.hpp>
+#include <MetaObject/object/MetaObject.hpp>
+#include <opencv2/dnn.hpp>
+
+namespace aq
+{
+    namespace Dnn
+    {
+        // cv::dnn counterpart of Caffe::NetHandler. Handlers are picked the same way, by the
+        // priority they report for each network output, but work on the host output blobs.
+        class NetHandlerInfo: public mo::IMetaObjectInfo
+        {
+        public:
+            // Return a map of output index, priority of this handler
+            virtual std::map<int, int> CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                        const std::vector<cv::Mat>& outputs) const = 0;
+        };
+
+        class OpenCVDnn_EXPORT NetHandler:
+              public TInterface<NetHandler, Algorithm>
+        {
+        public:
+            typedef NetHandlerInfo InterfaceInfo;
+            typedef NetHandler Interface;
+            MO_BEGIN(NetHandler)
+                PARAM(std::string, output_blob_name, "")
+            MO_END
+            static std::string layerType(const cv::dnn::Net& net, const cv::String& output_name);
+
+            virtual void setOutputBlob(const std::vector<cv::String>& output_names, int output_index);
+            virtual void startBatch(){}
+            // output holds the network output for the rois in bounding_boxes
+            virtual void handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                      mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<DetectedObject2d>& objs) = 0;
+            virtual void endBatch(boost::optional<mo::Time_t> timestamp){ (void)timestamp; }
+            void setLabels(std::vector<std::string>* labels){this->labels = labels;}
+        protected:
+            bool processImpl() { return true;}
+            std::vector<std::string>* labels = nullptr;
+        };
+    }
+}
+
+namespace mo
+{
+    template<class Type>
+    struct MetaObjectInfoImpl<Type, aq::Dnn::NetHandlerInfo>
+            : public aq::Dnn::NetHandlerInfo
+    {
+        std::map<int, int> CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                            const std::vector<cv::Mat>& outputs) const
+        {
+            return Type::CanHandleNetwork(net, output_names, outputs);
+        }
+    };
+}
@@ -0,0 +1,114 @@
+#include "DnnSSDHandler.hpp"
+#include <Utility/DetectionNMS.hpp>
+#include <MetaObject/logging/logging.hpp>
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+using namespace aq::Dnn;
+
+namespace
+{
+    float iou(const cv::Rect2f& r1, const cv::Rect2f& r2)
+    {
+        const float intersection = (r1 & r2).area();
+        const float union_area = r1.area() + r2.area() - intersection;
+        return union_area > 0.0f ? intersection / union_area : 0.0f;
+    }
+}
+
+std::map<int, int> DnnSSDHandler::CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                   const std::vector<cv::Mat>& outputs)
+{
+    std::map<int, int> output;
+    for(size_t i = 0; i < outputs.size(); ++i)
+    {
+        if(layerType(net, output_names[i]) == "DetectionOutput" && outputs[i].dims == 4 && outputs[i].size[3] == 7)
+            output[static_cast<int>(i)] = 10;
+    }
+    return output;
+}
+
+void DnnSSDHandler::startBatch()
+{
+    current_id = 0;
+    detections.clear();
+    detection_rois.clear();
+    roi_count = 0;
+}
+
+void DnnSSDHandler::handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                 mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<aq::DetectedObject2d>& objs)
+{
+    (void)objs;
+    if(output.empty())
+        return;
+    std::vector<DetectedObject> objects;
+    std::vector<int> object_rois;
+    const int num_detections = output.size[2];
+    const float* data = output.ptr<float>();
+    for(int i = 0; i < num_detections; ++i)
+    {
+        const float* det = data + i * 7;
+        const size_t num = static_cast<size_t>(det[0]);
+        const int label = static_cast<int>(det[1]);
+        const float confidence = det[2];
+        if(num >= bounding_boxes.size() || label < 0)
+            continue;
+        const float threshold = detection_threshold.size() == 1 ? detection_threshold[0] :
+                                static_cast<size_t>(label) < detection_threshold.size() ? detection_threshold[label] : 1.0f;
+        if(confidence <= threshold)
+            continue;
+        DetectedObject obj;
+        obj.bounding_box.x = det[3] * bounding_boxes[num].width + bounding_boxes[num].x;
+        obj.bounding_box.y = det[4] * bounding_boxes[num].height + bounding_boxes[num].y;
+        obj.bounding_box.width = (det[5] - det[3]) * bounding_boxes[num].width;
+        obj.bounding_box.height = (det[6] - det[4]) * bounding_boxes[num].height;
+        obj.timestamp = input_param.getTimestamp();
+        obj.framenumber = input_param.getFrameNumber();
+        obj.id = current_id++;
+        if(this->labels && static_cast<size_t>(label) < this->labels->size())
+            obj.classification = Classification((*this->labels)[label], confidence, label);
+        else
+            obj.classification = Classification("", confidence, label);
+
+        // Overlapping detections keep the most confident one, across rois that is left to endBatch
+        // when merge_rois is set
+        bool append = true;
+        for(size_t k = 0; k < objects.size(); ++k)
+        {
+            if(merge_rois && object_rois[k] != roi_count + static_cast<int>(num))
+                continue;
+            if(iou(obj.bounding_box, objects[k].bounding_box) > overlap_threshold)
+            {
+                if(obj.classification.confidence > objects[k].classification.confidence)
+                    objects[k] = obj;
+                append = false;
+            }
+        }
+        if(append)
+        {
+            objects.push_back(obj);
+            object_rois.push_back(roi_count + static_cast<int>(num));
+        }
+    }
+    if(objects.size())
+    {
+        MO_LOG(trace) << "Detected " << objects.size() << " objets in frame " << input_param.getFrameNumber();
+    }
+    detections.insert(detections.end(), objects.begin(), objects.end());
+    detection_rois.insert(detection_rois.end(), object_rois.begin(), object_rois.end());
+    roi_count += static_cast<int>(bounding_boxes.size());
+}
+
+void DnnSSDHandler::endBatch(boost::optional<mo::Time_t> timestamp)
+{
+    if(merge_rois && roi_count > 1)
+    {
+        aq::nodes::BoxSuppressionParams params;
+        params.iou_threshold = overlap_threshold;
+        params.cross_tile_threshold = cross_roi_threshold;
+        aq::nodes::mergeTiledDetections(detections, detection_rois, params, true, true);
+    }
+    detections_param.emitUpdate(timestamp, _ctx.get());
+}
+
+MO_REGISTER_CLASS(DnnSSDHandler)
@@ -0,0 +1,34 @@
+#pragma once
+#include "DnnNetHandler.hpp"
+
+namespace aq
+{
+    namespace Dnn
+    {
+        // Decodes the [1, 1, N, 7] output of a DetectionOutput layer:
+        // image index, label, confidence, xmin, ymin, xmax, ymax relative to the roi
+        class DnnSSDHandler: public NetHandler
+        {
+        public:
+            static std::map<int, int> CanHandleNetwork(const cv::dnn::Net& net, const std::vector<cv::String>& output_names,
+                                                       const std::vector<cv::Mat>& outputs);
+            MO_DERIVE(DnnSSDHandler, NetHandler)
+                PARAM(std::vector<float>, detection_threshold, {0.75f})
+                PARAM(float, overlap_threshold, 0.2f)
+                PARAM(bool, merge_rois, true)
+                TOOLTIP(merge_rois, "Merge detections of overlapping rois, such as INeuralNet tiles, at the end of the batch")
+                PARAM(float, cross_roi_threshold, 0.5f)
+                OUTPUT(std::vector<DetectedObject>, detections, std::vector<DetectedObject>())
+            MO_END
+            virtual void startBatch();
+            virtual void handleOutput(const cv::Mat& output, const std::vector<cv::Rect>& bounding_boxes,
+                                      mo::ITParam<aq::SyncedMemory>& input_param, const std::vector<DetectedObject2d>& objs);
+            virtual void endBatch(boost::optional<mo::Time_t> timestamp);
+        protected:
+            int current_id = 0;
+            // Index of the roi each detection came from, counted over the whole batch
+            std::vector<int> detection_rois;
+            int roi_count = 0;
+        };
+    }
+}
@@ -0,0 +1,255 @@
+#include "OpenCVDnn.hpp"
+#include <Aquila/nodes/NodeInfo.hpp>
+
+#include <MetaObject/logging/logging.hpp>
+#include <MetaObject/params/detail/TInputParamPtrImpl.hpp>
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+using namespace aq;
+using namespace aq::nodes;
+
+bool OpenCVDnnNet::initNetwork() {
+    if (num_threads_param.modified()) {
+        if (num_threads > 0)
+            cv::setNumThreads(num_threads);
+        num_threads_param.modified(false);
+    }
+    if (model_file_param.modified() || weight_file_param.modified()) {
+        if (boost::filesystem::exists(weight_file)) {
+            // Frameworks that keep the architecture in the weight file don't need model_file
+            const std::string config = boost::filesystem::exists(model_file) ? model_file.string() : std::string();
+            try {
+                _net = cv::dnn::readNet(weight_file.string(), config);
+            } catch (cv::Exception& e) {
+                MO_LOG(warning) << "Unable to load " << weight_file.string() << ": " << e.what();
+                _net_loaded = false;
+                return false;
+            }
+            _net.setPreferableBackend(cv::dnn::DNN_BACKEND_DEFAULT);
+            _net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+            _output_names.clear();
+            const std::vector<cv::String> layer_names = _net.getLayerNames();
+            for (int id : _net.getUnconnectedOutLayers()) {
+                _output_names.push_back(layer_names[static_cast<size_t>(id - 1)]);
+            }
+            _outputs.clear();
+            _input_blob.release();
+            _input_blobs.clear();
+            _net_handlers.clear();
+            _net_loaded = !_net.empty();
+            model_file_param.modified(false);
+            weight_file_param.modified(false);
+            MO_LOG(info) << "Loaded " << weight_file.string() << " with " << layer_names.size() << " layers";
+        } else {
+            MO_LOG_EVERY_N(warning, 100) << "Weight file does not exist " << weight_file.string();
+        }
+    }
+
+    if ((label_file_param.modified() || labels.empty()) && boost::filesystem::exists(label_file)) {
+        labels.clear();
+        std::ifstream ifs(label_file.string().c_str());
+        if (!ifs) {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to load label file";
+        }
+        std::string line;
+        while (std::getline(ifs, line, '\n')) {
+            labels.push_back(line);
+        }
+        MO_LOG(info) << "Loaded " << labels.size() << " classes";
+        labels_param.emitUpdate();
+        label_file_param.modified(false);
+    }
+
+    if (mean_file_param.modified()) {
+        MO_LOG(warning) << "mean_file is not supported by " << GetTypeName() << ", set channel_mean instead";
+        mean_file_param.modified(false);
+    }
+
+    if (!_net_loaded) {
+        MO_LOG_EVERY_N(debug, 1000) << "Model not loaded";
+        return false;
+    }
+    return true;
+}
+
+bool OpenCVDnnNet::reshapeNetwork(unsigned int num, unsigned int channels, unsigned int height, unsigned int width) {
+    // cv::dnn reallocates layer buffers on the next forward when the input shape changes, the input
+    // blobs themselves are kept per shape so alternating between batch buckets doesn't allocate
+    const auto key = std::make_tuple(num, channels, height, width);
+    auto       itr = _input_blobs.find(key);
+    if (itr == _input_blobs.end()) {
+        if (_input_blobs.size() >= 8)
+            _input_blobs.clear();
+        const int shape[] = {static_cast<int>(num), static_cast<int>(channels), static_cast<int>(height), static_cast<int>(width)};
+        itr               = _input_blobs.emplace(key, cv::Mat(4, shape, CV_32F)).first;
+        ++_input_allocations;
+    }
+    _input_blob = itr->second;
+    return true;
+}
+
+cv::Scalar_<unsigned int> OpenCVDnnNet::getNetworkShape() const {
+    if (_input_blob.empty())
+        return cv::Scalar_<unsigned int>(1, 3, network_height, network_width);
+    return cv::Scalar_<unsigned int>(static_cast<unsigned int>(_input_blob.size[0]), static_cast<unsigned int>(_input_blob.size[1]),
+        static_cast<unsigned int>(_input_blob.size[2]), static_cast<unsigned int>(_input_blob.size[3]));
+}
+
+std::vector<std::vector<cv::cuda::GpuMat> > OpenCVDnnNet::getNetImageInput(int requested_batch_size) {
+    (void)requested_batch_size;
+    return std::vector<std::vector<cv::cuda::GpuMat> >();
+}
+
+std::vector<std::vector<cv::Mat> > OpenCVDnnNet::getNetImageInputHost(int requested_batch_size) {
+    (void)requested_batch_size;
+    if (_input_blob.empty()) {
+        const cv::Scalar_<unsigned int> shape = getNetworkShape();
+        reshapeNetwork(shape[0], shape[1], shape[2], shape[3]);
+    }
+    std::vector<std::vector<cv::Mat> > output;
+    const int num      = _input_blob.size[0];
+    const int channels = _input_blob.size[1];
+    const int height   = _input_blob.size[2];
+    const int width    = _input_blob.size[3];
+    float*    ptr      = _input_blob.ptr<float>();
+    for (int i = 0; i < num; ++i) {
+        std::vector<cv::Mat> planes;
+        for (int c = 0; c < channels; ++c) {
+            planes.emplace_back(height, width, CV_32F, ptr);
+            ptr += height * width;
+        }
+        if (swap_bgr && planes.size() == 3) {
+            std::swap(planes[0], planes[2]);
+        }
+        output.push_back(planes);
+    }
+    return output;
+}
+
+void OpenCVDnnNet::preBatch(int batch_size) {
+    (void)batch_size;
+    for (auto& handler : _net_handlers) {
+        handler->startBatch();
+    }
+}
+
+void OpenCVDnnNet::createHandlers() {
+    auto constructors = mo::MetaObjectFactory::instance()->getConstructors(Dnn::NetHandler::s_interfaceID);
+    // For each output, we check each handler and pick the handler with the highest priority
+    std::map<int, std::vector<std::pair<int, IObjectConstructor*> > > output_priority_map;
+    for (auto& constructor : constructors) {
+        auto info = dynamic_cast<Dnn::NetHandlerInfo*>(constructor->GetObjectInfo());
+        if (info) {
+            std::map<int, int> handled_outputs = info->CanHandleNetwork(_net, _output_names, _outputs);
+            for (auto& itr : handled_outputs) {
+                output_priority_map[itr.first].emplace_back(itr.second, constructor);
+            }
+        }
+    }
+    for (auto& itr : output_priority_map) {
+        std::sort(itr.second.begin(), itr.second.end(), [](const std::pair<int, IObjectConstructor*>& I1, const std::pair<int, IObjectConstructor*>& I2) {
+            return I1.first > I2.first;
+        });
+        if (itr.second.size() == 0) {
+            continue;
+        }
+        auto obj     = itr.second[0].second->Construct();
+        auto handler = dynamic_cast<Dnn::NetHandler*>(obj);
+        if (handler) {
+            handler->Init(true);
+            handler->setContext(this->getContext());
+            handler->setLabels(&this->labels);
+            _net_handlers.emplace_back(handler);
+            this->_algorithm_components.emplace_back(handler);
+            handler->setOutputBlob(_output_names, itr.first);
+            handler->startBatch();
+        } else {
+            delete obj;
+        }
+    }
+    if (_net_handlers.empty()) {
+        MO_LOG(warning) << "Unable to find a handler for any of the " << _outputs.size() << " network outputs";
+    }
+}
+
+cv::Mat OpenCVDnnNet::sliceOutput(const cv::Mat& output, size_t offset, size_t count) const {
+    const int batch = _input_blob.size[0];
+    if (offset == 0 && static_cast<int>(count) == batch) {
+        return output;
+    }
+    // Batch major outputs, eg classifier scores or segmentation maps
+    if (output.dims >= 2 && output.size[0] == batch) {
+        std::vector<cv::Range> ranges(static_cast<size_t>(output.dims), cv::Range::all());
+        ranges[0] = cv::Range(static_cast<int>(offset), static_cast<int>(offset + count));
+        return output(ranges.data());
+    }
+    // DetectionOutput style [1, 1, N, 7] where the first value of each row is the image index
+    if (output.dims == 4 && output.size[3] == 7) {
+        const float*       data = output.ptr<float>();
+        std::vector<float> rows;
+        for (int i = 0; i < output.size[2]; ++i) {
+            const float* det   = data + i * 7;
+            const float  image = det[0] - static_cast<float>(offset);
+            if (image >= 0.0f && image < static_cast<float>(count)) {
+                rows.push_back(image);
+                rows.insert(rows.end(), det + 1, det + 7);
+            }
+        }
+        const int shape[] = {1, 1, static_cast<int>(rows.size() / 7), 7};
+        cv::Mat   sliced(4, shape, CV_32F);
+        std::copy(rows.begin(), rows.end(), sliced.ptr<float>());
+        return sliced;
+    }
+    MO_LOG_FIRST_N(warning, 1) << "Unable to split an output of " << output.dims << " dimensions between batched frames";
+    return output;
+}
+
+void OpenCVDnnNet::postMiniBatch(const std::vector<cv::Rect>& batch_bb, const std::vector<DetectedObject2d>& dets) {
+    // Handlers are chosen from the output shapes, which are only known after the first forward pass
+    if (_net_handlers.empty()) {
+        createHandlers();
+    }
+    for (auto& handler : _net_handlers) {
+        auto itr = std::find(_output_names.begin(), _output_names.end(), handler->output_blob_name);
+        if (itr != _output_names.end()) {
+            const cv::Mat output = sliceOutput(_outputs[static_cast<size_t>(itr - _output_names.begin())], _minibatch_offset, batch_bb.size());
+            handler->handleOutput(output, batch_bb, currentInputParam(), dets);
+        }
+    }
+}
+
+void OpenCVDnnNet::postBatch() {
+    for (auto& handler : _net_handlers) {
+        handler->endBatch(currentInputParam().getTimestamp());
+    }
+}
+
+bool OpenCVDnnNet::forwardMinibatch() {
+    try {
+        _net.setInput(_input_blob);
+        _net.forward(_outputs, _output_names);
+    } catch (cv::Exception& e) {
+        MO_LOG_EVERY_N(warning, 100) << "Forward pass failed: " << e.what();
+        return false;
+    }
+    return true;
+}
+
+void OpenCVDnnNet::postSerializeInit() {
+    Node::postSerializeInit();
+    for (auto& component : _algorithm_components) {
+        rcc::shared_ptr<Dnn::NetHandler> handler(component);
+        if (handler) {
+            _net_handlers.push_back(handler);
+            handler->setLabels(&this->labels);
+            handler->setContext(this->getContext());
+        }
+    }
+}
+
+MO_REGISTER_CLASS(OpenCVDnnNet)
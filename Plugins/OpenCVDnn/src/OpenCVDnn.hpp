@@ -0,0 +1,57 @@
+#pragma once
+#include "DnnNetHandler.hpp"
+#include "OpenCVDnnExport.hpp"
+
+#include <INeuralNet.hpp>
+
+#include <Aquila/nodes/Node.hpp>
+#include <Aquila/types/ObjectDetection.hpp>
+
+#include <MetaObject/params/Types.hpp>
+
+#include <opencv2/dnn.hpp>
+
+#include <map>
+#include <tuple>
+
+namespace aq {
+namespace nodes {
+    // INeuralNet backend running on the CPU through cv::dnn. Loads any model cv::dnn::readNet
+    // understands (caffe prototxt + caffemodel, darknet, tensorflow) and preprocesses on the host.
+    class OpenCVDnn_EXPORT OpenCVDnnNet : public INeuralNet {
+    public:
+        MO_DERIVE(OpenCVDnnNet, INeuralNet)
+        PARAM(unsigned int, network_width, 300)
+        PARAM(unsigned int, network_height, 300)
+        PARAM(int, num_threads, 0)
+        TOOLTIP(num_threads, "Threads used by OpenCV for each layer, 0 keeps OpenCV's default. This is a process wide setting")
+        MO_END
+
+    protected:
+        virtual bool initNetwork();
+        virtual bool reshapeNetwork(unsigned int num, unsigned int channels, unsigned int height, unsigned int width);
+        virtual cv::Scalar_<unsigned int>                   getNetworkShape() const;
+        virtual std::vector<std::vector<cv::cuda::GpuMat> > getNetImageInput(int requested_batch_size = 1);
+        virtual std::vector<std::vector<cv::Mat> >          getNetImageInputHost(int requested_batch_size = 1);
+        virtual void preBatch(int batch_size);
+        virtual void postMiniBatch(const std::vector<cv::Rect>& batch_bb = std::vector<cv::Rect>(),
+            const std::vector<DetectedObject2d>&                dets     = std::vector<DetectedObject2d>());
+        virtual void postBatch();
+        virtual bool forwardMinibatch();
+        void postSerializeInit();
+
+        void createHandlers();
+        // Rows of output belonging to the rois [offset, offset + count) of the last forward pass
+        cv::Mat sliceOutput(const cv::Mat& output, size_t offset, size_t count) const;
+
+        cv::dnn::Net                                  _net;
+        bool                                          _net_loaded = false;
+        // NCHW input blob, getNetImageInputHost wraps its planes
+        cv::Mat                                       _input_blob;
+        std::map<std::tuple<unsigned int, unsigned int, unsigned int, unsigned int>, cv::Mat> _input_blobs;
+        std::vector<cv::String>                       _output_names;
+        std::vector<cv::Mat>                          _outputs;
+        std::vector<rcc::shared_ptr<Dnn::NetHandler> > _net_handlers;
+    };
+}
+}
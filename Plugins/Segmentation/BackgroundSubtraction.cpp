@@ -0,0 +1,366 @@
+#include "BackgroundSubtraction.h"
+#include "ParallelBands.h"
+#include <Aquila/nodes/NodeInfo.hpp>
+#include "MetaObject/params/detail/TInputParamPtrImpl.hpp"
+#include "MetaObject/params/detail/TParamPtrImpl.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace aq;
+using namespace aq::nodes;
+
+namespace
+{
+    typedef cv::v_float32x4 v_f32;
+
+    struct GroupConstants
+    {
+        explicit GroupConstants(const GaussianMixtureModel::Params& params, float alpha):
+            zero(cv::v_setzero_f32()),
+            one(cv::v_setall_f32(1.0f)),
+            eps(cv::v_setall_f32(1e-6f)),
+            alpha(cv::v_setall_f32(alpha)),
+            decay(cv::v_setall_f32(1.0f - alpha)),
+            prune(cv::v_setall_f32(alpha * params.complexity_reduction)),
+            tb(cv::v_setall_f32(params.var_threshold)),
+            tg(cv::v_setall_f32(params.var_threshold_gen)),
+            ratio(cv::v_setall_f32(params.background_ratio)),
+            var_init(cv::v_setall_f32(params.var_init)),
+            var_min(cv::v_setall_f32(params.var_min)),
+            var_max(cv::v_setall_f32(params.var_max)),
+            tau(cv::v_setall_f32(params.shadow_threshold)),
+            fg(cv::v_setall_f32(255.0f)),
+            shadow(cv::v_setall_f32(127.0f)),
+            shadows(params.detect_shadows)
+        {
+        }
+        v_f32 zero, one, eps, alpha, decay, prune, tb, tg, ratio, var_init, var_min, var_max, tau, fg, shadow;
+        bool  shadows;
+    };
+
+    // Mean of the heaviest mode per lane, the background image for 4 pixels
+    template<int CN>
+    void heaviestMean(const float* model, int K, const GroupConstants& consts, v_f32* bg)
+    {
+        const float* weights = model;
+        const float* means   = model + 2 * K * 4;
+        v_f32 heaviest   = consts.zero - consts.one;
+        v_f32 heaviest_k = consts.zero;
+        for (int k = 0; k < K; ++k)
+        {
+            const v_f32 w       = cv::v_load(weights + k * 4);
+            const v_f32 heavier = w > heaviest;
+            heaviest   = cv::v_select(heavier, w, heaviest);
+            heaviest_k = cv::v_select(heavier, cv::v_setall_f32(static_cast<float>(k)), heaviest_k);
+        }
+        for (int c = 0; c < CN; ++c)
+        {
+            v_f32 value = consts.zero;
+            for (int k = 0; k < K; ++k)
+            {
+                value = cv::v_select(heaviest_k == cv::v_setall_f32(static_cast<float>(k)),
+                                     cv::v_load(means + (k * CN + c) * 4), value);
+            }
+            bg[c] = value;
+        }
+    }
+
+    template<int CN>
+    void storeBackground(const v_f32* bg, int count, uchar* dst)
+    {
+        float planes[CN][4];
+        for (int c = 0; c < CN; ++c)
+            cv::v_store(planes[c], bg[c]);
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < CN; ++c)
+                dst[i * CN + c] = cv::saturate_cast<uchar>(planes[c][i]);
+        }
+    }
+
+    // Classifies and updates 4 pixels. x holds CN planes of 4 pixel values, lanes where active is false
+    // keep their model. Returns 255 / 127 / 0 per lane, bg receives the heaviest mean if not null.
+    template<int CN>
+    v_f32 updateGroup(float* model, int K, const v_f32* x, const v_f32& active, const GroupConstants& consts, v_f32* bg)
+    {
+        float* weights   = model;
+        float* variances = model + K * 4;
+        float* means     = model + 2 * K * 4;
+
+        v_f32 w[GaussianMixtureModel::MaxMixtures];
+        v_f32 var[GaussianMixtureModel::MaxMixtures];
+        v_f32 d2[GaussianMixtureModel::MaxMixtures];
+        for (int k = 0; k < K; ++k)
+        {
+            w[k]   = cv::v_load(weights + k * 4);
+            var[k] = cv::v_load(variances + k * 4);
+            v_f32 d = consts.zero;
+            for (int c = 0; c < CN; ++c)
+            {
+                const v_f32 diff = x[c] - cv::v_load(means + (k * CN + c) * 4);
+                d = d + diff * diff;
+            }
+            d2[k] = d;
+        }
+
+        // Classify against the model before it is updated
+        v_f32 is_background = consts.zero < consts.zero;
+        v_f32 is_shadow     = is_background;
+        for (int k = 0; k < K; ++k)
+        {
+            // Equal weights are ordered by mode index
+            v_f32 heavier = consts.zero;
+            for (int j = 0; j < K; ++j)
+            {
+                if (j == k)
+                    continue;
+                const v_f32 before = j < k ? (w[j] >= w[k]) : (w[j] > w[k]);
+                heavier = heavier + cv::v_select(before, w[j], consts.zero);
+            }
+            const v_f32 background_mode = (heavier < consts.ratio) & (w[k] > consts.zero);
+            is_background = is_background | (background_mode & (d2[k] < var[k] * consts.tb));
+            if (consts.shadows)
+            {
+                // Darker version of the mode within the threshold: x ~ a * mean with tau <= a <= 1
+                const float* mean = means + k * CN * 4;
+                v_f32 xm = consts.zero;
+                v_f32 mm = consts.zero;
+                for (int c = 0; c < CN; ++c)
+                {
+                    const v_f32 m = cv::v_load(mean + c * 4);
+                    xm = xm + x[c] * m;
+                    mm = mm + m * m;
+                }
+                const v_f32 a = xm / cv::v_max(mm, consts.eps);
+                v_f32 distortion = consts.zero;
+                for (int c = 0; c < CN; ++c)
+                {
+                    const v_f32 diff = x[c] - a * cv::v_load(mean + c * 4);
+                    distortion = distortion + diff * diff;
+                }
+                is_shadow = is_shadow | (background_mode & (a >= consts.tau) & (a <= consts.one) &
+                                         (distortion < var[k] * consts.tb * a * a));
+            }
+        }
+        const v_f32 foreground = cv::v_select(is_shadow, consts.shadow, consts.fg);
+        const v_f32 result     = cv::v_select(active, cv::v_select(is_background, consts.zero, foreground), consts.zero);
+
+        // Heaviest matching mode is updated, without a match the lightest mode is replaced
+        v_f32 best_w  = consts.zero - consts.one;
+        v_f32 best_k  = best_w;
+        v_f32 min_w   = w[0];
+        v_f32 min_k   = consts.zero;
+        for (int k = 0; k < K; ++k)
+        {
+            const v_f32 index = cv::v_setall_f32(static_cast<float>(k));
+            const v_f32 match = (d2[k] < var[k] * consts.tg) & (w[k] > consts.zero) & (w[k] > best_w);
+            best_w = cv::v_select(match, w[k], best_w);
+            best_k = cv::v_select(match, index, best_k);
+            const v_f32 lighter = w[k] < min_w;
+            min_w = cv::v_select(lighter, w[k], min_w);
+            min_k = cv::v_select(lighter, index, min_k);
+        }
+        const v_f32 unmatched = best_k < consts.zero;
+
+        v_f32 total = consts.zero;
+        for (int k = 0; k < K; ++k)
+        {
+            const v_f32 index    = cv::v_setall_f32(static_cast<float>(k));
+            const v_f32 is_best  = best_k == index;
+            const v_f32 replaced = unmatched & (min_k == index);
+
+            v_f32 nw = w[k] * consts.decay - consts.prune;
+            nw = cv::v_select(is_best, nw + consts.alpha, nw);
+            nw = cv::v_select(replaced, consts.alpha, cv::v_max(nw, consts.zero));
+            const v_f32 rho = consts.alpha / cv::v_max(nw, consts.eps);
+
+            float* mean = means + k * CN * 4;
+            for (int c = 0; c < CN; ++c)
+            {
+                const v_f32 m = cv::v_load(mean + c * 4);
+                v_f32 nm = cv::v_select(is_best, m + rho * (x[c] - m), m);
+                nm = cv::v_select(replaced, x[c], nm);
+                cv::v_store(mean + c * 4, cv::v_select(active, nm, m));
+            }
+            v_f32 nv = cv::v_select(is_best, var[k] + rho * (d2[k] - var[k]), var[k]);
+            nv = cv::v_min(cv::v_max(nv, consts.var_min), consts.var_max);
+            nv = cv::v_select(replaced, consts.var_init, nv);
+            cv::v_store(variances + k * 4, cv::v_select(active, nv, var[k]));
+            w[k]  = cv::v_select(active, nw, w[k]);
+            total = total + w[k];
+        }
+        const v_f32 scale = consts.one / cv::v_max(total, consts.eps);
+        for (int k = 0; k < K; ++k)
+            cv::v_store(weights + k * 4, w[k] * scale);
+        if (bg)
+            heaviestMean<CN>(model, K, consts, bg);
+        return result;
+    }
+}
+
+bool GaussianMixtureModel::matches(const cv::Mat& image, int mixtures) const
+{
+    return image.size() == _size && image.type() == _type && mixtures == _mixtures;
+}
+
+void GaussianMixtureModel::reset()
+{
+    _model.clear();
+    _size     = cv::Size();
+    _type     = -1;
+    _mixtures = 0;
+}
+
+template<int CN>
+void GaussianMixtureModel::applyRows(const cv::Mat& image, const cv::Mat& roi, cv::Mat& mask, cv::Mat* background,
+                                     float learning_rate, const Params& params, int y0, int y1)
+{
+    const int            K      = _mixtures;
+    const int            groups = (image.cols + 3) / 4;
+    const size_t         block  = static_cast<size_t>(K) * (2 + CN) * 4;
+    const GroupConstants constants(params, learning_rate);
+    float                planes[CN][4];
+    float                lanes[4];
+    float                out[4];
+    v_f32                x[CN];
+    v_f32                bg[CN];
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const uchar* src      = image.ptr<uchar>(y);
+        const uchar* roi_row  = roi.empty() ? nullptr : roi.ptr<uchar>(y);
+        uchar*       dst      = mask.ptr<uchar>(y);
+        uchar*       bg_row   = background ? background->ptr<uchar>(y) : nullptr;
+        float*       model    = _model.data() + static_cast<size_t>(y) * groups * block;
+        for (int g = 0; g < groups; ++g, model += block)
+        {
+            const int x0    = g * 4;
+            const int count = std::min(4, image.cols - x0);
+            bool      any   = false;
+            for (int i = 0; i < 4; ++i)
+            {
+                lanes[i] = i < count && (roi_row == nullptr || roi_row[x0 + i]) ? 1.0f : 0.0f;
+                any      = any || lanes[i] != 0.0f;
+            }
+            if (!any)
+            {
+                // Static region, the model is left as is
+                std::memset(dst + x0, 0, count);
+                if (bg_row)
+                {
+                    heaviestMean<CN>(model, K, constants, bg);
+                    storeBackground<CN>(bg, count, bg_row + x0 * CN);
+                }
+                continue;
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                const uchar* pixel = src + std::min(x0 + i, image.cols - 1) * CN;
+                for (int c = 0; c < CN; ++c)
+                    planes[c][i] = pixel[c];
+            }
+            for (int c = 0; c < CN; ++c)
+                x[c] = cv::v_load(planes[c]);
+            const v_f32 active = cv::v_load(lanes) > constants.zero;
+            cv::v_store(out, updateGroup<CN>(model, K, x, active, constants, bg_row ? bg : nullptr));
+            for (int i = 0; i < count; ++i)
+                dst[x0 + i] = static_cast<uchar>(out[i]);
+            if (bg_row)
+                storeBackground<CN>(bg, count, bg_row + x0 * CN);
+        }
+    }
+}
+
+void GaussianMixtureModel::apply(const cv::Mat& image, const cv::Mat& roi, cv::Mat& mask, cv::Mat* background,
+                                 float learning_rate, const Params& params)
+{
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3));
+    CV_Assert(roi.empty() || (roi.type() == CV_8UC1 && roi.size() == image.size()));
+    const int mixtures = std::min(std::max(params.mixtures, 1), static_cast<int>(MaxMixtures));
+    if (!matches(image, mixtures))
+    {
+        _size     = image.size();
+        _type     = image.type();
+        _mixtures = mixtures;
+        const size_t groups = static_cast<size_t>((image.cols + 3) / 4) * image.rows;
+        _model.assign(groups * mixtures * (2 + image.channels()) * 4, 0.0f);
+    }
+    mask.create(image.size(), CV_8UC1);
+    if (background)
+        background->create(image.size(), image.type());
+    learning_rate = std::min(std::max(learning_rate, 0.0f), 1.0f);
+
+    // Bands of about 16 rows so threads that finish early pick up more work
+    const int num_bands = std::max(1, std::min(cv::getNumThreads() * 4, image.rows / 16));
+    const int channels  = image.channels();
+    parallelBands(image.rows, num_bands, [&](int, int y0, int y1) {
+        if (channels == 3)
+            applyRows<3>(image, roi, mask, background, learning_rate, params, y0, y1);
+        else
+            applyRows<1>(image, roi, mask, background, learning_rate, params, y0, y1);
+    });
+}
+
+void MOG2CPU::resetModel()
+{
+    // Applied by the processing thread
+    _reset_requested = true;
+}
+
+float MOG2CPU::learningRate() const
+{
+    const int frames = _frame_count + 1;
+    if (learning_rate < 0.0)
+        return 1.0f / static_cast<float>(std::max(std::min(frames, history), 1));
+    if (frames <= warmup_frames)
+        return std::max(static_cast<float>(learning_rate), 1.0f / static_cast<float>(frames));
+    return static_cast<float>(learning_rate);
+}
+
+bool MOG2CPU::processImpl()
+{
+    const bool on_device = image->getSyncState() >= SyncedMemory::DEVICE_UPDATED ||
+                           (roi_mask && roi_mask->getSyncState() >= SyncedMemory::DEVICE_UPDATED);
+    const cv::Mat& img = image->getMat(stream());
+    cv::Mat roi;
+    if (roi_mask)
+        roi = roi_mask->getMat(stream());
+    if (on_device)
+        stream().waitForCompletion();
+    if (img.depth() != CV_8U || (img.channels() != 1 && img.channels() != 3))
+    {
+        MO_LOG_EVERY_N(warning, 100) << "Only 8 bit single and three channel images are supported";
+        return false;
+    }
+    if (roi_mask && (roi.type() != CV_8UC1 || roi.size() != img.size()))
+    {
+        MO_LOG_EVERY_N(warning, 100) << "roi_mask must be a CV_8UC1 image the size of the input, ignoring it";
+        roi = cv::Mat();
+    }
+    if (_reset_requested.exchange(false) || !_model.matches(img, std::min(std::max(mixtures, 1), static_cast<int>(GaussianMixtureModel::MaxMixtures))))
+    {
+        _model.reset();
+        _frame_count = 0;
+    }
+    GaussianMixtureModel::Params params;
+    params.mixtures       = mixtures;
+    params.var_threshold  = static_cast<float>(threshold);
+    params.detect_shadows = detect_shadows;
+    const float rate      = learningRate();
+
+    cv::Mat mask;
+    cv::Mat background_img;
+    const bool want_background = background_image_param.hasSubscriptions();
+    _model.apply(img, roi, mask, want_background ? &background_img : nullptr, rate, params);
+    ++_frame_count;
+
+    current_learning_rate_param.updateData(rate);
+    background_param.updateData(mask, image_param.getTimestamp(), _ctx.get());
+    if (want_background)
+        background_image_param.updateData(background_img, image_param.getTimestamp(), _ctx.get());
+    return true;
+}
+
+MO_REGISTER_CLASS(MOG2CPU)
@@ -0,0 +1,95 @@
+#pragma once
+#include "Aquila/nodes/Node.hpp"
+#include <Aquila/types/SyncedMemory.hpp>
+#include <MetaObject/object/detail/MetaObjectMacros.hpp>
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <vector>
+
+namespace aq{
+    namespace nodes{
+    // Per pixel Gaussian mixture background model (Zivkovic), the model of cv::BackgroundSubtractorMOG2
+    // with a fixed number of modes per pixel so groups of 4 pixels are updated together with SIMD
+    // instructions. Unused modes have zero weight. Instead of keeping each pixel's modes sorted by weight,
+    // a mode is part of the background if the heavier modes of the pixel sum to less than background_ratio.
+    class GaussianMixtureModel
+    {
+    public:
+        enum { MaxMixtures = 5 };
+        struct Params
+        {
+            int   mixtures             = 4;
+            // Squared Mahalanobis distance below which a pixel matches a background mode
+            float var_threshold        = 16.0f;
+            // Squared Mahalanobis distance below which a pixel updates a mode instead of creating one
+            float var_threshold_gen    = 9.0f;
+            float background_ratio     = 0.9f;
+            float var_init             = 15.0f;
+            float var_min              = 4.0f;
+            float var_max              = 75.0f;
+            // Weight every mode loses per update in units of the learning rate, prunes unsupported modes
+            float complexity_reduction = 0.05f;
+            bool  detect_shadows       = true;
+            // Minimum brightness of a shadow relative to the background
+            float shadow_threshold     = 0.5f;
+        };
+
+        // True if the model was built for images of this size and type with this many mixtures
+        bool matches(const cv::Mat& image, int mixtures) const;
+        void reset();
+
+        // image is CV_8UC1 or CV_8UC3. mask receives 255 for foreground, 127 for shadows and 0 for background.
+        // Pixels where roi is zero keep their model untouched and are reported as background, groups of 4
+        // pixels outside of the roi are skipped. roi may be empty. If background is not null it receives the
+        // mean of each pixel's heaviest mode.
+        void apply(const cv::Mat& image, const cv::Mat& roi, cv::Mat& mask, cv::Mat* background,
+                   float learning_rate, const Params& params);
+
+    private:
+        template<int CN>
+        void applyRows(const cv::Mat& image, const cv::Mat& roi, cv::Mat& mask, cv::Mat* background,
+                       float learning_rate, const Params& params, int y0, int y1);
+
+        // Per group of 4 pixels: weights, variances, then the means of each mode, each as 4 lanes
+        std::vector<float> _model;
+        cv::Size           _size;
+        int                _type     = -1;
+        int                _mixtures = 0;
+    };
+
+    // CPU counterpart of MOG2 with the same parameters and mask output, for machines without a GPU.
+    // Rows are split into bands over the OpenCV thread pool.
+    class MOG2CPU: public Node
+    {
+    public:
+        MO_DERIVE(MOG2CPU, Node)
+            INPUT(SyncedMemory, image, nullptr)
+            OPTIONAL_INPUT(SyncedMemory, roi_mask, nullptr)
+            PARAM(int, history, 500)
+            PARAM(double, threshold, 15)
+            TOOLTIP(threshold, "Squared Mahalanobis distance below which a pixel is background")
+            PARAM(bool, detect_shadows, true)
+            PARAM(double, learning_rate, -1.0)
+            TOOLTIP(learning_rate, "Negative uses 1 / min(frames, history)")
+            PARAM(int, warmup_frames, 0)
+            TOOLTIP(warmup_frames, "Frames after a reset over which the learning rate decays from 1 / frames to learning_rate, so the initial background is learned quickly")
+            PARAM(int, mixtures, 4)
+            TOOLTIP(mixtures, "Gaussians per pixel, 1 to 5. Memory and time grow linearly with it")
+            MO_SLOT(void, resetModel)
+            STATUS(float, current_learning_rate, 0.0f)
+            OUTPUT(SyncedMemory, background, SyncedMemory())
+            TOOLTIP(background, "Foreground mask, 255 foreground, 127 shadow, 0 background. Named after the output of MOG2")
+            OUTPUT(SyncedMemory, background_image, SyncedMemory())
+            TOOLTIP(background_image, "Mean of the heaviest mode of each pixel, only computed when connected")
+        MO_END;
+
+    protected:
+        bool processImpl();
+        float learningRate() const;
+
+        GaussianMixtureModel _model;
+        int                  _frame_count = 0;
+        std::atomic<bool>    _reset_requested{false};
+    };
+    }
+}
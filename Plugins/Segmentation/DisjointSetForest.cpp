@@ -28,6 +28,79 @@
 #include <algorithm>
 
 
+void EdgeList::resize( size_t n ) {
+    a.resize( n );
+    b.resize( n );
+    weight.resize( n );
+    key.resize( n );
+}
+
+size_t EdgeList::size() const {
+    return a.size();
+}
+
+void EdgeList::sort() {
+    const int n         = static_cast<int>( size() );
+    const int num_bands = std::max( 1, std::min( cv::getNumThreads(), n / 65536 ) );
+    order.resize( n );
+    scratch.resize( n );
+    std::vector<int> histograms( num_bands * 256 );
+
+    /* Pass 0 reads keys in edge order and writes edge indices into scratch,
+       pass 1 reads through scratch and writes the final permutation into order */
+    for( int pass = 0; pass < 2; pass++ ) {
+        const int shift = pass * 8;
+        const uint32_t* src = pass == 0 ? nullptr : scratch.data();
+        uint32_t* dst       = pass == 0 ? scratch.data() : order.data();
+
+        std::fill( histograms.begin(), histograms.end(), 0 );
+        parallelBands( n, num_bands, [&]( int band, int begin, int end ) {
+            int* hist = &histograms[band * 256];
+            for( int i = begin; i < end; i++ ) {
+                uint32_t e = src ? src[i] : i;
+                hist[( key[e] >> shift ) & 0xFF]++;
+            }
+        });
+
+        /* Digit major, band minor prefix sum keeps the sort stable */
+        int offset = 0;
+        for( int digit = 0; digit < 256; digit++ ) {
+            for( int band = 0; band < num_bands; band++ ) {
+                int count = histograms[band * 256 + digit];
+                histograms[band * 256 + digit] = offset;
+                offset += count;
+            }
+        }
+
+        parallelBands( n, num_bands, [&]( int band, int begin, int end ) {
+            int* offsets = &histograms[band * 256];
+            for( int i = begin; i < end; i++ ) {
+                uint32_t e = src ? src[i] : i;
+                dst[offsets[( key[e] >> shift ) & 0xFF]++] = e;
+            }
+        });
+    }
+
+    /* Gather every array into sorted order */
+    std::vector<int> sorted_a( n ), sorted_b( n );
+    std::vector<float> sorted_weight( n );
+    std::vector<uint16_t> sorted_key( n );
+    parallelBands( n, num_bands, [&]( int, int begin, int end ) {
+        for( int i = begin; i < end; i++ ) {
+            uint32_t e       = order[i];
+            sorted_a[i]      = a[e];
+            sorted_b[i]      = b[e];
+            sorted_weight[i] = weight[e];
+            sorted_key[i]    = key[e];
+        }
+    });
+    a.swap( sorted_a );
+    b.swap( sorted_b );
+    weight.swap( sorted_weight );
+    key.swap( sorted_key );
+}
+
+
 DisjointSetForest::DisjointSetForest() {
 }
 
@@ -39,45 +112,47 @@ DisjointSetForest::DisjointSetForest( int no_of_elements ) {
  * Initialize the forest
  */
 void DisjointSetForest::init( int no_of_elements ) {
-    this->elements.clear();
-    this->elements.resize( no_of_elements );
+    this->parent.resize( no_of_elements );
+    this->rank.assign( no_of_elements, 0 );
+    this->sizes.assign( no_of_elements, 1 );
     this->num = no_of_elements;
     
-    for( int i = 0; i < no_of_elements; i++ ) {
-        elements[i].rank    = 0;
-        elements[i].size    = 1;
-        elements[i].parent  = i;
-    }
+    for( int i = 0; i < no_of_elements; i++ )
+        parent[i] = i;
 }
 
 DisjointSetForest::~DisjointSetForest() {
 }
 
 /**
- * Find a given set inside the forest
+ * Find a given set inside the forest, every node on the path is pointed at the root
  */
 int DisjointSetForest::find( int x ) {
-    int y = x;
-    while( y != elements[y].parent )
-        y = elements[y].parent;
-    elements[x].parent = y;
-    return y;
+    int root = x;
+    while( root != parent[root] )
+        root = parent[root];
+    while( x != root ) {
+        int next  = parent[x];
+        parent[x] = root;
+        x         = next;
+    }
+    return root;
 }
 
 /**
  * Join two sets together
  */
 void DisjointSetForest::join( int x, int y ) {
-    if ( elements[x].rank > elements[y].rank ) {
-        elements[y].parent  = x;
-        elements[x].size    += elements[y].size;
+    if ( rank[x] > rank[y] ) {
+        parent[y] = x;
+        sizes[x]  += sizes[y];
     }
     else {
-        elements[x].parent  = y;
-        elements[y].size    += elements[x].size;
+        parent[x] = y;
+        sizes[y]  += sizes[x];
         
-        if( elements[x].rank == elements[y].rank )
-            elements[y].rank++;
+        if( rank[x] == rank[y] )
+            rank[y]++;
     }
     num--;
 }
@@ -86,7 +161,7 @@ void DisjointSetForest::join( int x, int y ) {
  * Returns the size of the set
  */
 int DisjointSetForest::size( int x ) {
-    return elements[x].size;
+    return sizes[x];
 }
 
 /**
@@ -99,26 +174,25 @@ int DisjointSetForest::noOfElements() {
 /**
  * Segment the graph based on the weight of each edges
  */
-void DisjointSetForest::segmentGraph( int no_of_vertices, int no_of_edges, std::vector<Edge>& edges, float c ) {
+void DisjointSetForest::segmentGraph( int no_of_vertices, EdgeList& edges, float c ) {
     init( no_of_vertices );
     
-    std::sort( edges.begin(), edges.end(), []( const Edge& a, const Edge& b){
-        return a.weight < b.weight;
-    });
+    edges.sort();
     
-    std::vector<float> thresholds( no_of_vertices, c );
+    thresholds.assign( no_of_vertices, c );
 
-    for( Edge& edge: edges ){
-        int a = this->find( edge.a );
-        int b = this->find( edge.b );
+    const size_t no_of_edges = edges.size();
+    for( size_t i = 0; i < no_of_edges; i++ ){
+        int a = this->find( edges.a[i] );
+        int b = this->find( edges.b[i] );
         
         if( a != b ) {
-            
+            const float weight = edges.weight[i];
             /* If the weight is below respective threshold, union both sets together */
-            if( edge.weight <= thresholds[a] && edge.weight <= thresholds[b] ) {
+            if( weight <= thresholds[a] && weight <= thresholds[b] ) {
                 this->join( a, b );
                 a = this->find( a );
-                thresholds[a] = edge.weight + c / this->size( a );
+                thresholds[a] = weight + c / this->size( a );
             }
         }
     }
@@ -27,8 +27,11 @@
 #ifndef __EfficientGraphBasedImageSegmentation__SegmentGraph__
 #define __EfficientGraphBasedImageSegmentation__SegmentGraph__
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "ParallelBands.h"
 #include "RuntimeObjectSystem/RuntimeInclude.h"
 #include "RuntimeObjectSystem/RuntimeSourceDependency.h"
 RUNTIME_MODIFIABLE_INCLUDE;
@@ -36,25 +39,28 @@ RUNTIME_COMPILER_SOURCEDEPENDENCY_FILE("DisjointSetForest", ".cpp");
 
 
 /**
- * Set within the disjoint forest
+ * Weighted edges stored as a structure of arrays. key holds the weight quantized
+ * to 1/128 so the edges can be radix sorted, weights above 511 share the last key.
  */
-struct SetNode {
-    int rank;
-    int parent;
-    int size;
-};
+struct EdgeList {
+    std::vector<int>      a;
+    std::vector<int>      b;
+    std::vector<float>    weight;
+    std::vector<uint16_t> key;
 
-/**
- * Represents a weighted edge
- */
-struct Edge {
-    int a;
-    int b;
-    float weight;
-    
-    bool operator<( const Edge& other ) {
-        return weight < other.weight;
+    void resize( size_t n );
+    size_t size() const;
+
+    static inline uint16_t quantize( float weight ) {
+        return static_cast<uint16_t>( std::min( weight * 128.0f, 65535.0f ) );
     }
+
+    /* Stable LSD radix sort on key, two 8 bit passes */
+    void sort();
+
+private:
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> scratch;
 };
 
 
@@ -74,10 +80,14 @@ public:
     int size( int x );
     int noOfElements();
     
-    void segmentGraph( int no_of_vertices, int no_of_edges, std::vector<Edge>& edges, float c );
+    /* Sorts edges in place and merges components */
+    void segmentGraph( int no_of_vertices, EdgeList& edges, float c );
     
 private:
-   std::vector<SetNode> elements;
+    std::vector<int>   parent;
+    std::vector<int>   rank;
+    std::vector<int>   sizes;
+    std::vector<float> thresholds;
     int num;
 };
 
@@ -27,10 +27,76 @@
 
 
 #include "EGBS.h"
-#include <map>
+#include "ParallelBands.h"
+#include <Aquila/nodes/NodeInfo.hpp>
+#include "MetaObject/params/detail/TInputParamPtrImpl.hpp"
+#include "MetaObject/params/detail/TParamPtrImpl.hpp"
+#include <cmath>
 
 using namespace aq;
 
+namespace {
+/* Number of edges starting in row y: right, down, down-right and up-right neighbours */
+inline size_t edgesInRow( int y, int width, int height ) {
+    size_t count = width - 1;
+    if( y < height - 1 )
+        count += width + width - 1;
+    if( y > 0 )
+        count += width - 1;
+    return count;
+}
+
+/**
+ * L2 norm of the difference between two CN channel pixels
+ */
+template<int CN>
+inline float diff( const float* p, const float* q ) {
+    float sum = 0.0f;
+    for( int c = 0; c < CN; c++ ) {
+        float d = p[c] - q[c];
+        sum += d * d;
+    }
+    return std::sqrt( sum );
+}
+
+template<int CN>
+void buildEdgeRows( const cv::Mat& smoothed, EdgeList& edges, const std::vector<size_t>& row_start, int y0, int y1 ) {
+    const int width  = smoothed.cols;
+    const int height = smoothed.rows;
+    int* a           = edges.a.data();
+    int* b           = edges.b.data();
+    float* weight    = edges.weight.data();
+    uint16_t* key    = edges.key.data();
+
+    for( int y = y0; y < y1; y++ ) {
+        size_t e           = row_start[y];
+        const float* row   = smoothed.ptr<float>( y );
+        const float* below = y < height - 1 ? smoothed.ptr<float>( y + 1 ) : nullptr;
+        const float* above = y > 0 ? smoothed.ptr<float>( y - 1 ) : nullptr;
+        for( int x = 0; x < width; x++ ) {
+            const int idx = y * width + x;
+            const float* p = row + x * CN;
+            if( x < width - 1 ) {
+                a[e] = idx; b[e] = idx + 1; weight[e] = diff<CN>( p, p + CN );
+                key[e] = EdgeList::quantize( weight[e] ); e++;
+            }
+            if( below ) {
+                a[e] = idx; b[e] = idx + width; weight[e] = diff<CN>( p, below + x * CN );
+                key[e] = EdgeList::quantize( weight[e] ); e++;
+                if( x < width - 1 ) {
+                    a[e] = idx; b[e] = idx + width + 1; weight[e] = diff<CN>( p, below + ( x + 1 ) * CN );
+                    key[e] = EdgeList::quantize( weight[e] ); e++;
+                }
+            }
+            if( above && x < width - 1 ) {
+                a[e] = idx; b[e] = idx - width + 1; weight[e] = diff<CN>( p, above + ( x + 1 ) * CN );
+                key[e] = EdgeList::quantize( weight[e] ); e++;
+            }
+        }
+    }
+}
+}
+
 EGBS::EGBS() {
     
 }
@@ -40,81 +106,80 @@ EGBS::~EGBS() {
 }
 
 /**
- * Calculate the difference between two (3 channels) pixels, by 
- * taking the L2 norm of their differences.
+ * Create edges between each pixel and its right, lower, lower right and upper right
+ * neighbours, with the weight as the L2 norm between the color channels of the pixels.
+ * Each band of rows writes to a precomputed range so the layout matches a serial build.
  */
-float EGBS::diff( cv::Mat& rgb, int x1, int y1, int x2, int y2 ) {
-    cv::Vec3f pix1 = rgb.at<cv::Vec3f>(y1, x1);
-    cv::Vec3f pix2 = rgb.at<cv::Vec3f>(y2, x2);
-    return sqrt( (pix1 - pix2).dot((pix1 - pix2)) );
+void EGBS::buildEdges( const cv::Mat& smoothed ) {
+    const int width  = imageSize.width;
+    const int height = imageSize.height;
+    std::vector<size_t> row_start( height + 1, 0 );
+    for( int y = 0; y < height; y++ )
+        row_start[y + 1] = row_start[y] + edgesInRow( y, width, height );
+    edges.resize( row_start[height] );
+
+    const int num_bands = std::max( 1, std::min( cv::getNumThreads() * 4, height / 8 ) );
+    const int channels  = smoothed.channels();
+    parallelBands( height, num_bands, [&]( int, int y0, int y1 ) {
+        if( channels == 3 )
+            buildEdgeRows<3>( smoothed, edges, row_start, y0, y1 );
+        else
+            buildEdgeRows<1>( smoothed, edges, row_start, y0, y1 );
+    });
 }
 
 /**
  * Apply segmentation
  */
-int EGBS::applySegmentation( cv::Mat& image, float sigma, float threshold, int min_component_size ) {
-    this->image = image.clone();
+int EGBS::applySegmentation( const cv::Mat& image, float sigma, float threshold, int min_component_size ) {
+    CV_Assert( image.depth() == CV_8U && ( image.channels() == 1 || image.channels() == 3 ) );
+    this->image = image;
     this->imageSize = image.size();
     
     /* Apply gaussian blur to smoothen the image */
     cv::Mat smoothed;
-    image.convertTo( smoothed, CV_32FC1 );
+    image.convertTo( smoothed, CV_32F );
     GaussianBlur( smoothed, smoothed, cv::Size(5,5), sigma );
     
-    std::vector<Edge> edges( imageSize.area() * 4 );
-    int no_of_edges = 0;
+    buildEdges( smoothed );
     
-    /* Create edges between each pixels, with the weight as the L2 norm between each color channels of the pixels */
-    for( int y = 0; y < imageSize.height; y++ ) {
-        for( int x = 0; x < imageSize.width; x++ ) {
-            if( x < imageSize.width - 1 ){
-                edges[no_of_edges].a        = y * imageSize.width + x;
-                edges[no_of_edges].b        = y * imageSize.width + (x + 1);
-                edges[no_of_edges].weight   = diff( smoothed, x, y, x + 1, y );
-                no_of_edges++;
-            }
-
-            if( y < imageSize.height - 1 ) {
-                edges[no_of_edges].a        = y       * imageSize.width + x;
-                edges[no_of_edges].b        = (y + 1) * imageSize.width + x;
-                edges[no_of_edges].weight   = diff( smoothed, x, y, x, y + 1 );
-                no_of_edges++;
-            }
-
-            if( (x < imageSize.width - 1) && (y < imageSize.height - 1) ) {
-                edges[no_of_edges].a        = y       * imageSize.width + x;
-                edges[no_of_edges].b        = (y + 1) * imageSize.width + (x + 1);
-                edges[no_of_edges].weight   = diff( smoothed, x, y, x + 1, y + 1 );
-                no_of_edges++;
-            }
-
-            if( (x < imageSize.width - 1) && (y > 0) ) {
-                edges[no_of_edges].a        = y       * imageSize.width + x;
-                edges[no_of_edges].b        = (y - 1) * imageSize.width + (x + 1);
-                edges[no_of_edges].weight   = diff( smoothed, x, y, x + 1, y - 1 );
-                no_of_edges++;
-            }
-        }
-    }
-    
-    /* Resize the vector, since we over-initialized it */
-    edges.resize( no_of_edges );
-    
-    /* Apply segmentation on the edges */
-    forest.segmentGraph( imageSize.height * imageSize.width, no_of_edges, edges, threshold );
+    /* Apply segmentation on the edges, this leaves edges sorted by weight */
+    forest.segmentGraph( imageSize.height * imageSize.width, edges, threshold );
 
     /* Union all the smaller sets */
-    for( Edge& edge: edges ) {
-        int a = forest.find( edge.a );
-        int b = forest.find( edge.b );
+    const size_t no_of_edges = edges.size();
+    for( size_t i = 0; i < no_of_edges; i++ ) {
+        int a = forest.find( edges.a[i] );
+        int b = forest.find( edges.b[i] );
         if( (a != b) && (( forest.size(a) < min_component_size) || (forest.size(b) < min_component_size)) ) {
             forest.join( a, b );
         }
     }
     
+    relabel();
     return forest.noOfElements();
 }
 
+/**
+ * Map every pixel's root to a dense component index
+ */
+void EGBS::relabel() {
+    const int n = imageSize.area();
+    labelImage.create( imageSize, CV_32SC1 );
+    int* labels = labelImage.ptr<int>();
+    std::vector<int> root_label( n, -1 );
+    labelCount = 0;
+    for( int i = 0; i < n; i++ ) {
+        int root = forest.find( i );
+        if( root_label[root] < 0 )
+            root_label[root] = labelCount++;
+        labels[i] = root_label[root];
+    }
+}
+
+const cv::Mat& EGBS::labels() const {
+    return labelImage;
+}
 
 int EGBS::noOfConnectedComponents() {
     return forest.noOfElements();
@@ -124,49 +189,48 @@ int EGBS::noOfConnectedComponents() {
  * Recolor the image based on either average color of each cluster, or randomized color scheme
  */
 cv::Mat EGBS::recolor( bool random_color) {
-    cv::Mat result( imageSize, CV_8UC3, cv::Scalar(0, 0, 0) );
-    std::map<int, cv::Vec3f> colors;
+    cv::Mat result( imageSize, CV_8UC3 );
+    std::vector<cv::Vec3b> colors( labelCount );
     
     if( !random_color ){
-        std::map<int, int> count;
+        cv::Mat bgr = image;
+        if( image.channels() == 1 )
+            cv::cvtColor( image, bgr, cv::COLOR_GRAY2BGR );
+        std::vector<cv::Vec3f> sums( labelCount, cv::Vec3f( 0, 0, 0 ) );
+        std::vector<int> count( labelCount, 0 );
         
         /* If it's not random coloring, color based on the average of each clusters */
-        for(int y = 0; y < imageSize.height; y++ ) {
-            cv::Vec3b * ptr = image.ptr<cv::Vec3b>(y);
-            
-            for(int x = 0; x < imageSize.width; x++ ) {
-                int component = forest.find( y * imageSize.width + x );
-                colors[component] += ptr[x];
-                count[component]++;
+        for( int y = 0; y < imageSize.height; y++ ) {
+            const cv::Vec3b* ptr = bgr.ptr<cv::Vec3b>( y );
+            const int* label     = labelImage.ptr<int>( y );
+            for( int x = 0; x < imageSize.width; x++ ) {
+                sums[label[x]] += cv::Vec3f( ptr[x][0], ptr[x][1], ptr[x][2] );
+                count[label[x]]++;
             }
         }
         
         /* Averaging the color */
-        for( auto itr : colors )
-            colors[itr.first] /= count[itr.first];
+        for( int i = 0; i < labelCount; i++ ) {
+            cv::Vec3f color = sums[i] / static_cast<float>( std::max( count[i], 1 ) );
+            colors[i]       = cv::Vec3b( cv::saturate_cast<uchar>( color[0] ), cv::saturate_cast<uchar>( color[1] ), cv::saturate_cast<uchar>( color[2] ) );
+        }
     }
     else {
         /* Else just randomize the colors */
-        for(int y = 0; y < imageSize.height; y++ ) {
-            for(int x = 0; x < imageSize.width; x++ ) {
-                int component = forest.find( y * imageSize.width + x );
-                if( colors.count( component ) == 0 )
-                    colors[component] = cv::Vec3f( rand() % 255, rand() % 255, rand() % 255 );
-            }
-        }
+        cv::RNG& rng = cv::theRNG();
+        for( int i = 0; i < labelCount; i++ )
+            colors[i] = cv::Vec3b( rng.uniform( 0, 255 ), rng.uniform( 0, 255 ), rng.uniform( 0, 255 ) );
     }
     
     /* Recolor the image */
-    for(int y = 0; y < imageSize.height; y++ ) {
-        cv::Vec3b * ptr = result.ptr<cv::Vec3b>(y);
-        
-        for(int x = 0; x < imageSize.width; x++ ) {
-            int component = forest.find( y * imageSize.width + x );
-            cv::Vec3f color = colors[component];
-            ptr[x] = cv::Vec3b( color[0], color[1], color[2] );
+    parallelBands( imageSize.height, cv::getNumThreads(), [&]( int, int y0, int y1 ) {
+        for( int y = y0; y < y1; y++ ) {
+            cv::Vec3b* ptr   = result.ptr<cv::Vec3b>( y );
+            const int* label = labelImage.ptr<int>( y );
+            for( int x = 0; x < imageSize.width; x++ )
+                ptr[x] = colors[label[x]];
         }
-    }
-
+    });
 
     return result;
 }
@@ -174,26 +238,24 @@ cv::Mat EGBS::recolor( bool random_color) {
 
 using namespace aq;
 using namespace aq::nodes;
-/*void SegmentEGBS::nodeInit(bool firstInit)
-{
-    updateParameter("Sigma", float(0.5));;
-    updateParameter("Threshold", float(1500));
-    updateParameter("Min component size", int(20));
-    updateParameter("Recolor", false);
-}
-cv::cuda::GpuMat SegmentEGBS::doProcess(cv::cuda::GpuMat &img, cv::cuda::Stream &stream)
+
+bool SegmentEGBS::processImpl()
 {
-    float sigma = *getParameter<float>(0)->Data();
-    float thresh = *getParameter<float>(1)->Data();
-    int minSize = *getParameter<int>(2)->Data();
-    img.download(h_buf, stream);
-    stream.waitForCompletion();
-    cv::Mat mat = h_buf.createMatHeader();
-    egbs.applySegmentation(mat, sigma, thresh, minSize);
-    cv::Mat result = egbs.recolor(*getParameter<bool>(3)->Data());
-    img.upload(result, stream);
-    return img; 
+    if(image->getDepth() != CV_8U || (image->getChannels() != 1 && image->getChannels() != 3))
+    {
+        MO_LOG_EVERY_N(debug, 100) << "SegmentEGBS expects a CV_8UC1 or CV_8UC3 image";
+        return false;
+    }
+    const cv::Mat& mat = image->getMat(stream());
+    stream().waitForCompletion();
+    egbs.applySegmentation(mat, sigma, threshold, min_component_size);
+    num_components_param.updateData(egbs.noOfConnectedComponents(), image_param.getTimestamp(), _ctx.get());
+    labels_param.updateData(egbs.labels().clone(), image_param.getTimestamp(), _ctx.get());
+    if(output_param.hasSubscriptions())
+    {
+        output_param.updateData(egbs.recolor(random_color), image_param.getTimestamp(), _ctx.get());
+    }
+    return true;
 }
 
-NODE_DEFAULT_CONSTRUCTOR_IMPL(SegmentEGBS, Image, Processing, Segmentation)
-*/
+MO_REGISTER_CLASS(SegmentEGBS)
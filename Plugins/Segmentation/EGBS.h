@@ -27,6 +27,7 @@
 #ifndef __EfficientGraphBasedImageSegmentation__EGBS__
 #define __EfficientGraphBasedImageSegmentation__EGBS__
 #include "Aquila/nodes/Node.hpp"
+#include <Aquila/types/SyncedMemory.hpp>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include "DisjointSetForest.h"
@@ -37,15 +38,23 @@ public:
     EGBS();
     ~EGBS();
     
-    int applySegmentation( cv::Mat& image, float sigma, float threshold, int min_component_size );
+    /* image is CV_8UC1 or CV_8UC3 */
+    int applySegmentation( const cv::Mat& image, float sigma, float threshold, int min_component_size );
     cv::Mat recolor( bool random_color = false );
+    /* Component of each pixel numbered 0 .. noOfConnectedComponents() - 1, CV_32SC1 */
+    const cv::Mat& labels() const;
     int noOfConnectedComponents();
     
 protected:
+    void buildEdges( const cv::Mat& smoothed );
+    void relabel();
+
     cv::Mat image;
     cv::Size imageSize;
     DisjointSetForest forest;
-    inline float diff( cv::Mat& rgb, int x1, int y1, int x2, int y2 );
+    EdgeList edges;
+    cv::Mat labelImage;
+    int labelCount = 0;
 };
 
 
@@ -53,15 +62,22 @@ namespace aq
 {
     namespace nodes
     {
-    
     class SegmentEGBS: public Node
     {
-        EGBS egbs;
-        cv::cuda::HostMem h_buf;
     public:
-        SegmentEGBS();
-        //virtual void nodeInit(bool firstInit);
-        //virtual cv::cuda::GpuMat doProcess(cv::cuda::GpuMat &img, cv::cuda::Stream &stream);
+        MO_DERIVE(SegmentEGBS, Node)
+            INPUT(SyncedMemory, image, nullptr)
+            PARAM(float, sigma, 0.5f)
+            PARAM(float, threshold, 1500.0f)
+            PARAM(int, min_component_size, 20)
+            PARAM(bool, random_color, false)
+            OUTPUT(SyncedMemory, labels, SyncedMemory())
+            OUTPUT(SyncedMemory, output, SyncedMemory())
+            STATUS(int, num_components, 0)
+        MO_END;
+    protected:
+        bool processImpl();
+        EGBS egbs;
     };
     }
 }
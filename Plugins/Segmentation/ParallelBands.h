@@ -0,0 +1,35 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+/**
+ * Runs body( band, begin, end ) for num_bands contiguous bands covering [0, count)
+ * on the OpenCV thread pool
+ */
+template<class F>
+class BandLoopBody: public cv::ParallelLoopBody {
+public:
+    BandLoopBody( int count, int num_bands, const F& body ):
+        count( count ), num_bands( num_bands ), body( body ) {
+    }
+
+    void operator()( const cv::Range& range ) const {
+        for( int band = range.start; band < range.end; band++ ) {
+            int begin = static_cast<int>( static_cast<int64_t>( count ) * band / num_bands );
+            int end   = static_cast<int>( static_cast<int64_t>( count ) * ( band + 1 ) / num_bands );
+            body( band, begin, end );
+        }
+    }
+
+private:
+    int count;
+    int num_bands;
+    const F& body;
+};
+
+template<class F>
+void parallelBands( int count, int num_bands, const F& body ) {
+    num_bands = std::max( 1, std::min( num_bands, count ) );
+    cv::parallel_for_( cv::Range( 0, num_bands ), BandLoopBody<F>( count, num_bands, body ), num_bands );
+}
@@ -4,7 +4,10 @@
 #include <Aquila/rcc/external_includes/cv_cudaarithm.hpp>
 #include <Aquila/rcc/external_includes/cv_cudalegacy.hpp>
 #include <Aquila/nodes/NodeInfo.hpp>
+#include <ImgProc/HistogramHost.hpp>
 #include "RuntimeObjectSystem/RuntimeLinkLibrary.h"
+#include <cmath>
+#include <limits>
 #ifdef FASTMS_FOUND
 #ifdef _DEBUG
 RUNTIME_COMPILER_LINKLIBRARY("-lfastmsd")
@@ -24,133 +27,129 @@ bool OtsuThreshold::processImpl()
         MO_LOG_EVERY_N(warning, 100) << "Currently only supports single channel images!";
         return false;
     }
-    cv::cuda::GpuMat hist;
-    if(!histogram)
+    const int depth = image->getDepth();
+    const bool on_device = image->getSyncState() >= SyncedMemory::DEVICE_UPDATED ||
+                           (mask && mask->getSyncState() >= SyncedMemory::DEVICE_UPDATED);
+    // cv::cuda::histRange has no mask or 16 bit float levels, and small images are cheaper to download
+    const bool on_host = !on_device || mask || (depth != CV_8U && depth != CV_32F) ||
+                         image->getSize().area() <= host_max_pixels;
+    cv::Mat h_image, h_mask;
+    if(on_host)
     {
-        cv::Mat h_levels(1,200,CV_32F);
-        double minVal, maxVal;
-        cv::cuda::minMax(image->getGpuMat(stream()), &minVal, &maxVal);
-        // Generate 300 equally spaced bins over the space
-        float step = float((maxVal - minVal) / float(200));
-
-        float val = minVal;
-        for(int i = 0; i < 200; ++i, val += step)
+        h_image = image->getMat(stream());
+        if(mask)
+            h_mask = mask->getMat(stream());
+        if(on_device)
+            stream().waitForCompletion();
+        if(!h_mask.empty() && (h_mask.type() != CV_8UC1 || h_mask.size() != h_image.size()))
         {
-            h_levels.at<float>(i) = val;
+            MO_LOG_EVERY_N(warning, 100) << "mask must be CV_8UC1 with the size of the image";
+            return false;
         }
-        cv::cuda::histRange(image->getGpuMat(stream()), hist, cv::cuda::GpuMat(h_levels), stream());
-    }else{
-        if(range == nullptr){
+    }
+
+    cv::Mat hist;  // counts, one row
+    cv::Mat edges; // bin edges, CV_32F
+    if(histogram)
+    {
+        if(range == nullptr)
+        {
             MO_LOG_EVERY_N(error, 100) << "Histogram provided but range not provided";
             return false;
         }
-        if(range->getChannels() != 1){
+        if(range->getChannels() != 1)
+        {
             MO_LOG_EVERY_N(error, 100) << "Currently only support equal bins accross all histograms";
             return false;
         }
-        hist = histogram->getGpuMat(stream());
-    }
-    // Normalize histogram
-    hist.convertTo(hist, CV_32F, 1 / float(image->getSize().area()), 0, stream());
-    cv::cuda::HostMem h_hist;
-    hist.download(h_hist, stream());
-    stream().waitForCompletion();
-    cv::Mat h_hist_ = h_hist.createMatHeader();
-    int channels = h_hist_.channels();
-    std::vector<double> optValue(channels);
-
-
-    if (channels == 1)
+        hist = histogram->getMat(stream()).row(0);
+        range->getMat(stream()).reshape(1, 1).convertTo(edges, CV_32F);
+        stream().waitForCompletion();
+        if(hist.channels() != 1 || edges.cols < hist.cols)
+        {
+            MO_LOG_EVERY_N(error, 100) << "Histogram must be single channel with a range entry per bin";
+            return false;
+        }
+    }else
     {
-        float prbn = 0;  // First order cumulative
-        float meanItr = 0; // Second order cumulative
-        float meanGlb = 0; // Global mean level
-        float param1 = 0;
-        float param2 = 0;
-        double param3 = 0;
-        double optThresh = 0;
-
-        for (int i = 0; i < h_hist_.size().area(); ++i)
+        double min_val = 0, max_val = 256;
+        int num_bins = 256;
+        if(depth != CV_8U)
         {
-            meanGlb += h_hist_.at<float>(i)*i;
+            if(on_host)
+                cv::minMaxLoc(h_image, &min_val, &max_val, nullptr, nullptr, h_mask);
+            else
+                cv::cuda::minMax(image->getGpuMat(stream()), &min_val, &max_val);
+            // Upper edge just above the max so the max is counted
+            max_val = std::nextafter(static_cast<float>(max_val), std::numeric_limits<float>::max());
+            num_bins = std::max(bins, 2);
         }
-
-        // Currently we only support equal bins accross all channels
-        float val = 0;
-        cv::Mat bins = range->getMat(stream());
-        for (int i = 0; i < bins.cols - 1; ++i)
+        edges.create(1, num_bins + 1, CV_32F);
+        const double step = (max_val - min_val) / num_bins;
+        for(int i = 0; i < num_bins; ++i)
+            edges.at<float>(i) = static_cast<float>(min_val + i * step);
+        edges.at<float>(num_bins) = static_cast<float>(max_val);
+        if(on_host)
         {
-            val = h_hist_.at<float>(i);
-            prbn += val;
-            meanItr += val * i;
-
-            param1 = meanGlb * prbn - meanItr;
-            param2 = param1 * param1 / (prbn*(1 - prbn));
-            if (param2 > param3)
+            if(!histogramHost(h_image, h_mask, edges, hist))
             {
-                param3 = param2;
-                if (bins.type() == CV_32F)
-                    optThresh = bins.at<float>(i);
-                else
-                    optThresh = bins.at<int>(i);
+                MO_LOG_EVERY_N(warning, 100) << "Unable to compute histogram of image with depth " << depth;
+                return false;
             }
+        }else
+        {
+            cv::cuda::GpuMat d_hist;
+            if(depth == CV_8U)
+                cv::cuda::calcHist(image->getGpuMat(stream()), d_hist, stream());
+            else
+                cv::cuda::histRange(image->getGpuMat(stream()), d_hist, cv::cuda::GpuMat(edges), stream());
+            d_hist.download(hist, stream());
+            stream().waitForCompletion();
         }
-        optValue[0] = optThresh;
     }
-    else
+
+    const std::vector<int> bin_thresholds = otsuThresholds(hist, levels);
+    std::vector<double> values;
+    const bool integer = depth != CV_32F && depth != CV_64F;
+    for(int t : bin_thresholds)
+    {
+        // Bin t starts the next class, integer pixels above edge - 1 are in it. Floating point
+        // pixels equal to the edge are binned into bin t, so they are compared with >=.
+        const double edge = edges.at<float>(t);
+        values.push_back(integer ? std::ceil(edge) - 1 : edge);
+    }
+    const int cmp = integer ? cv::CMP_GT : cv::CMP_GE;
+
+    const int num_classes = static_cast<int>(values.size()) + 1;
+    if(on_host)
     {
-        cv::Mat bins = range->getMat(stream());
-        if (channels == 4)
+        cv::Mat out(h_image.size(), CV_8UC1, cv::Scalar::all(0));
+        cv::Mat above;
+        for(size_t k = 0; k < values.size(); ++k)
         {
-            for (int c = 0; c < channels; ++c)
-            {
-                float prbn = 0;  // First order cumulative
-                float meanItr = 0; // Second order cumulative
-                float meanGlb = 0; // Global mean level
-                float param1 = 0;
-                float param2 = 0;
-                double param3 = 0;
-                double optThresh = 0;
-
-                for (int i = 0; i < h_hist_.size().area(); ++i)
-                {
-                    meanGlb += h_hist_.at<cv::Vec4f>(i).val[c] * i;
-                }
-
-
-
-                // Currently we only support equal bins accross all channels
-                float val = 0;
-                for (int i = 0; i < bins.size().area(); ++i)
-                {
-                    val = h_hist_.at<cv::Vec4f>(i).val[c];
-                    prbn += val;
-                    meanItr += val * i;
-
-                    param1 = meanGlb * prbn - meanItr;
-                    param2 = param1 * param1 / (prbn*(1 - prbn));
-                    if (param2 > param3)
-                    {
-                        param3 = param2;
-                        optThresh = bins.at<float>(i);
-                    }
-                }
-                optValue[c] = optThresh;
-            }
+            cv::compare(h_image, cv::Scalar(values[k]), above, cmp);
+            out.setTo(cv::Scalar::all((k + 1) * 255 / (num_classes - 1)), above);
         }
-        else
+        if(!h_mask.empty())
+            out.setTo(cv::Scalar::all(0), h_mask == 0);
+        output_param.updateData(out, image_param.getTimestamp(), _ctx.get());
+    }else
+    {
+        const cv::cuda::GpuMat& in = image->getGpuMat(stream());
+        cv::cuda::GpuMat out(in.size(), CV_8UC1);
+        cv::cuda::GpuMat above;
+        out.setTo(cv::Scalar::all(0), stream());
+        for(size_t k = 0; k < values.size(); ++k)
         {
-            LOG_NODE(error) << "Incompatible channel count";
+            cv::cuda::compare(in, cv::Scalar(values[k]), above, cmp, stream());
+            out.setTo(cv::Scalar::all((k + 1) * 255 / (num_classes - 1)), above, stream());
         }
+        output_param.updateData(out, image_param.getTimestamp(), _ctx.get());
     }
-    for (int i = 0; i < optValue.size(); ++i)
-    {
-        //updateParameter("Optimal threshold " + boost::lexical_cast<std::string>(i), optValue[i]);
-    }
+    thresholds_param.updateData(values, image_param.getTimestamp(), _ctx.get());
     return true;
 }
 
-
 bool MOG2::processImpl()
 {
     if(mog2 == nullptr)
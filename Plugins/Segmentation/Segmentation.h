@@ -18,7 +18,17 @@ namespace aq{
             INPUT(SyncedMemory, image, nullptr)
             OPTIONAL_INPUT(SyncedMemory, histogram, nullptr)
             OPTIONAL_INPUT(SyncedMemory, range, nullptr)
+            OPTIONAL_INPUT(SyncedMemory, mask, nullptr)
+            PARAM(int, levels, 2)
+            TOOLTIP(levels, "Number of classes, above 2 the thresholds are found with multi level Otsu")
+            PARAM(int, bins, 256)
+            TOOLTIP(bins, "Bins between the image min and max when no histogram is connected, 8 bit images use one bin per value")
+            PARAM(int, host_max_pixels, 1 << 16)
+            TOOLTIP(host_max_pixels, "Pixel count up to which device images are thresholded on the host")
             OUTPUT(SyncedMemory, output, SyncedMemory())
+            TOOLTIP(output, "Class k of the pixel as k * 255 / (levels - 1), pixels outside of the mask are 0")
+            OUTPUT(std::vector<double>, thresholds, {})
+            TOOLTIP(thresholds, "Pixel values above each threshold belong to the next class, for floating point images values equal to it as well")
         MO_END
     protected:
         bool processImpl();
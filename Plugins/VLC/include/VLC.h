@@ -3,6 +3,7 @@
 #include <Aquila/framegrabbers/IFrameGrabber.hpp>
 #include <Aquila/types/SyncedMemory.hpp>
 #include <MetaObject/core/detail/ConcurrentQueue.hpp>
+#include <memory>
 #include <mutex>
 
 #ifdef _DEBUG
@@ -24,122 +25,68 @@ namespace aq
 {
     namespace nodes
     {
+    // Recycles the buffers VLC decodes into. Mats created by acquire return their memory to the
+    // pool when the last reference, ie the SyncedMemory handed downstream, is released. Only
+    // buffers of the current frame size are kept. The UMatData headers of those Mats and the Mats
+    // handed to VLC as picture ids are recycled as well, a steady stream allocates nothing.
+    class VlcFramePool : public cv::MatAllocator
+    {
+    public:
+        VlcFramePool(size_t max_free = 8);
+        // Sets the frame size, buffers of other sizes are freed instead of recycled
+        void reset(int rows, int cols, int type);
+        cv::Mat acquire();
+        // Picture handed to VLC between its lock and unlock callbacks, holds a Mat from acquire
+        cv::Mat* lockFrame();
+        // Releases the picture's reference to its buffer and recycles it
+        void unlockFrame(cv::Mat* frame);
+        // Called by the owner instead of delete, the pool is destroyed once no Mat uses it
+        void retire();
+        float hitRate() const;
+        cv::Size frameSize() const;
+
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const;
+        bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const;
+        void deallocate(cv::UMatData* data) const;
+    private:
+        ~VlcFramePool();
+        mutable std::mutex          _mtx;
+        mutable std::vector<uchar*> _free;
+        mutable std::vector<void*>  _free_headers;
+        std::vector<std::unique_ptr<cv::Mat> > _frames;
+        std::vector<cv::Mat*>       _free_frames;
+        mutable size_t              _outstanding = 0;
+        mutable size_t              _requests = 0;
+        mutable size_t              _hits = 0;
+        size_t                      _max_free;
+        size_t                      _frame_bytes = 0;
+        int                         _rows = 0;
+        int                         _cols = 0;
+        int                         _type = CV_8UC3;
+        bool                        _retired = false;
+    };
+
 	class vlcCamera : public IFrameGrabber
 	{
 	public:
         MO_DERIVE(vlcCamera, IFrameGrabber)
+            PARAM(int, max_queued_frames, 4)
+            TOOLTIP(max_queued_frames, "Decoded frames waiting for processing, the oldest is dropped beyond this")
+            STATUS(int, frame_width, 0)
+            STATUS(int, frame_height, 0)
+            STATUS(float, pool_hit_rate, 0.0f)
             SOURCE(SyncedMemory, image, {})    
         MO_END;
 		~vlcCamera();
 		bool Load(std::string file);
 		void nodeInit(bool firstInit);
         bool processImpl();
-        libvlc_instance_t* vlcInstance;
-        libvlc_media_player_t* mp;
-        libvlc_media_t* media;
+        libvlc_instance_t* vlcInstance = nullptr;
+        libvlc_media_player_t* mp = nullptr;
+        libvlc_media_t* media = nullptr;
+        // Owned until the destructor retires it, nodeInit runs again on reinitialization
+        VlcFramePool* frame_pool = nullptr;
         moodycamel::ConcurrentQueue<cv::Mat> img_queue;
 	};
     }
 }
-/*
-https://forum.videolan.org/viewtopic.php?t=87031
-using namespace cv;
-
-
-struct ctx
-{
-Mat* image;
-HANDLE mutex;
-uchar*    pixels;
-};
-// define output video resolution
-#define VIDEO_WIDTH     1920
-#define VIDEO_HEIGHT    1080
-
-void *lock(void *data, void**p_pixels)
-{
-struct ctx *ctx = (struct ctx*)data;
-
-WaitForSingleObject(ctx->mutex, INFINITE);
-
-// pixel will be stored on image pixel space
-*p_pixels = ctx->pixels;
-
-return NULL;
-
-}
-
-void display(void *data, void *id){
-(void) data;
-assert(id == NULL);
-}
-
-void unlock(void *data, void *id, void *const *p_pixels){
-
-// get back data structure
-struct ctx *ctx = (struct ctx*)data;
-
-// VLC just rendered the video, but we can also render stuff
-// show rendered image
-imshow("test", *ctx->image);
-
-ReleaseMutex(ctx->mutex);
-}
-
-int main()
-{
-	// VLC pointers
-	libvlc_instance_t *vlcInstance;
-	libvlc_media_player_t *mp;
-	libvlc_media_t *media;
-
-	const char * const vlc_args[] = {
-		"-I", "dummy", // Don't use any interface
-		"--ignore-config", // Don't use VLC's config
-		"--extraintf=logger", // Log anything
-		"--verbose=2", // Be much more verbose then normal for debugging purpose
-	};
-
-	vlcInstance = libvlc_new(sizeof(vlc_args) / sizeof(vlc_args[0]), vlc_args);
-
-	// Read a distant video stream
-	//media = libvlc_media_new_location(vlcInstance, "rtsp://192.168.0.218:554/Streaming/Channels/1");
-	// Read a local video file
-	media = libvlc_media_new_path(vlcInstance, "d:\\a.mp4");
-
-	mp = libvlc_media_player_new_from_media(media);
-
-	libvlc_media_release(media);
-
-	struct ctx* context = (struct ctx*)malloc(sizeof(*context));
-	context->mutex = CreateMutex(NULL, FALSE, NULL);
-
-	context->image = new Mat(VIDEO_HEIGHT, VIDEO_WIDTH, CV_8UC3);
-	context->pixels = (unsigned char *)context->image->data;
-	// show blank image
-	imshow("test", *context->image);
-
-	libvlc_video_set_callbacks(mp, lock, unlock, display, context);
-	libvlc_video_set_format(mp, "RV24", VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_WIDTH * 24 / 8); // pitch = width * BitsPerPixel / 8
-
-
-	int ii = 0;
-	int key = 0;
-	while (key != 27)
-	{
-		ii++;
-		if (ii > 5)
-		{
-			libvlc_media_player_play(mp);
-		}
-		float fps = libvlc_media_player_get_fps(mp);
-		printf("fps:%f\r\n", fps);
-		key = waitKey(100); // wait 100ms for Esc key
-	}
-
-	libvlc_media_player_stop(mp);
-
-
-	return 0;
-}
-*/
@@ -1,36 +1,248 @@
 #include "VLC.h"
 #include "Aquila/nodes/Node.hpp"
 #include "Aquila/framegrabbers/FrameGrabberInfo.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
 
 using namespace aq;
 using namespace aq::nodes;
 
+VlcFramePool::VlcFramePool(size_t max_free):
+    _max_free(max_free)
+{
+}
+
+VlcFramePool::~VlcFramePool()
+{
+    for (uchar* data : _free)
+        cv::fastFree(data);
+    for (void* header : _free_headers)
+        ::operator delete(header);
+}
+
+void VlcFramePool::reset(int rows, int cols, int type)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    _rows = rows;
+    _cols = cols;
+    _type = type;
+    _frame_bytes = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+    for (uchar* data : _free)
+        cv::fastFree(data);
+    _free.clear();
+}
+
+cv::Mat VlcFramePool::acquire()
+{
+    int rows, cols, type;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        rows = _rows;
+        cols = _cols;
+        type = _type;
+    }
+    cv::Mat img;
+    img.allocator = this;
+    img.create(rows, cols, type);
+    return img;
+}
+
+cv::Mat* VlcFramePool::lockFrame()
+{
+    cv::Mat* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_free_frames.empty())
+        {
+            _frames.emplace_back(new cv::Mat());
+            frame = _frames.back().get();
+        }
+        else
+        {
+            frame = _free_frames.back();
+            _free_frames.pop_back();
+        }
+    }
+    *frame = acquire();
+    return frame;
+}
+
+void VlcFramePool::unlockFrame(cv::Mat* frame)
+{
+    frame->release();
+    std::lock_guard<std::mutex> lock(_mtx);
+    _free_frames.push_back(frame);
+}
+
+void VlcFramePool::retire()
+{
+    bool destroy = false;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _retired = true;
+        destroy = _outstanding == 0;
+    }
+    if (destroy)
+        delete this;
+}
+
+float VlcFramePool::hitRate() const
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _requests ? static_cast<float>(_hits) / _requests : 0.0f;
+}
+
+cv::Size VlcFramePool::frameSize() const
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return cv::Size(_cols, _rows);
+}
+
+cv::UMatData* VlcFramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    (void)flags;
+    (void)usageFlags;
+    // Same layout as the default allocator, continuous rows
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--)
+    {
+        if (step)
+        {
+            if (data0 && step[i] != CV_AUTOSTEP)
+                total = step[i];
+            else
+                step[i] = total;
+        }
+        total *= sizes[i];
+    }
+    uchar* data = static_cast<uchar*>(data0);
+    void* header = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_free_headers.empty())
+        {
+            header = _free_headers.back();
+            _free_headers.pop_back();
+        }
+        if (data == nullptr)
+        {
+            ++_requests;
+            if (total == _frame_bytes && !_free.empty())
+            {
+                ++_hits;
+                data = _free.back();
+                _free.pop_back();
+            }
+            else
+            {
+                data = static_cast<uchar*>(cv::fastMalloc(total));
+            }
+            ++_outstanding;
+        }
+    }
+    if (header == nullptr)
+        header = ::operator new(sizeof(cv::UMatData));
+    cv::UMatData* u = new (header) cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0)
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool VlcFramePool::allocate(cv::UMatData* u, int accessflags, cv::UMatUsageFlags usageFlags) const
+{
+    (void)accessflags;
+    (void)usageFlags;
+    return u != nullptr;
+}
+
+void VlcFramePool::deallocate(cv::UMatData* u) const
+{
+    if (u == nullptr)
+        return;
+    CV_Assert(u->urefcount == 0 && u->refcount == 0);
+    const bool user_allocated = (u->flags & cv::UMatData::USER_ALLOCATED) != 0;
+    uchar*     data           = u->origdata;
+    const size_t size         = u->size;
+    u->~UMatData();
+    bool destroy = false;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!user_allocated)
+        {
+            if (!_retired && size == _frame_bytes && _free.size() < _max_free)
+                _free.push_back(data);
+            else
+                cv::fastFree(data);
+            --_outstanding;
+        }
+        if (!_retired && _free_headers.size() < _max_free)
+            _free_headers.push_back(u);
+        else
+            ::operator delete(u);
+        destroy = _retired && _outstanding == 0;
+    }
+    if (destroy)
+        delete this;
+}
+
+// VLC reports the decoded size here, the pool is sized to it and VLC converts to packed 24 bit
+unsigned setup(void** opaque, char* chroma, unsigned* width, unsigned* height, unsigned* pitches, unsigned* lines)
+{
+    vlcCamera* node = static_cast<vlcCamera*>(*opaque);
+    memcpy(chroma, "RV24", 4);
+    pitches[0] = *width * 3;
+    lines[0] = *height;
+    node->frame_pool->reset(static_cast<int>(*height), static_cast<int>(*width), CV_8UC3);
+    MO_LOG(info) << "Decoding " << *width << "x" << *height;
+    return 1;
+}
+
+void cleanup(void* opaque)
+{
+    (void)opaque;
+}
+
 void* lock(void* data, void**p_pixels)
 {
-	//std::cout << "lock called" << std::endl;
 	vlcCamera* node = static_cast<vlcCamera*>(data);
-    cv::Mat img;
-	img.create(1080,1920, CV_8UC3);
-	*p_pixels = img.data;
-    node->img_queue.enqueue(img);
-	return nullptr;
+    // Handed back as the picture id in unlock
+    cv::Mat* img = node->frame_pool->lockFrame();
+	*p_pixels = img->data;
+	return img;
 }
 
 void display(void* data, void* id)
 {
-	//std::cout << "display called" << std::endl;
+    (void)data;
+    (void)id;
 }
 
 void unlock(void* data, void* id, void* const* p_pixels)
 {
-	//std::cout << "unlock called" << std::endl;
+    (void)p_pixels;
+	vlcCamera* node = static_cast<vlcCamera*>(data);
+    cv::Mat* img = static_cast<cv::Mat*>(id);
+    // The frame is complete once it is unlocked, drop the oldest if processing falls behind
+    cv::Mat dropped;
+    while (node->img_queue.size_approx() >= static_cast<size_t>(std::max(node->max_queued_frames, 1)) &&
+           node->img_queue.try_dequeue(dropped))
+    {
+    }
+    node->img_queue.enqueue(*img);
+    node->frame_pool->unlockFrame(img);
 }
 
 void vlcCamera::nodeInit(bool firstInit)
 {
-	vlcInstance = nullptr;
-	mp = nullptr;
-	media = nullptr;
+    (void)firstInit;
+    // Frames handed out by an earlier pool may still be alive downstream, keep the one we have
+    if (frame_pool == nullptr)
+    {
+        frame_pool = new VlcFramePool();
+    }
 }
 
 bool vlcCamera::Load(std::string file)
@@ -58,7 +270,7 @@ bool vlcCamera::Load(std::string file)
     }
     libvlc_media_release(media);
     libvlc_video_set_callbacks(mp, lock, unlock, display, this);
-    libvlc_video_set_format(mp, "RV24", 1920, 1080, 1920 * 3);
+    libvlc_video_set_format_callbacks(mp, setup, cleanup);
     MO_LOG(info) << "Source setup correctly";
 
     int height = libvlc_video_get_height(mp);
@@ -81,6 +293,11 @@ vlcCamera::~vlcCamera()
 	{
 
 	}
+    // Frames still referenced downstream keep the pool alive
+    if (frame_pool)
+    {
+        frame_pool->retire();
+    }
 }
 
 bool vlcCamera::processImpl()
@@ -88,7 +305,15 @@ bool vlcCamera::processImpl()
     cv::Mat img;
     if(img_queue.try_dequeue(img))
     {
+        // Shares the pooled buffer, it returns to the pool when the SyncedMemory is released
         image_param.updateData(img);
+        const cv::Size size = frame_pool->frameSize();
+        if (size.width != frame_width || size.height != frame_height)
+        {
+            frame_width_param.updateData(size.width);
+            frame_height_param.updateData(size.height);
+        }
+        pool_hit_rate_param.updateData(frame_pool->hitRate());
     }
     return true;
 }
@@ -0,0 +1,87 @@
+#include "RegionDecoder.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace aq::darknet;
+
+namespace {
+inline float logistic(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+// Indices of values above threshold
+void findAbove(const float* data, int count, float threshold, std::vector<int>& indices) {
+    int i = 0;
+#if CV_SIMD128
+    const cv::v_float32x4 vthreshold = cv::v_setall_f32(threshold);
+    for (; i <= count - 4; i += 4) {
+        const int mask = cv::v_signmask(cv::v_load(data + i) > vthreshold);
+        for (int bit = 0; mask >> bit; ++bit) {
+            if (mask & (1 << bit))
+                indices.push_back(i + bit);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (data[i] > threshold)
+            indices.push_back(i);
+    }
+}
+}
+
+void aq::darknet::decodeRegion(const float* output, const RegionLayerDesc& desc, cv::Size network_size,
+    float objectness_threshold, float class_threshold, std::vector<RegionDetection>& detections) {
+    const int cells       = desc.width * desc.height;
+    const int entries     = 5 + desc.classes;
+    const int num_anchors = static_cast<int>(desc.anchors.size() / 2);
+    // logistic(x) > t <=> x > log(t / (1 - t)), so raw planes are thresholded without activating them
+    const float threshold = std::min(std::max(objectness_threshold, 1e-6f), 1.0f - 1e-6f);
+    const float cut       = desc.activated ? threshold : std::log(threshold / (1.0f - threshold));
+    // Region anchors are in grid cells, yolo anchors in network input pixels
+    const float anchor_w = desc.type == Region ? static_cast<float>(desc.width) : static_cast<float>(network_size.width);
+    const float anchor_h = desc.type == Region ? static_cast<float>(desc.height) : static_cast<float>(network_size.height);
+
+    std::vector<int> candidates;
+    for (int a = 0; a < num_anchors; ++a) {
+        const float* base       = output + static_cast<size_t>(a) * entries * cells;
+        const float* objectness = base + 4 * cells;
+        candidates.clear();
+        findAbove(objectness, cells, cut, candidates);
+        for (int idx : candidates) {
+            const float* scores = base + 5 * cells + idx;
+            int          best   = 0;
+            for (int c = 1; c < desc.classes; ++c) {
+                if (scores[c * cells] > scores[best * cells])
+                    best = c;
+            }
+            float probability = desc.classes > 0 ? scores[best * cells] : 1.0f;
+            if (!desc.activated && desc.classes > 0) {
+                if (desc.type == Region) {
+                    // Softmax of the largest logit
+                    float sum = 0.0f;
+                    for (int c = 0; c < desc.classes; ++c)
+                        sum += std::exp(scores[c * cells] - probability);
+                    probability = 1.0f / sum;
+                } else {
+                    probability = logistic(probability);
+                }
+            }
+            const float object     = desc.activated ? objectness[idx] : logistic(objectness[idx]);
+            const float confidence = object * probability;
+            if (confidence <= class_threshold)
+                continue;
+
+            const int   col = idx % desc.width;
+            const int   row = idx / desc.width;
+            const float tx  = desc.activated ? base[idx] : logistic(base[idx]);
+            const float ty  = desc.activated ? base[cells + idx] : logistic(base[cells + idx]);
+            const float x   = (col + tx) / desc.width;
+            const float y   = (row + ty) / desc.height;
+            const float w   = std::exp(base[2 * cells + idx]) * desc.anchors[2 * a] / anchor_w;
+            const float h   = std::exp(base[3 * cells + idx]) * desc.anchors[2 * a + 1] / anchor_h;
+            detections.push_back({cv::Rect2f(x - w * 0.5f, y - h * 0.5f, w, h), confidence, best});
+        }
+    }
+}
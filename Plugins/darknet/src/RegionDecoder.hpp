@@ -0,0 +1,39 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace aq {
+namespace darknet {
+    enum RegionType {
+        Region, // yolo v2 [region]: anchors in grid cells, softmax class scores
+        Yolo    // yolo v3 [yolo]: anchors in network input pixels, logistic class scores
+    };
+
+    // Layout of one region layer output. For every anchor there are 5 + classes planes of
+    // width * height values: x, y, w, h, objectness, class scores.
+    struct RegionLayerDesc {
+        RegionType         type    = Region;
+        int                width   = 0;
+        int                height  = 0;
+        int                classes = 0;
+        // w, h pairs, one per anchor
+        std::vector<float> anchors;
+        // darknet applies the logistic / softmax activations to x, y, objectness and the class
+        // scores in place, raw convolution outputs need them applied here
+        bool               activated = false;
+    };
+
+    struct RegionDetection {
+        // Relative to the network input, 0 to 1
+        cv::Rect2f box;
+        float      confidence;
+        int        class_id;
+    };
+
+    // Appends every anchor box with objectness above objectness_threshold and objectness * best
+    // class score above class_threshold. The objectness test runs vectorized on the raw plane,
+    // activations are only evaluated for boxes passing it.
+    void decodeRegion(const float* output, const RegionLayerDesc& desc, cv::Size network_size,
+        float objectness_threshold, float class_threshold, std::vector<RegionDetection>& detections);
+}
+}
@@ -1,66 +1,235 @@
-#define OPENCV
-#include "yolo_v2_class.hpp"
+#include "RegionDecoder.hpp"
+#include <darknet.h>
 
 #include <Aquila/nodes/Node.hpp>
 #include <Aquila/nodes/NodeInfo.hpp>
 #include <Aquila/types/SyncedMemory.hpp>
 #include <Aquila/types/ObjectDetection.hpp>
 #include <INeuralNet.hpp>
-#include <Aquila/nodes/IDetector.hpp>
+#include <Utility/DetectionNMS.hpp>
+#include <MetaObject/params/detail/TInputParamPtrImpl.hpp>
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
 #include <boost/filesystem.hpp>
-class YOLO: virtual public aq::nodes::INeuralNet, virtual public aq::nodes::IImageDetector {
+
+#include <fstream>
+
+// Runs a darknet yolo v2 / v3 network and decodes its [region] / [yolo] layers on the host.
+// Rois are resized to the network input and run one at a time, the detections of all rois of a
+// frame are merged with per class NMS.
+class DarknetYOLO: public aq::nodes::INeuralNet {
 public:
-    typedef aq::nodes::NodeInfo InterfaceInfo;
-    static const unsigned int s_interfaceID = aq::nodes::Node::s_interfaceID;
-    MO_DERIVE(YOLO, aq::nodes::INeuralNet, aq::nodes::IImageDetector)
+    MO_DERIVE(DarknetYOLO, aq::nodes::INeuralNet)
+        PARAM(float, objectness_threshold, 0.24f)
+        PARAM(float, detection_threshold, 0.25f)
+        TOOLTIP(detection_threshold, "Minimum objectness * class probability of a detection")
+        PARAM(float, nms_threshold, 0.45f)
+        PARAM(float, cross_roi_threshold, 0.5f)
+        TOOLTIP(cross_roi_threshold, "Intersection over the smaller box above which detections from overlapping rois are merged")
+        OUTPUT(std::vector<aq::DetectedObject>, detections, {})
     MO_END;
+    ~DarknetYOLO();
+    void nodeInit(bool firstInit);
+
 protected:
-    virtual std::vector<std::vector<cv::cuda::GpuMat>> getNetImageInput(int batch_size = 1){
-        if (!detector) {
-            if(boost::filesystem::exists(model_file) && boost::filesystem::exists(weight_file)){
-                detector = std::make_shared<Detector>(model_file.string(), weight_file.string());
-            }else{
-                LOG(warning) << "Model file '" << model_file << "' or weight file '" << weight_file << "' does not exist";
+    virtual bool initNetwork();
+    virtual bool reshapeNetwork(unsigned int num, unsigned int channels, unsigned int height, unsigned int width);
+    virtual cv::Scalar_<unsigned int> getNetworkShape() const;
+    virtual std::vector<std::vector<cv::cuda::GpuMat>> getNetImageInput(int requested_batch_size = 1);
+    virtual std::vector<std::vector<cv::Mat>> getNetImageInputHost(int requested_batch_size = 1);
+    virtual void preBatch(int batch_size);
+    virtual void postMiniBatch(const std::vector<cv::Rect>& batch_bb, const std::vector<aq::DetectedObject2d>& dets);
+    virtual void postBatch();
+    virtual bool forwardMinibatch();
+
+private:
+    network* net = nullptr;
+    // Planar RGB input of the network
+    std::vector<float> input_buffer;
+    std::vector<int> region_layers;
+    std::vector<aq::darknet::RegionLayerDesc> region_descs;
+    std::vector<aq::darknet::RegionDetection> decoded;
+    std::vector<aq::DetectedObject> batch_detections;
+    // Roi each detection of the batch was found in
+    std::vector<int> batch_rois;
+    int roi_count = 0;
+};
+
+DarknetYOLO::~DarknetYOLO() {
+    if (net) {
+        free_network_ptr(net);
+    }
+}
+
+void DarknetYOLO::nodeInit(bool firstInit) {
+    if (firstInit) {
+        // darknet expects RGB in [0, 1] at the input size the network was trained with
+        channel_mean_param.updateData(cv::Scalar::all(0));
+        pixel_scale_param.updateData(1.0f / 255.0f);
+        image_scale_param.updateData(-1.0f);
+        // Batches larger than one can't be shaped, padding to a bucket would only add reshape attempts
+        batch_buckets_param.updateData(std::vector<int>());
+    }
+}
+
+bool DarknetYOLO::initNetwork() {
+    if (model_file_param.modified() || weight_file_param.modified()) {
+        if (boost::filesystem::exists(model_file) && boost::filesystem::exists(weight_file)) {
+            if (net) {
+                free_network_ptr(net);
             }
-        }
-        if (input_buffer.empty() && detector) {
-            int width, height;
-            if (detector->get_network_size(width, height)) {
-                workspace = cv::cuda::GpuMat(1, width * height * 3, CV_32F);
-                float* ptr = workspace.ptr<float>();
-                std::vector<cv::cuda::GpuMat> channels;
-                for (int i = 0; i < 3; ++i) {
-                    channels.emplace_back(height, width, CV_32F, static_cast<void*>(ptr), width);
-                    ptr += height * width;
+            std::string cfg = model_file.string();
+            std::string weights = weight_file.string();
+            net = load_network_custom(&cfg[0], &weights[0], 0, 1);
+            region_layers.clear();
+            region_descs.clear();
+            for (int i = 0; i < net->n; ++i) {
+                const layer& l = net->layers[i];
+                if (l.type != REGION && l.type != YOLO) {
+                    continue;
                 }
-                if (swap_bgr) {
-                    std::swap(channels[0], channels[2]);
+                aq::darknet::RegionLayerDesc desc;
+                desc.type = l.type == REGION ? aq::darknet::Region : aq::darknet::Yolo;
+                desc.width = l.w;
+                desc.height = l.h;
+                desc.classes = l.classes;
+                // The host copy of a region layer's output has had its activations applied in place
+                desc.activated = true;
+                for (int a = 0; a < l.n; ++a) {
+                    const int anchor = l.type == YOLO ? l.mask[a] : a;
+                    desc.anchors.push_back(l.biases[2 * anchor]);
+                    desc.anchors.push_back(l.biases[2 * anchor + 1]);
                 }
-                input_buffer.push_back(channels);
-                input_ptr = ptr;
+                region_layers.push_back(i);
+                region_descs.push_back(desc);
             }
+            input_buffer.assign(static_cast<size_t>(net->w) * net->h * net->c, 0.0f);
+            model_file_param.modified(false);
+            weight_file_param.modified(false);
+            MO_LOG(info) << "Loaded " << weights << " with " << region_layers.size() << " output layers";
+            if (region_layers.empty()) {
+                MO_LOG(warning) << cfg << " has no region or yolo layer to decode";
+            }
+        } else {
+            MO_LOG_EVERY_N(warning, 100) << "Model file '" << model_file << "' or weight file '" << weight_file << "' does not exist";
         }
-        return input_buffer;
     }
-    virtual bool forwardMinibatch(){
-        if(input_ptr){
-            current_detections = detector->detect(input_ptr);
-            return true;
+
+    if ((label_file_param.modified() || labels.empty()) && boost::filesystem::exists(label_file)) {
+        labels.clear();
+        std::ifstream ifs(label_file.string().c_str());
+        if (!ifs) {
+            MO_LOG_EVERY_N(warning, 100) << "Unable to load label file";
         }
-        return false;
+        std::string line;
+        while (std::getline(ifs, line, '\n')) {
+            labels.push_back(line);
+        }
+        MO_LOG(info) << "Loaded " << labels.size() << " classes";
+        labels_param.emitUpdate();
+        label_file_param.modified(false);
     }
-    virtual void postBatch(const std::vector<cv::Rect>& batch_bb, const std::vector<aq::DetectedObject2d>& dets){
-        // do things with current_detections
+    return net != nullptr;
+}
+
+bool DarknetYOLO::reshapeNetwork(unsigned int num, unsigned int channels, unsigned int height, unsigned int width) {
+    // The network keeps the input size and batch it was loaded with
+    return net && num == 1 && channels == static_cast<unsigned int>(net->c) &&
+           height == static_cast<unsigned int>(net->h) && width == static_cast<unsigned int>(net->w);
+}
+
+cv::Scalar_<unsigned int> DarknetYOLO::getNetworkShape() const {
+    if (net == nullptr) {
+        return cv::Scalar_<unsigned int>();
     }
-    virtual bool reshapeNetwork(int num, int channels, int height, int width){
+    return cv::Scalar_<unsigned int>(1, net->c, net->h, net->w);
+}
+
+std::vector<std::vector<cv::cuda::GpuMat>> DarknetYOLO::getNetImageInput(int requested_batch_size) {
+    (void)requested_batch_size;
+    return std::vector<std::vector<cv::cuda::GpuMat>>();
+}
+
+std::vector<std::vector<cv::Mat>> DarknetYOLO::getNetImageInputHost(int requested_batch_size) {
+    (void)requested_batch_size;
+    std::vector<std::vector<cv::Mat>> output;
+    if (net == nullptr || input_buffer.empty()) {
+        return output;
+    }
+    std::vector<cv::Mat> channels;
+    float* ptr = input_buffer.data();
+    for (int i = 0; i < net->c; ++i) {
+        channels.emplace_back(net->h, net->w, CV_32F, ptr);
+        ptr += net->h * net->w;
+    }
+    if (swap_bgr && channels.size() == 3) {
+        std::swap(channels[0], channels[2]);
+    }
+    output.push_back(channels);
+    return output;
+}
+
+void DarknetYOLO::preBatch(int batch_size) {
+    (void)batch_size;
+    batch_detections.clear();
+    batch_rois.clear();
+    roi_count = 0;
+}
+
+bool DarknetYOLO::forwardMinibatch() {
+    if (net == nullptr) {
         return false;
     }
-private:
-    std::shared_ptr<Detector> detector;
-    std::vector<std::vector<cv::cuda::GpuMat>> input_buffer;
-    cv::cuda::GpuMat workspace;
-    float* input_ptr = nullptr;
-    std::vector<bbox_t> current_detections;
-};
+    network_predict_ptr(net, input_buffer.data());
+    return true;
+}
+
+void DarknetYOLO::postMiniBatch(const std::vector<cv::Rect>& batch_bb, const std::vector<aq::DetectedObject2d>& dets) {
+    (void)dets;
+    if (batch_bb.empty()) {
+        return;
+    }
+    // The network runs one roi at a time, reshapeNetwork rejects larger batches so INeuralNet
+    // falls back to mini batches of one
+    if (batch_bb.size() != 1 || _minibatch_offset != 0) {
+        MO_LOG_FIRST_N(warning, 1) << "Darknet outputs a single roi per forward pass, ignoring a mini batch of " << batch_bb.size()
+                                   << " rois at offset " << _minibatch_offset;
+        return;
+    }
+    decoded.clear();
+    for (size_t i = 0; i < region_layers.size(); ++i) {
+        aq::darknet::decodeRegion(net->layers[region_layers[i]].output, region_descs[i], cv::Size(net->w, net->h),
+                                  objectness_threshold, detection_threshold, decoded);
+    }
+    // Boxes are relative to the network input, which is the roi resized
+    const cv::Rect& roi = batch_bb[0];
+    mo::ITParam<aq::SyncedMemory>& input = currentInputParam();
+    for (const auto& det : decoded) {
+        aq::DetectedObject obj;
+        obj.bounding_box = cv::Rect2f(det.box.x * roi.width + roi.x, det.box.y * roi.height + roi.y,
+                                      det.box.width * roi.width, det.box.height * roi.height) & cv::Rect2f(roi);
+        if (static_cast<size_t>(det.class_id) < labels.size()) {
+            obj.classification = aq::Classification(labels[det.class_id], det.confidence, det.class_id);
+        } else {
+            obj.classification = aq::Classification("", det.confidence, det.class_id);
+        }
+        obj.timestamp = input.getTimestamp();
+        obj.framenumber = input.getFrameNumber();
+        batch_detections.push_back(obj);
+        batch_rois.push_back(roi_count);
+    }
+    ++roi_count;
+}
+
+void DarknetYOLO::postBatch() {
+    aq::nodes::BoxSuppressionParams params;
+    params.iou_threshold = nms_threshold;
+    params.cross_tile_threshold = cross_roi_threshold;
+    const bool multiple_rois = roi_count > 1;
+    aq::nodes::mergeTiledDetections(batch_detections, multiple_rois ? batch_rois : std::vector<int>(), params, true, multiple_rois);
+    for (size_t i = 0; i < batch_detections.size(); ++i) {
+        batch_detections[i].id = static_cast<int>(i);
+    }
+    detections_param.updateData(batch_detections, mo::tag::_param = currentInputParam(), _ctx.get());
+}
 
-MO_REGISTER_CLASS(YOLO)
\ No newline at end of file
+MO_REGISTER_CLASS(DarknetYOLO)
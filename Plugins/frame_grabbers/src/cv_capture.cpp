@@ -2,6 +2,7 @@
 #include "precompiled.hpp"
 #include "Aquila/framegrabbers/GrabberInfo.hpp"
 #include "MetaObject/params/detail/TParamPtrImpl.hpp"
+#include "MetaObject/thread/boost_thread.hpp"
 
 #if _MSC_VER
 RUNTIME_COMPILER_LINKLIBRARY("ole32.lib")
@@ -19,7 +20,12 @@ void SafeRelease(T **ppT){
 }
 
 
+GrabberCV::~GrabberCV(){
+    stopDecodeAhead();
+}
+
 bool GrabberCV::loadData(const std::string& file_path){
+    stopDecodeAhead();
     if(LoadGPU(file_path)){
         return true;
     }else{
@@ -73,6 +79,73 @@ bool GrabberCV::LoadCPU(const std::string& file_path){
     return false;
 }
 
+bool GrabberCV::readFrame(DecodedFrame& frame){
+    if(!h_cam || !h_cam->read(frame.image)){
+        return false;
+    }
+    frame.frame_number = h_cam->get(CV_CAP_PROP_POS_FRAMES);
+    double ts_ = h_cam->get(CV_CAP_PROP_POS_MSEC);
+    if(ts_ == -1){
+        if(!initial_time)
+            initial_time = mo::getCurrentTime();
+        frame.timestamp = mo::Time_t(mo::getCurrentTime() - *initial_time);
+    }else{
+        frame.timestamp = mo::Time_t(ts_* mo::ms);
+    }
+    return true;
+}
+
+void GrabberCV::decodeLoop(){
+    mo::setThisThreadName("decode-ahead");
+    while(true){
+        {
+            boost::mutex::scoped_lock lock(_decode_mtx);
+            while(!_decode_stop && static_cast<int>(_decoded.size()) >= std::max(decode_queue_size, 1)){
+                _decode_cv.wait(lock);
+            }
+            if(_decode_stop){
+                return;
+            }
+        }
+        // The capture is only touched by this thread while it runs
+        DecodedFrame frame;
+        const bool read = readFrame(frame);
+        boost::mutex::scoped_lock lock(_decode_mtx);
+        if(!read){
+            _decode_eos = true;
+            _decode_cv.notify_all();
+            return;
+        }
+        _decoded.push_back(frame);
+        _decode_cv.notify_all();
+    }
+}
+
+void GrabberCV::stopDecodeAhead(bool rewind){
+    if(_decode_thread.joinable()){
+        {
+            boost::mutex::scoped_lock lock(_decode_mtx);
+            _decode_stop = true;
+        }
+        _decode_cv.notify_all();
+        _decode_thread.join();
+    }
+    if(rewind && h_cam && !_decoded.empty() && _decoded.front().frame_number > 0){
+        h_cam->set(CV_CAP_PROP_POS_FRAMES, _decoded.front().frame_number - 1);
+    }
+    _decoded.clear();
+    _decode_stop = false;
+    _decode_eos  = false;
+    decode_queue_fill_param.updateData(0);
+}
+
+void GrabberCV::seek(int frame){
+    stopDecodeAhead();
+    if(h_cam){
+        h_cam->set(CV_CAP_PROP_POS_FRAMES, frame);
+    }
+}
+
 bool GrabberCV::grab(){
     if(d_cam){
         cv::cuda::GpuMat img;
@@ -81,25 +154,41 @@ bool GrabberCV::grab(){
             return true;
         }
     }else if(h_cam){
-        cv::Mat img;
-        if(h_cam->read(img)){
-            double fn = h_cam->get(CV_CAP_PROP_POS_FRAMES);
-            double ts_ = h_cam->get(CV_CAP_PROP_POS_MSEC);
-            mo::Time_t ts;
-            if(ts_ == -1){
-                if(!initial_time)
-                    initial_time = mo::getCurrentTime();
-                ts = mo::Time_t(mo::getCurrentTime() - *initial_time);
-            }else{
-                ts = mo::Time_t(ts_* mo::ms);
+        DecodedFrame frame;
+        if(decode_ahead){
+            if(!_decode_thread.joinable() && !_decode_eos){
+                _decode_thread = boost::thread(&GrabberCV::decodeLoop, this);
             }
-            if(fn == -1){
-                image_param.updateData(img, mo::tag::_timestamp = ts, _ctx.get());
-            }else{
-                image_param.updateData(img, mo::tag::_timestamp = ts, mo::tag::_frame_number = fn, _ctx.get());
+            int fill = 0;
+            {
+                boost::mutex::scoped_lock lock(_decode_mtx);
+                while(_decoded.empty() && !_decode_eos){
+                    _decode_cv.wait(lock);
+                }
+                if(_decoded.empty()){
+                    return false;
+                }
+                frame = _decoded.front();
+                _decoded.pop_front();
+                fill = static_cast<int>(_decoded.size());
+            }
+            _decode_cv.notify_all();
+            decode_queue_fill_param.updateData(fill);
+        }else{
+            if(_decode_thread.joinable() || !_decoded.empty()){
+                // decode_ahead was turned off, continue from the first frame that was not emitted
+                stopDecodeAhead(true);
+            }
+            if(!readFrame(frame)){
+                return false;
             }
-            return true;
         }
+        if(frame.frame_number == -1){
+            image_param.updateData(frame.image, mo::tag::_timestamp = frame.timestamp, _ctx.get());
+        }else{
+            image_param.updateData(frame.image, mo::tag::_timestamp = frame.timestamp, mo::tag::_frame_number = frame.frame_number, _ctx.get());
+        }
+        return true;
     }
     return false;
 }
@@ -190,6 +279,7 @@ int GrabberCamera::canLoad(const std::string& doc){
 }
 
 bool GrabberCamera::loadData(const std::string& file_path){
+    stopDecodeAhead();
     int index = 0;
     if (boost::conversion::detail::try_lexical_convert(file_path, index)){
         h_cam.reset(new cv::VideoCapture(index));
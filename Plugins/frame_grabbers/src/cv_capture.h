@@ -6,6 +6,8 @@
 #include "Aquila/rcc/external_includes/cv_videoio.hpp"
 #include <MetaObject/params/detail/TParamPtrImpl.hpp>
 #include "RuntimeObjectSystem/RuntimeSourceDependency.h"
+#include <boost/thread.hpp>
+#include <deque>
 
 namespace aq
 {
@@ -17,16 +19,40 @@ namespace aq
             MO_ABSTRACT(GrabberCV, IGrabber)
                 PROPERTY(cv::Ptr<cv::VideoCapture>, h_cam, cv::Ptr<cv::VideoCapture>())
                 PROPERTY(cv::Ptr<cv::cudacodec::VideoReader>, d_cam, cv::Ptr<cv::cudacodec::VideoReader>())
+                PARAM(bool, decode_ahead, false)
+                TOOLTIP(decode_ahead, "Decode host frames on a separate thread so decoding overlaps with processing")
+                PARAM(int, decode_queue_size, 4)
+                MO_SLOT(void, seek, int)
                 MO_SIGNAL(void, eos)
+                STATUS(int, decode_queue_fill, 0)
                 SOURCE(SyncedMemory, image, {})
                 APPEND_FLAGS(image, mo::Source_e)
             MO_END;
+            ~GrabberCV();
             bool loadData(const std::string& path);
             bool grab();
         protected:
+            struct DecodedFrame{
+                cv::Mat    image;
+                mo::Time_t timestamp;
+                double     frame_number = -1;
+            };
             virtual bool LoadGPU(const std::string& path);
             virtual bool LoadCPU(const std::string& path);
+            // Reads the next host frame and computes its timestamp and frame number
+            bool readFrame(DecodedFrame& frame);
+            void decodeLoop();
+            // Stops the decode thread and drops queued frames, rewinding the capture to the first
+            // dropped frame when rewind is set
+            void stopDecodeAhead(bool rewind = false);
             mo::OptionalTime_t initial_time;
+
+            boost::thread             _decode_thread;
+            boost::mutex              _decode_mtx;
+            boost::condition_variable _decode_cv;
+            std::deque<DecodedFrame>  _decoded;
+            bool                      _decode_stop = false;
+            bool                      _decode_eos  = false;
         };
     }
 }
@@ -1,207 +1,274 @@
 #include "directory.h"
-#include <Aquila/rcc/external_includes/cv_imgcodec.hpp>
 #include "precompiled.hpp"
+#include "Aquila/framegrabbers/GrabberInfo.hpp"
+#include <MetaObject/thread/boost_thread.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
 
 using namespace aq;
 using namespace aq::nodes;
 
-/*frame_grabber_directory::frame_grabber_directory()
-{
-    frame_index = 0;
+namespace {
+bool isImage(const boost::filesystem::path& path){
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" || ext == ".tif" ||
+           ext == ".tiff" || ext == ".pgm" || ext == ".ppm" || ext == ".webp";
 }
-bool frame_grabber_directory::processImpl()
-{
-    auto frame = GetNextFrame(stream());
-    if(!frame.empty())
-    {
-        this->current_frame_param.updateData(frame, frame.frame_number, _ctx.get());
-        return true;
-    }
+
+bool matchWildcard(const char* pattern, const char* str){
+    if (*pattern == '\0')
+        return *str == '\0';
+    if (*pattern == '*')
+        return matchWildcard(pattern + 1, str) || (*str != '\0' && matchWildcard(pattern, str + 1));
+    if (*str != '\0' && (*pattern == '?' || *pattern == *str))
+        return matchWildcard(pattern + 1, str + 1);
     return false;
 }
-void frame_grabber_directory::Restart()
-{
+}
 
+ImageReadAhead::~ImageReadAhead(){
+    stop();
 }
 
-void frame_grabber_directory::nodeInit(bool firstInit)
-{
-    //updateParameter("Frame Index", 0);
-    //updateParameter("Loaded file", std::string(""));
-    /*updateParameter<boost::function<void(void)>>("Restart", [this]()->void
-    {
-        frame_index = 0;
-        updateParameter("Frame Index", 0);
-    });
-}
-void frame_grabber_directory::Serialize(ISimpleSerializer* pSerializer)
-{
-    IFrameGrabber::Serialize(pSerializer);
-    SERIALIZE(frame_index);
-    SERIALIZE(files_on_disk);
-    SERIALIZE(loaded_images);
-}
-bool frame_grabber_directory::LoadFile(const std::string& file_path)
-{
-    auto path = boost::filesystem::path(file_path);
-    if(boost::filesystem::exists(path) && boost::filesystem::is_directory(path))
+void ImageReadAhead::start(const std::shared_ptr<const std::vector<std::string>>& files, int threads, int read_ahead, int keep_behind){
+    stop();
+    _files       = files;
+    _read_ahead  = std::max(read_ahead, 0);
+    _keep_behind = std::max(keep_behind, 0);
+    _stop        = false;
+    _decode_time = 0.0;
+    _decoded     = 0;
+    for (int i = 0; i < std::max(threads, 1); ++i){
+        _threads.emplace_back(&ImageReadAhead::decodeLoop, this);
+    }
+}
+
+void ImageReadAhead::stop(){
     {
-        boost::filesystem::directory_iterator end_itr;
-        std::vector<std::string> files;
-        // cycle through the directory
-        std::map<std::string, std::vector<std::string>> extension_map;
-        for (boost::filesystem::directory_iterator itr(path); itr != end_itr; ++itr)
-        {
-            if (is_regular_file(itr->path())) 
-            {
-                //files.push_back(itr->path().string());
-                extension_map[itr->path().extension().string()].push_back(itr->path().string());
-            }
+        boost::mutex::scoped_lock lock(_mtx);
+        _stop = true;
+    }
+    _work_cv.notify_all();
+    _ready_cv.notify_all();
+    for (auto& thread : _threads){
+        thread.join();
+    }
+    _threads.clear();
+    _entries.clear();
+}
+
+void ImageReadAhead::updateWindow(int cursor){
+    const int count = static_cast<int>(_files->size());
+    const int begin = std::max(0, cursor - _keep_behind);
+    const int end   = std::min(count, cursor + _read_ahead + 1);
+    // Entries being decoded are dropped by the decoding thread once it sees they are gone
+    _entries.erase(_entries.begin(), _entries.lower_bound(begin));
+    _entries.erase(_entries.lower_bound(end), _entries.end());
+    bool scheduled = false;
+    for (int i = cursor; i < end; ++i){
+        if (_entries.find(i) == _entries.end()){
+            _entries[i];
+            scheduled = true;
         }
-        for(auto& itr: extension_map)
-        {
-            std::sort(itr.second.begin(), itr.second.end());
+    }
+    if (scheduled){
+        _work_cv.notify_all();
+    }
+}
+
+bool ImageReadAhead::get(int index, cv::Mat& image, bool& hit){
+    boost::mutex::scoped_lock lock(_mtx);
+    if (_threads.empty() || index < 0 || index >= static_cast<int>(_files->size())){
+        return false;
+    }
+    updateWindow(index);
+    auto itr = _entries.find(index);
+    hit      = itr->second.state == Ready || itr->second.state == Failed;
+    while (!_stop){
+        itr = _entries.find(index);
+        if (itr == _entries.end()){
+            // Evicted by a concurrent seek
+            return false;
         }
-        auto constructors = mo::MetaObjectFactory::instance()->
-                getConstructors(aq::nodes::IFrameGrabber::s_interfaceID);
-        std::vector<int> load_count(constructors.size(), 0);
-        std::vector<int> priorities(constructors.size(), 0);
-        for(int i = 0; i < constructors.size(); ++i)
-        {
-            if(auto info = dynamic_cast<FrameGrabberInfo*>(constructors[i]->GetObjectInfo()))
-            {
-                for(auto& file : extension_map)
-                {
-                    int priority = info->CanLoadDocument(file.second[0]);
-                    if(priority > 0)
-                    {
-                        ++load_count[i];
-                        priorities[i] = priority;
-                    }
-                }
-            }
+        if (itr->second.state == Ready){
+            image = itr->second.image;
+            return true;
         }
-        auto itr = std::max_element(load_count.begin(), load_count.end());
-        if(itr != load_count.end() && (*itr) != 0)
-        {
-            long long idx = itr - load_count.begin();
-            this->fg = constructors[idx]->Construct();
-            this->fg->Init(true);
-            auto info = dynamic_cast<FrameGrabberInfo*>(constructors[idx]->GetObjectInfo());
-            for(auto& file : extension_map)
-            {
-                if(info->CanLoadDocument(file.second[0]))
-                {
-                    files_on_disk.insert(files_on_disk.end(), file.second.begin(), file.second.end());
-                }
-            }
-            return files_on_disk.size() != 0;
+        if (itr->second.state == Failed){
+            return false;
         }
+        _ready_cv.wait(lock);
     }
     return false;
 }
 
-long long frame_grabber_directory::getFrameNumber()
-{
-    return frame_index;
-}
-long long frame_grabber_directory::GetNumFrames()
-{
-    return files_on_disk.size();
-}
-
-std::string frame_grabber_directory::GetSourceFilename()
-{
-    return files_on_disk[frame_index];
+double ImageReadAhead::decodeLatency(){
+    boost::mutex::scoped_lock lock(_mtx);
+    return _decoded ? _decode_time / _decoded : 0.0;
 }
 
-TS<SyncedMemory> frame_grabber_directory::GetCurrentFrame(cv::cuda::Stream& stream)
-{
-    return GetFrame(frame_index, stream);
-}
+void ImageReadAhead::decodeLoop(){
+    mo::setThisThreadName("directory-decode");
+    boost::mutex::scoped_lock lock(_mtx);
+    while (!_stop){
+        // Lowest pending index first so frames complete in order
+        auto itr = std::find_if(_entries.begin(), _entries.end(),
+                                [](const std::pair<const int, Entry>& entry){ return entry.second.state == Pending; });
+        if (itr == _entries.end()){
+            _work_cv.wait(lock);
+            continue;
+        }
+        const int index    = itr->first;
+        itr->second.state  = Decoding;
+        const std::string& file = (*_files)[static_cast<size_t>(index)];
+        lock.unlock();
 
-TS<SyncedMemory> frame_grabber_directory::GetFrame(int index, cv::cuda::Stream& stream)
-{
-    // First check if this has already been loaded in the frame buffer
-    if(index == files_on_disk.size() - 1)
-        sig_eos();
-    if(files_on_disk.empty())
-        return TS<SyncedMemory>(mo::Time_t(0.0 * mo::ms), (size_t)0);
-    if(index >= files_on_disk.size())
-        index = static_cast<int>(files_on_disk.size() - 1);
-    std::string file_name = files_on_disk[index];
+        const auto start = boost::posix_time::microsec_clock::universal_time();
+        cv::Mat    image = cv::imread(file);
+        const auto end   = boost::posix_time::microsec_clock::universal_time();
 
-    cv::Mat h_out = cv::imread(file_name);
+        lock.lock();
+        _decode_time += boost::posix_time::time_duration(end - start).total_microseconds() / 1000.0;
+        ++_decoded;
+        itr = _entries.find(index);
+        if (itr != _entries.end() && itr->second.state == Decoding){
+            itr->second.image = image;
+            itr->second.state = image.empty() ? Failed : Ready;
+            _ready_cv.notify_all();
+        }
+    }
+}
 
-    if(h_out.empty())
-        return TS<SyncedMemory>(mo::Time_t(0.0*mo::ms), (size_t)0);
+GrabberDirectory::~GrabberDirectory(){
+    _cache.stop();
+}
 
-    this->_modified = true;
+std::vector<std::string> GrabberDirectory::listImages(const std::string& document, size_t max_count){
+    std::vector<std::string> files;
+    boost::filesystem::path  path(document);
+    std::string              pattern;
+    if (!boost::filesystem::is_directory(path)){
+        if (document.find_first_of("*?") == std::string::npos){
+            return files;
+        }
+        pattern = path.filename().string();
+        path    = path.parent_path().empty() ? boost::filesystem::path(".") : path.parent_path();
+        if (!boost::filesystem::is_directory(path)){
+            return files;
+        }
+    }
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator itr(path, ec), end; itr != end; itr.increment(ec)){
+        if (ec){
+            break;
+        }
+        const auto& file = itr->path();
+        if (!isImage(file) || (pattern.size() && !matchWildcard(pattern.c_str(), file.filename().string().c_str()))){
+            continue;
+        }
+        if (boost::filesystem::is_regular_file(file)){
+            files.push_back(file.string());
+            if (max_count && files.size() >= max_count){
+                break;
+            }
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
 
-    return TS<SyncedMemory>(mo::Time_t(0.0 * mo::ms), (size_t)index, h_out);
+int GrabberDirectory::canLoad(const std::string& document){
+    // Only probe for one image, the directory may hold millions
+    return listImages(document, 1).empty() ? 0 : 4;
 }
 
-TS<SyncedMemory> frame_grabber_directory::GetNextFrame(cv::cuda::Stream& stream)
-{
-    if (frame_index == files_on_disk.size() - 1)
-        return GetCurrentFrame(stream);
-    return GetFrame(frame_index++, stream);
+int GrabberDirectory::loadTimeout(){
+    return 60000;
 }
 
-TS<SyncedMemory> frame_grabber_directory::GetFrameRelative(int index, cv::cuda::Stream& stream)
-{
-    index = frame_index + index;
-    index = std::max((int)files_on_disk.size() - 1, index);
-    index = std::min(0, index);
-    return GetFrame(index, stream);
+bool GrabberDirectory::loadData(const std::string& path){
+    auto files = std::make_shared<std::vector<std::string>>(listImages(path));
+    if (files->empty()){
+        MO_LOG(warning) << "No images found in " << path;
+        return false;
+    }
+    MO_LOG(info) << "Loaded " << files->size() << " images from " << path;
+    _cache.stop();
+    _files = files;
+    _next_index = 0;
+    _requests = 0;
+    _hits = 0;
+    _eos_sent = false;
+    num_frames_param.updateData(static_cast<int>(files->size()));
+    loaded_document = path;
+    return true;
 }
 
-int frame_grabber_directory::CanLoadDocument(const std::string& document)
-{
-    auto path = boost::filesystem::path(document);
-    if (boost::filesystem::exists(path) && boost::filesystem::is_directory(path))
-    {
-        std::map<std::string, std::vector<std::string>> extension_map;
-        boost::filesystem::directory_iterator end_itr;
-        std::vector<std::string> files;
-        // cycle through the directory
-        for (boost::filesystem::directory_iterator itr(path); itr != end_itr; ++itr)
-        {
-            if (is_regular_file(itr->path()))
-            {
-                extension_map[itr->path().extension().string()].push_back(itr->path().string());
+bool GrabberDirectory::grab(){
+    if (!_files || _files->empty()){
+        return false;
+    }
+    if (!_cache.running() || decode_threads_param.modified() || read_ahead_param.modified() || keep_behind_param.modified()){
+        _cache.start(_files, decode_threads, read_ahead, keep_behind);
+        decode_threads_param.modified(false);
+        read_ahead_param.modified(false);
+        keep_behind_param.modified(false);
+    }
+    const int count     = static_cast<int>(_files->size());
+    const int requested = _next_index;
+    int       index     = requested;
+    if (index >= count){
+        if (!loop){
+            if (!_eos_sent){
+                _eos_sent = true;
+                sig_eos();
             }
+            return false;
         }
+        index = 0;
+    }
+    index = std::max(index, 0);
+    // A seek issued while this frame is grabbed takes precedence over advancing
+    int expected = requested;
+    _next_index.compare_exchange_strong(expected, index + 1);
 
-        auto constructors = mo::MetaObjectFactory::instance()->
-                getConstructors(aq::nodes::IFrameGrabber::s_interfaceID);
-        std::vector<int> load_count(constructors.size(), 0);
-        std::vector<int> priorities(constructors.size(), 0);
-        for (int i = 0; i < constructors.size(); ++i)
-        {
-            if (auto info = dynamic_cast<FrameGrabberInfo*>(constructors[i]->GetObjectInfo()))
-            {
-                for(auto& file : extension_map)
-                {
-                    int priority = info->CanLoadDocument(file.second[0]);
-                    if (priority > 0)
-                    {
-                        ++load_count[i];
-                        priorities[i] = priority;
-                    }
-                }
-            }
-        }
-        auto itr = std::max_element(load_count.begin(), load_count.end());
-        if (itr != load_count.end())
-        {
-            long long idx = itr - load_count.begin();
-            return priorities[idx];
-        }
+    cv::Mat img;
+    bool    hit = false;
+    const bool decoded = _cache.get(index, img, hit);
+    ++_requests;
+    if (hit){
+        ++_hits;
+    }
+    cache_hit_rate_param.updateData(static_cast<float>(_hits) / _requests);
+    decode_latency_param.updateData(static_cast<float>(_cache.decodeLatency()));
+    if (!decoded){
+        MO_LOG(warning) << "Unable to read " << (*_files)[static_cast<size_t>(index)] << ", skipping";
+        return false;
     }
-    return 0;
+    frame_index_param.updateData(index);
+    current_file_param.updateData((*_files)[static_cast<size_t>(index)]);
+    const mo::Time_t ts(index * 1000.0 / std::max(frame_rate, 1e-3) * mo::ms);
+    image_param.updateData(img, mo::tag::_timestamp = ts, mo::tag::_frame_number = static_cast<size_t>(index), _ctx.get());
+    return true;
 }
 
+void GrabberDirectory::seek(int index){
+    if (_files){
+        _next_index = std::min(std::max(index, 0), static_cast<int>(_files->size()) - 1);
+        _eos_sent   = false;
+    }
+}
+
+void GrabberDirectory::stepBackward(){
+    // The next grab re-emits the frame before the last emitted one, from the kept frames
+    _next_index = std::max(frame_index - 1, 0);
+    _eos_sent   = false;
+}
+
+void GrabberDirectory::restart(){
+    seek(0);
+}
 
-MO_REGISTER_CLASS(frame_grabber_directory);
-*/
\ No newline at end of file
+MO_REGISTER_CLASS(GrabberDirectory);
@@ -1,36 +1,97 @@
 #pragma once
 #include "Aquila/framegrabbers/IFrameGrabber.hpp"
+#include "Aquila/types/SyncedMemory.hpp"
+#include "frame_grabbersExport.hpp"
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+
+#include <boost/thread.hpp>
+#include <atomic>
+#include <map>
+#include <memory>
 
 namespace aq
 {
     namespace nodes
     {
-    /*class frame_grabber_directory: public IFrameGrabber
-    {
-    public:
-        frame_grabber_directory();
-        virtual bool LoadFile(const std::string& file_path);
-        
-        virtual void nodeInit(bool firstInit);
-        virtual void Serialize(ISimpleSerializer* pSerializer);
-        
-        MO_DERIVE(frame_grabber_directory, IFrameGrabber)
-            MO_SLOT(void, Restart)
-            STATUS(int, frame_index, 0)
-            MO_SIGNAL(void, eos)
-        MO_END;
-        
-        static int canLoad(const std::string& doc);
-    protected:
-        bool processImpl();
-    private:
-        cv::cuda::GpuMat                d_image;
-        cv::Mat                         h_image;
-        std::string                     loaded_file;
-        std::vector<std::string>        files_on_disk;
-        //int frame_index;
-        boost::circular_buffer<std::tuple<std::string, TS<SyncedMemory>>> loaded_images;
-        rcc::shared_ptr<IFrameGrabber> fg; // internal frame grabber used for loading the actual files
-    };*/
+        // Decodes the images of a file sequence ahead of the reader on a pool of threads. Keeps a
+        // window of [cursor - keep_behind, cursor + read_ahead] decoded, the lowest pending index is
+        // decoded first so frames become ready in order.
+        class ImageReadAhead
+        {
+        public:
+            ~ImageReadAhead();
+            void start(const std::shared_ptr<const std::vector<std::string>>& files, int threads, int read_ahead, int keep_behind);
+            void stop();
+            // Moves the window to index and blocks until it is decoded. hit is set if it was
+            // already decoded. Returns false if the file could not be read.
+            bool get(int index, cv::Mat& image, bool& hit);
+            // Mean imread time in ms since start
+            double decodeLatency();
+            bool running() const { return !_threads.empty(); }
+
+        private:
+            enum State { Pending, Decoding, Ready, Failed };
+            struct Entry
+            {
+                State   state = Pending;
+                cv::Mat image;
+            };
+            void decodeLoop();
+            void updateWindow(int cursor);
+
+            std::shared_ptr<const std::vector<std::string>> _files;
+            std::vector<boost::thread> _threads;
+            boost::mutex               _mtx;
+            boost::condition_variable  _work_cv;
+            boost::condition_variable  _ready_cv;
+            std::map<int, Entry>       _entries;
+            int                        _read_ahead  = 0;
+            int                        _keep_behind = 0;
+            bool                       _stop        = false;
+            double                     _decode_time = 0.0;
+            size_t                     _decoded     = 0;
+        };
+
+        // Image sequence from a directory or a glob on the file name (/data/frame_*.jpg), in file
+        // name order. Frame n gets timestamp n / frame_rate.
+        class frame_grabbers_EXPORT GrabberDirectory : public IGrabber
+        {
+        public:
+            static int canLoad(const std::string& path);
+            static int loadTimeout();
+            MO_DERIVE(GrabberDirectory, IGrabber)
+                PARAM(int, decode_threads, 4)
+                PARAM(int, read_ahead, 32)
+                TOOLTIP(read_ahead, "Number of frames decoded ahead of the current frame")
+                PARAM(int, keep_behind, 8)
+                TOOLTIP(keep_behind, "Number of already emitted frames kept decoded for stepping backward")
+                PARAM(double, frame_rate, 30.0)
+                PARAM(bool, loop, false)
+                MO_SLOT(void, seek, int)
+                MO_SLOT(void, stepBackward)
+                MO_SLOT(void, restart)
+                MO_SIGNAL(void, eos)
+                STATUS(int, frame_index, 0)
+                STATUS(int, num_frames, 0)
+                STATUS(float, cache_hit_rate, 0.0f)
+                STATUS(float, decode_latency, 0.0f)
+                SOURCE(SyncedMemory, image, {})
+                APPEND_FLAGS(image, mo::Source_e)
+                OUTPUT(std::string, current_file, {})
+            MO_END;
+            ~GrabberDirectory();
+            virtual bool loadData(const std::string& path);
+            virtual bool grab();
+
+        protected:
+            static std::vector<std::string> listImages(const std::string& path, size_t max_count = 0);
+
+            std::shared_ptr<const std::vector<std::string>> _files;
+            ImageReadAhead   _cache;
+            std::atomic<int> _next_index{0};
+            size_t           _requests = 0;
+            size_t           _hits     = 0;
+            bool             _eos_sent = false;
+        };
     }
 }
@@ -40,7 +40,7 @@ void GrabberGstreamer::listPaths(std::vector<std::string>& paths)
 bool GrabberGstreamer::loadData(const std::string& file_path_)
 {
     std::string file_path = file_path_;
-
+    stopDecodeAhead();
     h_cam.reset(new cv::VideoCapture(file_path_, cv::CAP_GSTREAMER));
     if(h_cam->isOpened())
     {
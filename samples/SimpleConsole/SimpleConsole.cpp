@@ -33,6 +33,7 @@
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/version.hpp>
 #include <signal.h> // SIGINT, etc
@@ -43,7 +44,10 @@
 #include <cuda_runtime.h>
 #include <cuda_runtime_api.h>
 
+#include <atomic>
 #include <fstream>
+#include <iomanip>
+#include <memory>
 
 std::string printParam(mo::IParam* param) {
     std::stringstream ss;
@@ -159,6 +163,62 @@ void printStatus(aq::nodes::Node* node, std::vector<std::string>& printed_nodes)
     }
 }
 
+// Profile status outputs of a node, prefix stripped, in declaration order
+struct NodeLatency {
+    std::string                                      node;
+    std::vector<std::pair<std::string, std::string> > values;
+};
+
+void collectLatency(aq::nodes::Node* node, std::vector<NodeLatency>& latencies, std::vector<std::string>& visited) {
+    std::string name = node->getTreeName();
+    if (std::find(visited.begin(), visited.end(), name) != visited.end()) {
+        return;
+    }
+    visited.push_back(name);
+    NodeLatency latency;
+    latency.node = name;
+    for (auto param : node->getAllParams()) {
+        const std::string& param_name = param->getName();
+        if (param_name.compare(0, 8, "profile_") != 0 || !param->checkFlags(mo::State_e)) {
+            continue;
+        }
+        auto func = mo::SerializationFactory::instance()->getTextSerializationFunction(param->getTypeInfo());
+        if (func) {
+            std::stringstream ss;
+            func(param, ss);
+            latency.values.emplace_back(param_name.substr(8), ss.str());
+        }
+    }
+    if (latency.values.size()) {
+        latencies.push_back(latency);
+    }
+    for (auto child : node->getChildren()) {
+        collectLatency(child.get(), latencies, visited);
+    }
+}
+
+void printLatency(const std::vector<NodeLatency>& latencies, bool json, std::ostream& os) {
+    if (json) {
+        os << "[\n";
+        for (size_t i = 0; i < latencies.size(); ++i) {
+            os << "  {\"node\": \"" << latencies[i].node << "\"";
+            for (const auto& value : latencies[i].values) {
+                os << ", \"" << value.first << "\": " << value.second;
+            }
+            os << (i + 1 < latencies.size() ? "},\n" : "}\n");
+        }
+        os << "]" << std::endl;
+        return;
+    }
+    for (const auto& latency : latencies) {
+        os << latency.node << "\n";
+        for (const auto& value : latency.values) {
+            os << "  " << std::left << std::setw(14) << value.first << value.second << "\n";
+        }
+    }
+    os << std::flush;
+}
+
 static volatile bool quit;
 
 void sig_handler(int s) {
@@ -198,6 +258,237 @@ void sig_handler(int s) {
     }
 }
 
+// '*' and '?' wildcard match, used to expand batch mode input globs
+bool matchWildcard(const char* pattern, const char* str) {
+    if (*pattern == '\0')
+        return *str == '\0';
+    if (*pattern == '*')
+        return matchWildcard(pattern + 1, str) || (*str != '\0' && matchWildcard(pattern, str + 1));
+    if (*str != '\0' && (*pattern == '?' || *pattern == *str))
+        return matchWildcard(pattern + 1, str + 1);
+    return false;
+}
+
+// Expands the batch mode inputs into a sorted list of files. An input is a file, a directory
+// (all regular files in it), a glob on the file name (/data/*.mp4) or @list.txt with one input per line
+std::vector<std::string> expandBatchInputs(const std::vector<std::string>& inputs) {
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        if (input.empty())
+            continue;
+        if (input[0] == '@') {
+            std::ifstream ifs(input.substr(1));
+            if (!ifs) {
+                MO_LOG(warning) << "Unable to open input list " << input.substr(1);
+                continue;
+            }
+            std::vector<std::string> listed;
+            std::string              line;
+            while (std::getline(ifs, line)) {
+                if (line.size() && line[0] != '#')
+                    listed.push_back(line);
+            }
+            auto expanded = expandBatchInputs(listed);
+            files.insert(files.end(), expanded.begin(), expanded.end());
+            continue;
+        }
+        boost::filesystem::path path(input);
+        std::vector<std::string> matched;
+        if (boost::filesystem::is_directory(path)) {
+            for (boost::filesystem::directory_iterator itr(path), end; itr != end; ++itr) {
+                if (boost::filesystem::is_regular_file(itr->path()))
+                    matched.push_back(itr->path().string());
+            }
+        } else if (input.find_first_of("*?") != std::string::npos) {
+            boost::filesystem::path dir     = path.parent_path().empty() ? boost::filesystem::path(".") : path.parent_path();
+            std::string             pattern = path.filename().string();
+            if (boost::filesystem::is_directory(dir)) {
+                for (boost::filesystem::directory_iterator itr(dir), end; itr != end; ++itr) {
+                    if (boost::filesystem::is_regular_file(itr->path()) &&
+                        matchWildcard(pattern.c_str(), itr->path().filename().string().c_str()))
+                        matched.push_back(itr->path().string());
+                }
+            }
+            if (matched.empty())
+                MO_LOG(warning) << "No files match " << input;
+        } else {
+            matched.push_back(input);
+        }
+        std::sort(matched.begin(), matched.end());
+        files.insert(files.end(), matched.begin(), matched.end());
+    }
+    return files;
+}
+
+struct BatchResult {
+    std::string file;
+    size_t      frames    = 0;
+    double      wall_time = 0.0;
+    bool        eos       = false;
+    std::string error;
+};
+
+// Number of frames the frame grabbers of a stream have published so far, from the frame number
+// of their current_frame output
+size_t framesProcessed(aq::IDataStream* stream) {
+    size_t frames = 0;
+    for (auto& node : stream->getTopLevelNodes()) {
+        if (auto fg = node.DynamicCast<aq::nodes::IFrameGrabber>()) {
+            mo::IParam* output = fg->getOutput("current_frame");
+            if (output == nullptr)
+                continue;
+            const size_t fn = output->getFrameNumber();
+            if (fn != std::numeric_limits<size_t>::max())
+                frames = std::max(frames, fn + 1);
+        }
+    }
+    return frames;
+}
+
+// Sum of the frame numbers of every node output of a stream, stops changing once the nodes behind
+// the frame grabbers have caught up with the last frame
+size_t streamProgress(aq::IDataStream* stream) {
+    size_t progress = 0;
+    for (auto& node : stream->getAllNodes()) {
+        for (mo::IParam* output : node->getOutputs()) {
+            const size_t fn = output->getFrameNumber();
+            if (fn != std::numeric_limits<size_t>::max())
+                progress += fn;
+        }
+    }
+    return progress;
+}
+
+// Loads one input into its own data streams and runs them until every stream signals end of stream
+// and its nodes have processed the last frames, the timeout expires or the program is asked to quit. With a config the input is substituted for
+// ${file} in the saved graph, without one a frame grabber is picked for it as with load_file.
+BatchResult processBatchFile(const std::string& file, const std::string& config, const std::string& preset,
+    std::map<std::string, std::string> variable_replace_map, std::map<std::string, std::string> replace_map,
+    int timeout, boost::mutex& load_mtx) {
+    BatchResult result;
+    result.file = file;
+
+    boost::mutex                                      eos_mtx;
+    boost::condition_variable                         eos_cv;
+    std::vector<char>                                 stream_eos;
+    size_t                                            eos_count = 0;
+    std::vector<std::unique_ptr<mo::TSlot<void()> > > eos_slots;
+    std::vector<rcc::shared_ptr<aq::IDataStream> >    streams;
+    std::vector<std::shared_ptr<mo::Connection> >     eos_connections;
+
+    auto start = boost::posix_time::microsec_clock::universal_time();
+    try {
+        {
+            // Object construction goes through the shared factory, only the processing runs in parallel
+            boost::mutex::scoped_lock lock(load_mtx);
+            if (config.size()) {
+                replace_map["${file}"]      = file;
+                replace_map["${file_stem}"] = boost::filesystem::path(file).stem().string();
+                streams                     = aq::IDataStream::load(config, variable_replace_map, replace_map, preset);
+            } else if (auto stream = aq::IDataStream::create(file, "")) {
+                streams.push_back(stream);
+            }
+        }
+        if (streams.empty()) {
+            result.error = "load failed";
+            return result;
+        }
+        // One slot per stream, a config with several streams is done once all of them ended
+        stream_eos.resize(streams.size(), 0);
+        for (size_t i = 0; i < streams.size(); ++i) {
+            eos_slots.emplace_back(new mo::TSlot<void()>(std::bind([&eos_mtx, &eos_cv, &stream_eos, &eos_count, i]() {
+                boost::mutex::scoped_lock lock(eos_mtx);
+                if (!stream_eos[i]) {
+                    stream_eos[i] = 1;
+                    ++eos_count;
+                }
+                eos_cv.notify_all();
+            })));
+            eos_connections.push_back(streams[i]->getRelayManager()->connect(eos_slots.back().get(), "eos"));
+        }
+        for (auto& stream : streams)
+            stream->startThread();
+        start = boost::posix_time::microsec_clock::universal_time();
+        auto timedOut = [&start, timeout]() {
+            return timeout > 0 &&
+                   boost::posix_time::time_duration(boost::posix_time::microsec_clock::universal_time() - start).total_seconds() >= timeout;
+        };
+
+        {
+            boost::mutex::scoped_lock lock(eos_mtx);
+            while (eos_count < streams.size() && !quit) {
+                eos_cv.wait_for(lock, boost::chrono::milliseconds(100));
+                if (timedOut()) {
+                    result.error = "timeout";
+                    break;
+                }
+            }
+            result.eos = eos_count == streams.size();
+        }
+        // The grabbers are done, the nodes behind them may still be working on the last frames
+        size_t progress = 0;
+        for (auto& stream : streams)
+            progress += streamProgress(stream.get());
+        while (result.eos && !quit && !timedOut()) {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+            size_t current = 0;
+            for (auto& stream : streams)
+                current += streamProgress(stream.get());
+            if (current == progress)
+                break;
+            progress = current;
+        }
+        if (quit && result.error.empty())
+            result.error = "interrupted";
+    } catch (std::exception& e) {
+        result.error = e.what();
+    } catch (...) {
+        result.error = "unknown exception";
+    }
+    result.wall_time = boost::posix_time::time_duration(boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 1e-6;
+    for (auto& stream : streams) {
+        stream->stopThread();
+        result.frames += framesProcessed(stream.get());
+    }
+    eos_connections.clear();
+    streams.clear();
+    return result;
+}
+
+// One line per input, csv unless the path ends in .json
+void writeBatchSummary(const std::string& path, const std::vector<BatchResult>& results) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        MO_LOG(warning) << "Unable to write batch summary to " << path;
+        return;
+    }
+    const bool json = boost::filesystem::path(path).extension() == ".json";
+    if (json) {
+        ofs << "[\n";
+    } else {
+        ofs << "file,frames,wall_time_s,fps,eos,error\n";
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BatchResult& result = results[i];
+        const double       fps    = result.wall_time > 0.0 ? result.frames / result.wall_time : 0.0;
+        std::string        error  = result.error;
+        std::replace(error.begin(), error.end(), '"', '\'');
+        std::replace(error.begin(), error.end(), '\n', ' ');
+        if (json) {
+            std::string file = result.file;
+            std::replace(file.begin(), file.end(), '\\', '/');
+            ofs << "  {\"file\": \"" << file << "\", \"frames\": " << result.frames << ", \"wall_time_s\": " << result.wall_time
+                << ", \"fps\": " << fps << ", \"eos\": " << (result.eos ? "true" : "false") << ", \"error\": \"" << error << "\"}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        } else {
+            ofs << "\"" << result.file << "\"," << result.frames << "," << result.wall_time << "," << fps << ","
+                << result.eos << ",\"" << error << "\"\n";
+        }
+    }
+    if (json)
+        ofs << "]\n";
+}
+
 int main(int argc, char* argv[]) {
     BOOST_LOG_TRIVIAL(info) << "Initializing";
     boost::program_options::options_description desc("Allowed options");
@@ -212,6 +503,10 @@ int main(int argc, char* argv[]) {
             ("log", boost::program_options::value<std::string>()->default_value("info"), "Logging verbosity. trace, debug, info, warning, error, fatal")
             ("log-dir", boost::program_options::value<std::string>(), "directory for log output")
             ("mode", boost::program_options::value<std::string>()->default_value("interactive"), "Processing mode, options are interactive or batch")
+            ("input,i", boost::program_options::value<std::vector<std::string>>()->multitoken(), "Batch mode - files, directories, globs or @list files to process")
+            ("workers", boost::program_options::value<int>()->default_value(1), "Batch mode - number of inputs processed in parallel")
+            ("timeout", boost::program_options::value<int>()->default_value(0), "Batch mode - seconds before an input is abandoned, 0 to wait for end of stream")
+            ("summary", boost::program_options::value<std::string>()->default_value("batch_summary.csv"), "Batch mode - per file summary, csv or .json")
             ("script,s", boost::program_options::value<std::string>(), "Text file with scripting commands")
             ("profile,p", boost::program_options::bool_switch(), "Profile application")
             ("gpu", boost::program_options::value<int>()->default_value(0), "")
@@ -433,8 +728,61 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    int exit_code = 0;
     if (vm["mode"].as<std::string>() == "batch") {
-
+        std::vector<std::string> inputs;
+        if (vm.count("input"))
+            inputs = vm["input"].as<std::vector<std::string> >();
+        if (vm.count("file"))
+            inputs.push_back(vm["file"].as<std::string>());
+        const std::vector<std::string> files   = expandBatchInputs(inputs);
+        const std::string              config  = vm.count("config") ? vm["config"].as<std::string>() : std::string();
+        const std::string              preset  = vm["preset"].as<std::string>();
+        const int                      timeout = vm["timeout"].as<int>();
+        const int workers = std::max(1, std::min(vm["workers"].as<int>(), static_cast<int>(files.size())));
+        if (files.empty()) {
+            MO_LOG(error) << "Batch mode requires at least one --input";
+            exit_code = 1;
+        } else {
+            MO_LOG(info) << "Processing " << files.size() << " files with " << workers << " workers" << (config.size() ? " using " + config : std::string());
+            signal(SIGINT, sig_handler);
+            std::vector<BatchResult> results(files.size());
+            std::atomic<size_t>      next_file(0);
+            boost::mutex             load_mtx;
+            auto                     batch_start = boost::posix_time::microsec_clock::universal_time();
+            boost::thread_group      worker_threads;
+            for (int i = 0; i < workers; ++i) {
+                worker_threads.create_thread([&, i]() {
+                    mo::setThreadName("batch-worker-" + boost::lexical_cast<std::string>(i));
+                    for (size_t idx = next_file++; idx < files.size() && !quit; idx = next_file++) {
+                        results[idx] = processBatchFile(files[idx], config, preset, variable_replace_map, replace_map, timeout, load_mtx);
+                        const BatchResult& result = results[idx];
+                        MO_LOG(info) << "[" << idx + 1 << "/" << files.size() << "] " << result.file << ": " << result.frames << " frames in "
+                                     << result.wall_time << " s" << (result.error.size() ? " (" + result.error + ")" : std::string());
+                    }
+                });
+            }
+            worker_threads.join_all();
+            const double batch_time = boost::posix_time::time_duration(boost::posix_time::microsec_clock::universal_time() - batch_start).total_microseconds() * 1e-6;
+
+            size_t total_frames = 0;
+            size_t failed       = 0;
+            for (size_t i = 0; i < results.size(); ++i) {
+                // Inputs never started because of an interrupt
+                if (results[i].file.empty()) {
+                    results[i].file  = files[i];
+                    results[i].error = "not processed";
+                }
+                total_frames += results[i].frames;
+                if (results[i].error.size())
+                    ++failed;
+            }
+            writeBatchSummary(vm["summary"].as<std::string>(), results);
+            std::cout << "Processed " << files.size() - failed << "/" << files.size() << " files, " << total_frames << " frames in "
+                      << batch_time << " s (" << (batch_time > 0.0 ? total_frames / batch_time : 0.0) << " fps), summary written to "
+                      << vm["summary"].as<std::string>() << std::endl;
+            exit_code = failed ? 1 : 0;
+        }
     } else {
         std::vector<rcc::shared_ptr<aq::IDataStream> > _dataStreams;
         rcc::weak_ptr<aq::IDataStream>                 current_stream;
@@ -470,6 +818,9 @@ int main(int argc, char* argv[]) {
                          "    name parameters -- signal name and parameters\n"
                          " - save             -- Save node configuration\n"
                          " - load             -- Load node configuration\n"
+                         " - latency          -- Print process time, input wait time (ms) and throughput of profiled nodes\n"
+                         "    json            -- print as json\n"
+                         "    file            -- write to file instead of the console\n"
                          " - help             -- Print this help\n"
                          " - quit             -- Close program and cleanup\n"
                          " - log              -- change logging level\n"
@@ -941,6 +1292,42 @@ int main(int argc, char* argv[]) {
 
         connections.push_back(manager.connect(slot, "help"));
 
+        slot = new mo::TSlot<void(std::string)>(std::bind([&_dataStreams](std::string args) -> void {
+            bool        json = false;
+            std::string file;
+            std::stringstream ss(args);
+            std::string arg;
+            while (ss >> arg) {
+                if (arg == "json") {
+                    json = true;
+                } else {
+                    file = arg;
+                }
+            }
+            std::vector<NodeLatency> latencies;
+            std::vector<std::string> visited;
+            for (auto& stream : _dataStreams) {
+                for (auto node : stream->getNodes()) {
+                    collectLatency(node.get(), latencies, visited);
+                }
+            }
+            if (file.empty()) {
+                if (latencies.empty())
+                    std::cout << "No profiled nodes" << std::endl;
+                printLatency(latencies, json, std::cout);
+            } else {
+                std::ofstream ofs(file);
+                if (!ofs) {
+                    std::cout << "Unable to open " << file << std::endl;
+                    return;
+                }
+                printLatency(latencies, json, ofs);
+                std::cout << "Wrote latency of " << latencies.size() << " nodes to " << file << std::endl;
+            }
+        }, std::placeholders::_1));
+        _slots.emplace_back(slot);
+        connections.push_back(manager.connect(slot, "latency"));
+
         slot = new mo::TSlot<void(std::string)>(std::bind([](std::string filter) -> void {
             auto constructors = mo::MetaObjectFactory::instance()->getConstructors();
             std::map<std::string, std::vector<IObjectConstructor*> > interface_map;
@@ -1437,5 +1824,5 @@ int main(int argc, char* argv[]) {
     table.cleanUp();
     std::cout << "Program exiting" << std::endl;
     std::cout << "Program exiting" << std::endl;
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,693 @@
+// Throughput benchmark for node pipelines.
+// Builds synthetic pipelines out of registered nodes, feeds them host (cv::Mat) frames and
+// reports per node latency percentiles, frames per second and allocations as JSON so that
+// results from two builds can be diffed.
+//
+// perf_bench --frames 500 --output results.json
+// perf_bench --pipeline "Resize:width=640:height=360,Threshold:min=128" --output resize.json
+// perf_bench --preprocess --output preprocess.json
+#include <Aquila/core/Aquila.hpp>
+#include <Aquila/core/IDataStream.hpp>
+#include <Aquila/nodes/Node.hpp>
+#include <Aquila/nodes/NodeInfo.hpp>
+#include <Aquila/types/ObjectDetection.hpp>
+#include <Aquila/types/SyncedMemory.hpp>
+
+#include <MetaObject/logging/logging.hpp>
+#include <MetaObject/object/MetaObjectFactory.hpp>
+#include <MetaObject/params/detail/TInputParamPtrImpl.hpp>
+#include <MetaObject/params/detail/TParamPtrImpl.hpp>
+#include <MetaObject/serialization/SerializationFactory.hpp>
+
+#include "Aquila/rcc/SystemTable.hpp"
+#include "MetaObject/MetaParameters.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#ifdef HAVE_BLOB_PREPROCESSING
+#include <BlobPreprocessing.hpp>
+#endif
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+
+namespace po = boost::program_options;
+
+// ---------------------------------------------------------------------------------------------
+// Allocation counting. Heap allocations are counted for the whole process and for the calling
+// thread, the latter is what gets attributed to the node being processed. Matrix allocations
+// are counted separately through cv::Mat's default allocator since they don't go through new.
+namespace {
+std::atomic<size_t> g_heap_allocs(0);
+thread_local size_t t_heap_allocs = 0;
+thread_local size_t t_mat_allocs  = 0;
+thread_local size_t t_mat_bytes   = 0;
+}
+
+void* operator new(size_t size) {
+    ++g_heap_allocs;
+    ++t_heap_allocs;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    explicit CountingMatAllocator(cv::MatAllocator* allocator)
+        : _allocator(allocator) {
+    }
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags, cv::UMatUsageFlags usage) const {
+        cv::UMatData* u = _allocator->allocate(dims, sizes, type, data, step, flags, usage);
+        if (u && !data) {
+            ++t_mat_allocs;
+            t_mat_bytes += u->size;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, int access_flags, cv::UMatUsageFlags usage) const {
+        return _allocator->allocate(data, access_flags, usage);
+    }
+
+    void deallocate(cv::UMatData* data) const {
+        _allocator->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator* _allocator;
+};
+
+struct AllocationSnapshot {
+    size_t heap_allocs;
+    size_t mat_allocs;
+    size_t mat_bytes;
+    static AllocationSnapshot now() {
+        return {t_heap_allocs, t_mat_allocs, t_mat_bytes};
+    }
+};
+}
+
+// ---------------------------------------------------------------------------------------------
+// Frame source. Frames are generated up front and cycled so the source itself doesn't
+// allocate while the pipeline is being measured.
+namespace aq {
+namespace nodes {
+    class BenchmarkSource : public Node {
+    public:
+        MO_DERIVE(BenchmarkSource, Node)
+            PARAM(int, width, 1920)
+            PARAM(int, height, 1080)
+            PARAM(int, channels, 3)
+            PARAM(int, num_objects, 40)
+            PARAM(int, unique_frames, 8)
+            OUTPUT(SyncedMemory, image, SyncedMemory())
+            OUTPUT(std::vector<DetectedObject>, detections, {})
+        MO_END
+    protected:
+        bool processImpl();
+        void generate();
+
+        std::vector<cv::Mat>                      _frames;
+        std::vector<std::vector<DetectedObject> > _detections;
+        size_t                                    _frame_number = 0;
+    };
+}
+}
+
+using namespace aq;
+using namespace aq::nodes;
+
+void BenchmarkSource::generate() {
+    std::mt19937                          rng(1234);
+    std::uniform_int_distribution<int>    intensity(0, 255);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const int                             count = std::max(unique_frames, 1);
+    _frames.clear();
+    _detections.clear();
+    for (int i = 0; i < count; ++i) {
+        // Noisy background with filled shapes so thresholding, contours and segmentation have
+        // something realistic to work on
+        cv::Mat frame(height, width, CV_MAKETYPE(CV_8U, channels));
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(64));
+        std::vector<DetectedObject> detections;
+        for (int j = 0; j < num_objects; ++j) {
+            const float      w = (0.02f + 0.1f * unit(rng)) * width;
+            const float      h = (0.02f + 0.1f * unit(rng)) * height;
+            const cv::Rect2f box(unit(rng) * (width - w), unit(rng) * (height - h), w, h);
+            const cv::Scalar color(intensity(rng) / 2 + 128, intensity(rng) / 2 + 128, intensity(rng) / 2 + 128);
+            if (j % 2)
+                cv::rectangle(frame, cv::Rect(box), color, -1);
+            else
+                cv::ellipse(frame, cv::RotatedRect((box.tl() + box.br()) * 0.5f, box.size(), 0.0f), color, -1);
+            // A detector reports each object a few times with jittered boxes
+            for (int k = 0; k < 3; ++k) {
+                DetectedObject det;
+                det.bounding_box = cv::Rect2f(box.x + (unit(rng) - 0.5f) * 0.1f * w, box.y + (unit(rng) - 0.5f) * 0.1f * h,
+                                              w * (0.95f + 0.1f * unit(rng)), h * (0.95f + 0.1f * unit(rng)));
+                det.classification.confidence  = unit(rng);
+                det.classification.classNumber = j % 4;
+                detections.push_back(det);
+            }
+        }
+        _frames.push_back(frame);
+        _detections.push_back(detections);
+    }
+}
+
+bool BenchmarkSource::processImpl() {
+    if (_frames.empty() || width_param.modified() || height_param.modified() || channels_param.modified() ||
+        num_objects_param.modified() || unique_frames_param.modified()) {
+        generate();
+        width_param.modified(false);
+        height_param.modified(false);
+        channels_param.modified(false);
+        num_objects_param.modified(false);
+        unique_frames_param.modified(false);
+    }
+    const size_t idx = _frame_number % _frames.size();
+    // 30 fps timestamps
+    const mo::Time_t ts(static_cast<double>(_frame_number) * 33.333 * mo::ms);
+    image_param.updateData(_frames[idx], mo::tag::_timestamp = ts, mo::tag::_frame_number = _frame_number, _ctx.get());
+    detections_param.updateData(_detections[idx], mo::tag::_timestamp = ts, mo::tag::_frame_number = _frame_number, _ctx.get());
+    ++_frame_number;
+    return true;
+}
+
+MO_REGISTER_CLASS(BenchmarkSource)
+
+// ---------------------------------------------------------------------------------------------
+// Pipelines
+namespace {
+struct StageDesc {
+    std::string                                       node;
+    std::vector<std::pair<std::string, std::string> > params;
+};
+
+struct PipelineDesc {
+    std::string            name;
+    std::vector<StageDesc> stages;
+};
+
+std::vector<PipelineDesc> builtinPipelines(const std::string& scratch_dir) {
+    std::vector<PipelineDesc> pipelines;
+    pipelines.push_back({"threshold_contours",
+                         {{"Resize", {{"width", "960"}, {"height", "540"}}},
+                          {"Threshold", {{"min", "128"}, {"source_value", "0"}}},
+                          {"FindContours", {}},
+                          {"ContourBoundingBox", {}}}});
+    pipelines.push_back({"egbs_segmentation",
+                         {{"Resize", {{"width", "320"}, {"height", "180"}}},
+                          {"SegmentEGBS", {}}}});
+    pipelines.push_back({"detection_nms_writer",
+                         {{"DetectionNMS", {}},
+                          {"DetectionWriter", {{"output_directory", scratch_dir + "/detection_writer"}}}}});
+    return pipelines;
+}
+
+// "Resize:width=640:height=360,Threshold:min=128"
+PipelineDesc parsePipeline(const std::string& spec) {
+    PipelineDesc             pipeline;
+    std::vector<std::string> stages;
+    boost::split(stages, spec, boost::is_any_of(","), boost::token_compress_on);
+    for (const auto& stage_spec : stages) {
+        std::vector<std::string> tokens;
+        boost::split(tokens, stage_spec, boost::is_any_of(":"));
+        StageDesc stage;
+        stage.node = boost::trim_copy(tokens[0]);
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            auto pos = tokens[i].find('=');
+            if (pos != std::string::npos)
+                stage.params.emplace_back(tokens[i].substr(0, pos), tokens[i].substr(pos + 1));
+        }
+        if (!stage.node.empty()) {
+            if (!pipeline.name.empty())
+                pipeline.name += "_";
+            pipeline.name += stage.node;
+            pipeline.stages.push_back(stage);
+        }
+    }
+    return pipeline;
+}
+
+bool setParam(aq::nodes::Node* node, const std::string& name, const std::string& value) {
+    mo::IParam* param = node->getParam(name);
+    if (param == nullptr) {
+        MO_LOG(warning) << node->getTreeName() << " has no parameter named " << name;
+        return false;
+    }
+    auto func = mo::SerializationFactory::instance()->getTextDeSerializationFunction(param->getTypeInfo());
+    if (!func) {
+        MO_LOG(warning) << "No text deserialization function for " << param->getTreeName();
+        return false;
+    }
+    std::stringstream ss;
+    ss << value;
+    mo::Mutex_t::scoped_lock lock(param->mtx());
+    return func(param, ss);
+}
+
+// Connects each input to the matching output of the closest upstream node
+void connectInputs(const std::vector<rcc::shared_ptr<aq::nodes::Node> >& nodes, size_t idx) {
+    auto& node = nodes[idx];
+    for (mo::InputParam* input : node->getInputs()) {
+        bool connected = false;
+        for (size_t j = idx; j-- > 0 && !connected;) {
+            for (mo::IParam* output : nodes[j]->getOutputs()) {
+                if (output->getTypeInfo() == input->getTypeInfo()) {
+                    connected = node->connectInput(nodes[j], output, input, mo::ForceDirectConnection_e);
+                    break;
+                }
+            }
+        }
+        if (!connected && !input->checkFlags(mo::Optional_e)) {
+            MO_LOG(warning) << "No upstream output for " << input->getTreeName();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// Results
+struct NodeResult {
+    std::string name;
+    size_t      executions            = 0;
+    double      mean_us               = 0.0;
+    double      p50_us                = 0.0;
+    double      p90_us                = 0.0;
+    double      p99_us                = 0.0;
+    double      max_us                = 0.0;
+    double      heap_allocs_per_frame = 0.0;
+    double      mat_allocs_per_frame  = 0.0;
+    double      mat_bytes_per_frame   = 0.0;
+
+    template <class AR>
+    void serialize(AR& ar) {
+        ar(CEREAL_NVP(name), CEREAL_NVP(executions), CEREAL_NVP(mean_us), CEREAL_NVP(p50_us), CEREAL_NVP(p90_us),
+            CEREAL_NVP(p99_us), CEREAL_NVP(max_us), CEREAL_NVP(heap_allocs_per_frame), CEREAL_NVP(mat_allocs_per_frame),
+            CEREAL_NVP(mat_bytes_per_frame));
+    }
+};
+
+struct PipelineResult {
+    std::string             name;
+    size_t                  frames                = 0;
+    double                  fps                   = 0.0;
+    double                  mean_frame_us         = 0.0;
+    double                  p99_frame_us          = 0.0;
+    // Includes allocations from worker threads owned by the nodes
+    double                  heap_allocs_per_frame = 0.0;
+    std::vector<NodeResult> nodes;
+
+    template <class AR>
+    void serialize(AR& ar) {
+        ar(CEREAL_NVP(name), CEREAL_NVP(frames), CEREAL_NVP(fps), CEREAL_NVP(mean_frame_us), CEREAL_NVP(p99_frame_us),
+            CEREAL_NVP(heap_allocs_per_frame), CEREAL_NVP(nodes));
+    }
+};
+
+struct LatencyStats {
+    double mean = 0.0;
+    double p50  = 0.0;
+    double p90  = 0.0;
+    double p99  = 0.0;
+    double max  = 0.0;
+};
+
+// Nearest rank percentiles
+LatencyStats computeStats(std::vector<double> samples) {
+    LatencyStats stats;
+    if (samples.empty())
+        return stats;
+    std::sort(samples.begin(), samples.end());
+    auto rank = [&samples](double p) {
+        size_t idx = static_cast<size_t>(std::ceil(p * samples.size()));
+        return samples[std::min(std::max<size_t>(idx, 1), samples.size()) - 1];
+    };
+    for (double s : samples)
+        stats.mean += s;
+    stats.mean /= samples.size();
+    stats.p50 = rank(0.5);
+    stats.p90 = rank(0.9);
+    stats.p99 = rank(0.99);
+    stats.max = samples.back();
+    return stats;
+}
+
+double elapsedUs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool runPipeline(const PipelineDesc& desc, const std::vector<std::pair<std::string, std::string> >& source_params, int warmup, int frames,
+    PipelineResult& result) {
+    result      = PipelineResult();
+    result.name = desc.name;
+    auto stream = aq::IDataStream::create("", "");
+    if (!stream) {
+        MO_LOG(warning) << "Unable to create a data stream";
+        return false;
+    }
+
+    // All nodes are top level so each process() call only covers one node
+    std::vector<rcc::shared_ptr<aq::nodes::Node> > nodes;
+    std::vector<StageDesc>                         stages;
+    stages.push_back({"BenchmarkSource", source_params});
+    stages.insert(stages.end(), desc.stages.begin(), desc.stages.end());
+    for (const auto& stage : stages) {
+        auto added = stream->addNode(stage.node);
+        if (added.empty()) {
+            MO_LOG(warning) << "Unable to create " << stage.node << ", is the plugin providing it loaded?";
+            return false;
+        }
+        rcc::shared_ptr<aq::nodes::Node> node(added[0]);
+        for (const auto& param : stage.params) {
+            if (!setParam(node.get(), param.first, param.second))
+                MO_LOG(warning) << "Unable to set " << stage.node << "." << param.first << " to " << param.second;
+        }
+        nodes.push_back(node);
+        connectInputs(nodes, nodes.size() - 1);
+    }
+
+    for (int i = 0; i < warmup; ++i) {
+        for (auto& node : nodes)
+            node->process();
+    }
+
+    std::vector<std::vector<double> > latency(nodes.size());
+    std::vector<AllocationSnapshot>   allocs(nodes.size(), AllocationSnapshot{0, 0, 0});
+    std::vector<size_t>               executions(nodes.size(), 0);
+    std::vector<double>               frame_latency;
+    for (auto& samples : latency)
+        samples.reserve(frames);
+    frame_latency.reserve(frames);
+
+    const size_t heap_start  = g_heap_allocs.load();
+    const auto   bench_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        const auto frame_start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            const AllocationSnapshot before = AllocationSnapshot::now();
+            const auto               start  = std::chrono::steady_clock::now();
+            const bool               ran    = nodes[n]->process();
+            const double             us     = elapsedUs(start);
+            const AllocationSnapshot after  = AllocationSnapshot::now();
+            latency[n].push_back(us);
+            allocs[n].heap_allocs += after.heap_allocs - before.heap_allocs;
+            allocs[n].mat_allocs += after.mat_allocs - before.mat_allocs;
+            allocs[n].mat_bytes += after.mat_bytes - before.mat_bytes;
+            executions[n] += ran ? 1 : 0;
+        }
+        frame_latency.push_back(elapsedUs(frame_start));
+    }
+    const double total_us = elapsedUs(bench_start);
+
+    result.frames                = static_cast<size_t>(frames);
+    result.fps                   = total_us > 0.0 ? frames * 1e6 / total_us : 0.0;
+    result.heap_allocs_per_frame = frames ? double(g_heap_allocs.load() - heap_start) / frames : 0.0;
+    const LatencyStats frame_stats = computeStats(frame_latency);
+    result.mean_frame_us           = frame_stats.mean;
+    result.p99_frame_us            = frame_stats.p99;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        const LatencyStats stats = computeStats(latency[n]);
+        NodeResult         node;
+        node.name                  = stages[n].node;
+        node.executions            = executions[n];
+        node.mean_us               = stats.mean;
+        node.p50_us                = stats.p50;
+        node.p90_us                = stats.p90;
+        node.p99_us                = stats.p99;
+        node.max_us                = stats.max;
+        node.heap_allocs_per_frame = frames ? double(allocs[n].heap_allocs) / frames : 0.0;
+        node.mat_allocs_per_frame  = frames ? double(allocs[n].mat_allocs) / frames : 0.0;
+        node.mat_bytes_per_frame   = frames ? double(allocs[n].mat_bytes) / frames : 0.0;
+        result.nodes.push_back(node);
+    }
+    return true;
+}
+
+#ifdef HAVE_BLOB_PREPROCESSING
+// ---------------------------------------------------------------------------------------------
+// Network input preparation, the cv:: call sequence INeuralNet used on the host against the
+// fused single pass routine that replaced it
+struct PreprocessResult {
+    int    rois          = 0;
+    int    net_width     = 0;
+    int    net_height    = 0;
+    double sequential_us = 0.0;
+    double fused_us      = 0.0;
+    double speedup       = 0.0;
+    double max_abs_diff  = 0.0;
+
+    template <class AR>
+    void serialize(AR& ar) {
+        ar(CEREAL_NVP(rois), CEREAL_NVP(net_width), CEREAL_NVP(net_height), CEREAL_NVP(sequential_us), CEREAL_NVP(fused_us),
+            CEREAL_NVP(speedup), CEREAL_NVP(max_abs_diff));
+    }
+};
+
+void preprocessSequential(const cv::Mat& image, const std::vector<cv::Rect>& rois, const cv::Scalar& mean, float scale,
+    std::vector<std::vector<cv::Mat> >& net_input) {
+    cv::Mat float_image;
+    image.convertTo(float_image, CV_32F);
+    cv::subtract(float_image, mean, float_image);
+    float_image *= static_cast<double>(scale);
+    cv::Mat resized;
+    for (size_t i = 0; i < rois.size(); ++i) {
+        cv::resize(float_image(rois[i]), resized, net_input[i][0].size(), 0, 0, cv::INTER_LINEAR);
+        cv::split(resized, net_input[i]);
+    }
+}
+
+PreprocessResult runPreprocess(const cv::Mat& image, int num_rois, cv::Size net_size, int warmup, int frames) {
+    std::mt19937                          rng(num_rois);
+    std::uniform_int_distribution<int>    x_dist(0, image.cols / 2);
+    std::uniform_int_distribution<int>    y_dist(0, image.rows / 2);
+    std::vector<cv::Rect>                 rois;
+    std::vector<std::vector<cv::Mat> >    sequential(num_rois);
+    std::vector<std::vector<cv::Mat> >    fused(num_rois);
+    const cv::Scalar                      mean(104, 117, 123);
+    const float                           scale = 0.00390625f;
+    for (int i = 0; i < num_rois; ++i) {
+        if (num_rois == 1) {
+            rois.emplace_back(0, 0, image.cols, image.rows);
+        } else {
+            const int x = x_dist(rng), y = y_dist(rng);
+            rois.emplace_back(x, y, std::min(image.cols - x, net_size.width * 2), std::min(image.rows - y, net_size.height * 2));
+        }
+        for (int c = 0; c < image.channels(); ++c) {
+            sequential[i].emplace_back(net_size, CV_32F);
+            fused[i].emplace_back(net_size, CV_32F);
+        }
+    }
+
+    auto time = [&](const std::function<void()>& func) {
+        for (int i = 0; i < warmup; ++i)
+            func();
+        std::vector<double> samples;
+        samples.reserve(frames);
+        for (int i = 0; i < frames; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            func();
+            samples.push_back(elapsedUs(start));
+        }
+        return computeStats(samples).p50;
+    };
+
+    PreprocessResult result;
+    result.rois          = num_rois;
+    result.net_width     = net_size.width;
+    result.net_height    = net_size.height;
+    result.sequential_us = time([&]() { preprocessSequential(image, rois, mean, scale, sequential); });
+    result.fused_us      = time([&]() { aq::nodes::preprocessRois(image, rois, mean, scale, fused); });
+    result.speedup       = result.fused_us > 0.0 ? result.sequential_us / result.fused_us : 0.0;
+    for (int i = 0; i < num_rois; ++i) {
+        for (size_t c = 0; c < fused[i].size(); ++c)
+            result.max_abs_diff = std::max(result.max_abs_diff, cv::norm(sequential[i][c], fused[i][c], cv::NORM_INF));
+    }
+    return result;
+}
+#endif
+
+void loadPlugins(const boost::filesystem::path& dir) {
+    if (!boost::filesystem::is_directory(dir))
+        return;
+    boost::filesystem::directory_iterator end_itr;
+    for (boost::filesystem::directory_iterator itr(dir); itr != end_itr; ++itr) {
+        if (boost::filesystem::is_regular_file(itr->path())) {
+#ifdef _MSC_VER
+            if (itr->path().extension() == ".dll")
+#else
+            if (itr->path().extension() == ".so")
+#endif
+            {
+                mo::MetaObjectFactory::instance()->loadPlugin(itr->path().string());
+            }
+        }
+    }
+}
+}
+
+int main(int argc, char* argv[]) {
+    po::options_description desc("Allowed options");
+    // clang-format off
+    desc.add_options()
+            ("help", "Produce help message")
+            ("plugins", po::value<std::string>(), "Path to additional plugins to load")
+            ("pipeline", po::value<std::vector<std::string> >(), "Pipeline to run, either the name of a builtin pipeline or a list of nodes, eg Resize:width=640:height=360,Threshold:min=128. Runs all builtin pipelines if not set")
+            ("list", po::bool_switch(), "List builtin pipelines")
+            ("preprocess", po::bool_switch(), "Benchmark network input preprocessing instead of pipelines")
+            ("frames", po::value<int>()->default_value(300), "Number of measured frames")
+            ("warmup", po::value<int>()->default_value(30), "Number of frames processed before measuring")
+            ("width", po::value<int>()->default_value(1920), "Source frame width")
+            ("height", po::value<int>()->default_value(1080), "Source frame height")
+            ("channels", po::value<int>()->default_value(3), "Source frame channels")
+            ("objects", po::value<int>()->default_value(40), "Objects per source frame")
+            ("scratch-dir", po::value<std::string>()->default_value("perf_bench_scratch"), "Directory for pipelines that write files")
+            ("output,o", po::value<std::string>(), "JSON output file, written to stdout if not set");
+    // clang-format on
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+#ifndef HAVE_BLOB_PREPROCESSING
+    if (vm["preprocess"].as<bool>()) {
+        std::cerr << "--preprocess requires a build with blob preprocessing (HAVE_BLOB_PREPROCESSING)" << std::endl;
+        return 1;
+    }
+#endif
+
+    const std::string         scratch_dir = vm["scratch-dir"].as<std::string>();
+    std::vector<PipelineDesc> builtins    = builtinPipelines(scratch_dir);
+    if (vm["list"].as<bool>()) {
+        for (const auto& pipeline : builtins) {
+            std::cout << pipeline.name << ":";
+            for (const auto& stage : pipeline.stages)
+                std::cout << " " << stage.node;
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+
+    SystemTable table;
+    mo::MetaObjectFactory::instance(&table);
+    mo::MetaParams::initialize();
+    aq::Init();
+    mo::MetaObjectFactory::instance()->registerTranslationUnit();
+
+    // Host only: keep every matrix on the CPU and count its allocations. Static since matrices
+    // held by plugins and by the factory are released after main returns
+    static CountingMatAllocator mat_allocator(cv::Mat::getStdAllocator());
+    cv::Mat::setDefaultAllocator(&mat_allocator);
+
+#ifdef _MSC_VER
+    mo::MetaObjectFactory::instance()->loadPlugin("aquila_core.dll");
+#else
+    mo::MetaObjectFactory::instance()->loadPlugin("aquila_core.so");
+#endif
+    loadPlugins(boost::filesystem::path(argv[0]).parent_path() / "Plugins");
+    if (vm.count("plugins"))
+        loadPlugins(vm["plugins"].as<std::string>());
+    boost::filesystem::create_directories(scratch_dir);
+
+    std::vector<PipelineDesc> pipelines;
+    if (vm.count("pipeline")) {
+        for (const auto& spec : vm["pipeline"].as<std::vector<std::string> >()) {
+            auto itr = std::find_if(builtins.begin(), builtins.end(), [&spec](const PipelineDesc& p) { return p.name == spec; });
+            pipelines.push_back(itr != builtins.end() ? *itr : parsePipeline(spec));
+        }
+    } else {
+        pipelines = builtins;
+    }
+
+    const std::vector<std::pair<std::string, std::string> > source_params = {
+        {"width", std::to_string(vm["width"].as<int>())},
+        {"height", std::to_string(vm["height"].as<int>())},
+        {"channels", std::to_string(vm["channels"].as<int>())},
+        {"num_objects", std::to_string(vm["objects"].as<int>())}};
+    const int frames = std::max(vm["frames"].as<int>(), 1);
+    const int warmup = std::max(vm["warmup"].as<int>(), 0);
+
+    std::vector<PipelineResult> results;
+    int                         failed = 0;
+#ifdef HAVE_BLOB_PREPROCESSING
+    std::vector<PreprocessResult> preprocess_results;
+    if (vm["preprocess"].as<bool>()) {
+        pipelines.clear();
+        cv::Mat image(vm["height"].as<int>(), vm["width"].as<int>(), CV_MAKETYPE(CV_8U, vm["channels"].as<int>()));
+        cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+        for (int rois : {1, 8}) {
+            preprocess_results.push_back(runPreprocess(image, rois, cv::Size(300, 300), warmup, frames));
+            const PreprocessResult& result = preprocess_results.back();
+            std::cerr << "preprocess " << rois << " rois: sequential " << result.sequential_us << "us fused " << result.fused_us
+                      << "us max diff " << result.max_abs_diff << std::endl;
+        }
+    }
+#endif
+    for (const auto& pipeline : pipelines) {
+        PipelineResult result;
+        if (runPipeline(pipeline, source_params, warmup, frames, result)) {
+            std::cerr << pipeline.name << ": " << result.fps << " fps" << std::endl;
+            for (const auto& node : result.nodes) {
+                std::cerr << "  " << node.name << " p50 " << node.p50_us << "us p99 " << node.p99_us << "us "
+                          << node.heap_allocs_per_frame << " allocs/frame" << std::endl;
+            }
+            results.push_back(result);
+        } else {
+            std::cerr << pipeline.name << ": failed to build" << std::endl;
+            ++failed;
+        }
+    }
+
+    std::ofstream ofs;
+    if (vm.count("output"))
+        ofs.open(vm["output"].as<std::string>());
+    std::ostream& os = ofs.is_open() ? ofs : std::cout;
+    {
+        cereal::JSONOutputArchive ar(os);
+        ar(cereal::make_nvp("width", vm["width"].as<int>()));
+        ar(cereal::make_nvp("height", vm["height"].as<int>()));
+        ar(cereal::make_nvp("channels", vm["channels"].as<int>()));
+        ar(cereal::make_nvp("warmup", warmup));
+        ar(cereal::make_nvp("pipelines", results));
+#ifdef HAVE_BLOB_PREPROCESSING
+        if (!preprocess_results.empty())
+            ar(cereal::make_nvp("preprocess", preprocess_results));
+#endif
+    }
+    os << std::endl;
+    return failed ? 1 : 0;
+}